@@ -16,6 +16,28 @@ typedef struct application_config {
   i16 start_height;
   // The application name used in windowing, if applicable.
   char *name;
+  // Run without a window or renderer, e.g. for scripted performance runs on
+  // machines that have no window system.
+  bool headless;
+  // If set, all input is recorded to this file.
+  const char *input_record_path;
+  // If set, input is played back from this file instead of being read from
+  // the platform. The application quits when the recording runs out.
+  const char *input_playback_path;
+  // Read input on a dedicated thread so it can be sampled with lower latency,
+  // see `input_sample_latest`.
+  bool input_thread;
+  // Frames per second to pace the main loop to, 0 for unlimited. Can be
+  // changed while running with `frame_pacer_set_target_fps`.
+  u32 target_fps;
+  // How often to log frame time statistics, 0 to never. See `frame_stats.h`.
+  f32 frame_stats_log_seconds;
+  // Job system workers to start, 0 for one per physical core besides the
+  // main thread's.
+  u32 job_worker_count;
+  // Draw frames on a dedicated thread while the main thread updates the next
+  // one, for a frame of latency. Ignored when headless.
+  bool render_thread;
 } application_config;
 
 KAPI bool application_create(struct game *game_inst);
@@ -3,16 +3,19 @@
 #include "defines.h"
 
 typedef struct clock {
-  f64 start_time;
+  // 0 while the clock is stopped.
+  u64 start_ns;
+  u64 elapsed_ns;
+  // `elapsed_ns` in seconds.
   f64 elapsed;
 } clock;
 
 // Updates the provided clock. Should be called just before checking elapsed
 // time. Has no effect on non-started  clocks.
-void clock_update(clock *clock);
+KAPI void clock_update(clock *clock);
 
 // Starts the provided clock, resets the elapsed time.
-void clock_start(clock *clock);
+KAPI void clock_start(clock *clock);
 
 // Stops the provided clock, does not reset elapsed time.
-void clock_stop(clock *clock);
+KAPI void clock_stop(clock *clock);
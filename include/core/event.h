@@ -21,6 +21,15 @@ typedef struct event_context {
 
     char c[16];
   } data;
+
+  // Optional variable-size payload for data that doesn't fit in `data`, such
+  // as text or paths. Must be allocated with `event_payload_allocate` (or set
+  // with `event_context_set_payload`); it is owned by the event system and
+  // stays valid until the end of the frame after the one it was allocated
+  // in, or if posted, until the end of the frame it is delivered in.
+  // Listeners that need it for longer must copy it.
+  void *payload;
+  u64 payload_size;
 } event_context;
 
 // Should return true if handled
@@ -31,20 +40,59 @@ bool event_initialize();
 void event_shutdown();
 
 /**
- * Register to listen for when events are sent with the provided code. Events
- * with duplicate listener/callback combos will not be registered again and will
- * cause this to return `false`.
+ * Identifies a single listener registration. Returned by `event_register` and
+ * accepted by `event_unregister_handle`. `EVENT_HANDLE_INVALID` (0) signals a
+ * failed registration, so handles can be tested like a `bool`.
+ */
+typedef u64 event_handle;
+
+#define EVENT_HANDLE_INVALID 0
+
+// Priority used by `event_register`. Listeners with a higher priority are
+// invoked first; listeners with equal priority are invoked in the order they
+// were registered.
+#define EVENT_PRIORITY_DEFAULT 0
+
+/**
+ * Register to listen for when events are sent with the provided code, using
+ * `EVENT_PRIORITY_DEFAULT`. Events with duplicate listener/callback combos
+ * will not be registered again and will cause this to return
+ * `EVENT_HANDLE_INVALID`.
+ * @param code The event code to listen for.
+ * @param listener A pointer to a listener instance. Can be 0/nullptr.
+ * @param on_event The callback function pointer to be invoked when the event
+ * code is fired.
+ * @returns A handle to the registration; `EVENT_HANDLE_INVALID` on failure.
+ */
+KAPI event_handle event_register(u16 code, void *listener,
+                                 PFN_on_event on_event);
+
+/**
+ * Same as `event_register`, with an explicit dispatch priority.
  * @param code The event code to listen for.
  * @param listener A pointer to a listener instance. Can be 0/nullptr.
  * @param on_event The callback function pointer to be invoked when the event
  * code is fired.
- * @returns `true` if the event is successfully registered; otherwise `false`.
+ * @param priority Higher values are invoked before lower values.
+ * @returns A handle to the registration; `EVENT_HANDLE_INVALID` on failure.
+ */
+KAPI event_handle event_register_priority(u16 code, void *listener,
+                                          PFN_on_event on_event, i32 priority);
+
+/**
+ * Unregister the listener identified by a handle returned from
+ * `event_register`. Runs in constant time. Safe to call from within an event
+ * callback, including for the listener currently being invoked.
+ * @param handle The registration to remove.
+ * @returns `true` if the listener was unregistered; `false` if the handle is
+ * invalid or was already unregistered.
  */
-KAPI bool event_register(u16 code, void *listener, PFN_on_event on_event);
+KAPI bool event_unregister_handle(event_handle handle);
 
 /**
  * Unregister from listening for when events are sent with the provided code. If
- * no matching registration is found, this function returns `false`.
+ * no matching registration is found, this function returns `false`. Prefer
+ * `event_unregister_handle`, which does not search the listeners of `code`.
  * @param code The event code to stop listening for.
  * @param listener A pointer to a listener instance. Can be 0/nullptr.
  * @param on_event The callback function pointer to be unregistered.
@@ -53,9 +101,9 @@ KAPI bool event_register(u16 code, void *listener, PFN_on_event on_event);
 KAPI bool event_unregister(u16 code, void *listener, PFN_on_event on_event);
 
 /**
- * Fires an event to listeners of the given code. If an event handler returns
- * `true`, the event is considered handled and is not passed on to any more
- * listeners.
+ * Fires an event to listeners of the given code, in priority order. If an
+ * event handler returns `true`, the event is considered handled and is not
+ * passed on to any more listeners.
  * @param code The event code to fire.
  * @param sender A pointer to the sender. Can be 0/nullptr.
  * @param data The event data.
@@ -63,6 +111,132 @@ KAPI bool event_unregister(u16 code, void *listener, PFN_on_event on_event);
  */
 KAPI bool event_fire(u16 code, void *sender, event_context data);
 
+/**
+ * Allocates memory for an event payload from the event system's frame arena.
+ * Never touches `kallocate`. May be called from any thread, so payloads can be
+ * attached to events sent with `event_post`. The memory is released
+ * automatically: it stays valid until the end of the frame after the one it
+ * was allocated in, which covers both `event_fire` and the next drain of
+ * posted events. Once posted, it stays valid until the event is delivered,
+ * however late; but it must be posted by the end of the frame after the one
+ * it was allocated in, or `event_post` rejects it.
+ * @param size The payload size in bytes.
+ * @returns The memory, or nullptr if the arena for this frame is exhausted.
+ */
+KAPI void *event_payload_allocate(u64 size);
+
+/**
+ * Copies `size` bytes from `data` into a new frame-arena payload and attaches
+ * it to `context`.
+ * @param context The context to attach the payload to.
+ * @param data The bytes to copy.
+ * @param size The number of bytes to copy.
+ * @returns `true` on success; `false` if the arena is exhausted, in which case
+ * `context` is left without a payload.
+ */
+KAPI bool event_context_set_payload(event_context *context, const void *data,
+                                    u64 size);
+
+/**
+ * Ends the current event frame, releasing the payloads allocated during the
+ * previous one. Called by the application once per frame.
+ */
+void event_end_frame();
+
+/**
+ * Starts recording every event passed to `event_fire` (code, data, payload,
+ * frame number and timestamp) into a compact binary file. Events fired from
+ * within a listener are not recorded, since replaying the event that caused
+ * them fires them again. Senders are not recorded.
+ * @param path The file to write. Overwritten if it exists.
+ * @returns `true` if recording started.
+ */
+KAPI bool event_recording_start(const char *path);
+
+/**
+ * Stops recording and flushes the file. Does nothing if not recording.
+ */
+KAPI void event_recording_stop();
+
+/**
+ * Opens a recording made with `event_recording_start` for replay. While
+ * replay is active the application feeds events from the file through
+ * `event_replay_frame` instead of pumping platform messages.
+ * @param path The recording to read.
+ * @returns `true` if the file was opened and is a valid recording.
+ */
+KAPI bool event_replay_start(const char *path);
+
+/**
+ * Closes the replay file. Does nothing if no replay is active.
+ */
+KAPI void event_replay_stop();
+
+/**
+ * @returns `true` while a replay file is open.
+ */
+KAPI bool event_replay_active();
+
+/**
+ * Fires every recorded event that belongs to the current frame, relative to
+ * when the replay started, with a nullptr sender.
+ * @returns `true` if the recording has more events left; `false` once it is
+ * exhausted.
+ */
+KAPI bool event_replay_frame();
+
+/**
+ * Marks an event code as coalesced, or clears the mark. Events fired with a
+ * coalesced code are not delivered immediately; instead only the latest
+ * payload (and sender) is kept and delivered once by
+ * `event_flush_coalesced`. Useful for floods such as mouse motion and
+ * interactive resizes where only the final value of a frame matters.
+ * Un-marking a code delivers any payload still being held.
+ * @param code The event code to change.
+ * @param coalesce `true` to coalesce the code, `false` to deliver it
+ * immediately again.
+ * @returns `true` on success; `false` if the limit of coalesced codes is
+ * reached or the event system is not initialized.
+ */
+KAPI bool event_set_coalesced(u16 code, bool coalesce);
+
+/**
+ * Delivers the latest held payload of every coalesced code that was fired
+ * since the last flush. The application calls this once per frame after
+ * platform messages have been pumped.
+ * @returns The number of events delivered.
+ */
+KAPI u32 event_flush_coalesced();
+
+/**
+ * @returns The total number of events that were collapsed into a later event
+ * with the same code, and therefore never delivered on their own.
+ */
+KAPI u64 event_get_collapsed_count();
+
+/**
+ * Posts an event to the main thread. Safe to call from any thread; the event
+ * is queued in a lock-free inbox and delivered through `event_fire` on the
+ * next call to `event_drain_posted`. Events posted from the same thread are
+ * delivered in order.
+ * @param code The event code to fire.
+ * @param sender A pointer to the sender. Can be 0/nullptr. Must still be valid
+ * when the event is drained.
+ * @param data The event data.
+ * @returns `true` if the event was queued; `false` if the inbox is full, the
+ * payload was allocated too long ago (see `event_payload_allocate`), or the
+ * event system is not initialized.
+ */
+KAPI bool event_post(u16 code, void *sender, event_context data);
+
+/**
+ * Fires every event posted with `event_post` since the last drain. Must only
+ * be called from the main thread; the application calls this once per frame
+ * right after pumping platform messages.
+ * @returns The number of events delivered.
+ */
+KAPI u32 event_drain_posted();
+
 // System internal event codes. Application should use codes beyond 255.
 typedef enum system_event_code : u16 {
   // Shuts the application down on the next frame.
@@ -112,5 +286,12 @@ typedef enum system_event_code : u16 {
    */
   EVENT_CODE_RESIZED = 0x08,
 
+  // Changes the runtime level of a log category, see log_category_set_level.
+  /* Context usage:
+   * `u8 category = data.data.u8[0];` (LOG_CATEGORY_MAX for all of them)
+   * `u8 level = data.data.u8[1];`
+   */
+  EVENT_CODE_LOG_LEVEL = 0x09,
+
   MAX_EVENT_CODE = 0xFF,
 } system_event_code;
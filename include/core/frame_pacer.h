@@ -0,0 +1,46 @@
+#pragma once
+
+#include "defines.h"
+
+/**
+ * Holds the main loop to a target frame rate. Frames are released on a fixed
+ * grid of deadlines: the pacer sleeps until shortly before the deadline and
+ * spins for the rest, so that frame times stay steady without keeping a core
+ * busy for the whole wait. How long to spin adapts to how late the OS has
+ * been waking the thread up.
+ */
+
+typedef struct frame_pacer_stats {
+  // 0 when unlimited.
+  u32 target_fps;
+  // Frames that finished after their deadline had already passed.
+  u64 missed_deadlines;
+  // How long after its deadline the last frame was released.
+  u64 last_overshoot_ns;
+  // Moving average of `last_overshoot_ns`.
+  u64 average_overshoot_ns;
+  u64 max_overshoot_ns;
+  // How long before a deadline the pacer stops sleeping and starts spinning.
+  u64 spin_ns;
+} frame_pacer_stats;
+
+/**
+ * @param target_fps Frames per second to pace to, 0 for unlimited.
+ */
+void frame_pacer_initialize(u32 target_fps);
+
+/**
+ * Changes the target frame rate from the next frame on.
+ * @param target_fps Frames per second to pace to, 0 for unlimited.
+ */
+KAPI void frame_pacer_set_target_fps(u32 target_fps);
+
+KAPI u32 frame_pacer_get_target_fps();
+
+/**
+ * Waits until the current frame's deadline. Called once at the end of every
+ * frame. Returns immediately when unlimited or when the deadline has passed.
+ */
+void frame_pacer_wait();
+
+KAPI void frame_pacer_get_stats(frame_pacer_stats *out_stats);
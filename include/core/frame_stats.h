@@ -0,0 +1,79 @@
+#pragma once
+
+#include "core/profiler.h"
+#include "defines.h"
+
+/**
+ * Frame time statistics over a rolling window of the most recent frames.
+ * The main loop records every frame; the summary is computed on request.
+ */
+
+// Frames kept in the rolling window.
+#define FRAME_STATS_WINDOW 512
+
+// A frame is a stutter when its CPU time exceeds the budget by this factor,
+// unless changed with `frame_stats_set_stutter_factor`.
+#define FRAME_STATS_DEFAULT_STUTTER_FACTOR 1.5F
+
+typedef struct frame_sample {
+  // From the start of the frame until it started waiting for its deadline.
+  u64 cpu_ns;
+  // The game's update.
+  u64 update_ns;
+  // The game's render and the renderer's frame.
+  u64 render_ns;
+  // Spent in the frame pacer.
+  u64 wait_ns;
+  // Hardware events during cpu_ns, 0 unless the profiler counts them.
+  u64 counters[PROFILE_COUNTER_COUNT];
+} frame_sample;
+
+typedef struct frame_time_summary {
+  u64 average_ns;
+  u64 p50_ns;
+  u64 p95_ns;
+  u64 p99_ns;
+  u64 max_ns;
+} frame_time_summary;
+
+typedef struct frame_stats_report {
+  // Frames in the window.
+  u32 frame_count;
+  u64 total_frames;
+  frame_time_summary cpu;
+  frame_time_summary update;
+  frame_time_summary render;
+  frame_time_summary wait;
+  // Average hardware events per frame.
+  u64 counters[PROFILE_COUNTER_COUNT];
+  u64 budget_ns;
+  f32 stutter_factor;
+  // Frames over budget * stutter_factor, in the window and since startup.
+  u32 window_stutters;
+  u64 total_stutters;
+} frame_stats_report;
+
+/**
+ * @param log_interval_seconds How often to log a summary, 0 to never.
+ */
+void frame_stats_initialize(f32 log_interval_seconds);
+
+/**
+ * Adds a frame to the window, and logs a summary when one is due.
+ */
+void frame_stats_record(const frame_sample *sample);
+
+/**
+ * Sets the CPU time a frame is meant to take. 0, the default, follows the
+ * frame pacer's target rate, or 60 frames per second when it is unlimited.
+ */
+KAPI void frame_stats_set_budget(u64 budget_ns);
+
+KAPI void frame_stats_set_stutter_factor(f32 factor);
+
+KAPI void frame_stats_set_log_interval(f32 seconds);
+
+/**
+ * Summarizes the frames in the window.
+ */
+KAPI void frame_stats_get_report(frame_stats_report *out_report);
@@ -143,6 +143,39 @@ typedef enum keys : u8 {
   DEFINE_KEY(RBRACKET, 0xC2),
 } keys;
 
+typedef enum input_event_type : u8 {
+  INPUT_EVENT_KEY,
+  INPUT_EVENT_BUTTON,
+  INPUT_EVENT_MOUSE_MOVE,
+  INPUT_EVENT_MOUSE_WHEEL,
+} input_event_type;
+
+/**
+ * A single raw input, as reported by the platform layer, stamped with the
+ * absolute time (see `platform_get_absolute_time`) at which it was processed.
+ */
+typedef struct input_event {
+  f64 timestamp;
+  input_event_type type;
+  union {
+    struct {
+      keys key;
+      bool pressed;
+    } key;
+    struct {
+      buttons button;
+      bool pressed;
+    } button;
+    struct {
+      i16 x;
+      i16 y;
+    } move;
+    struct {
+      i8 z_delta;
+    } wheel;
+  };
+} input_event;
+
 void input_initialize();
 void input_shutdown();
 void input_update(f64 delta_time);
@@ -154,6 +187,19 @@ KAPI bool input_was_key_up(keys key);
 
 void input_process_key(keys key, bool pressed);
 
+// Number of u64 words returned by `input_get_state_bits`: four for the 256
+// key codes and one for mouse buttons.
+#define INPUT_STATE_WORDS 5
+#define INPUT_STATE_BUTTON_WORD 4
+
+/**
+ * @returns The current key and button state packed one bit per input: bit
+ * `key % 64` of word `key / 64` is set while `key` is down, and bit `button`
+ * of word `INPUT_STATE_BUTTON_WORD` while `button` is down. Lets callers test
+ * many inputs at once with bitmask operations.
+ */
+const u64 *input_get_state_bits();
+
 KAPI bool input_is_button_down(buttons button);
 KAPI bool input_is_button_up(buttons button);
 KAPI bool input_was_button_down(buttons button);
@@ -161,6 +207,110 @@ KAPI bool input_was_button_up(buttons button);
 KAPI void input_get_mouse_position(i32 *x, i32 *y);
 KAPI void input_get_previous_mouse_position(i32 *x, i32 *y);
 
+/**
+ * @returns The number of raw input events received since the last frame, in
+ * the order they arrived. Unlike the current/previous state queries, this
+ * sees every press and release even when several happen within one frame.
+ */
+KAPI u32 input_get_frame_event_count();
+
+/**
+ * Gets a raw input event received since the last frame.
+ * @param index The index of the event, 0 being the oldest; must be less than
+ * `input_get_frame_event_count()`.
+ * @returns A pointer to the event, valid until the next frame.
+ */
+KAPI const input_event *input_get_frame_event(u32 index);
+
+/**
+ * @returns The number of input events that arrived within a single frame but
+ * did not fit in the event buffer, since startup.
+ */
+KAPI u64 input_get_dropped_event_count();
+
+/**
+ * Starts recording every call to the `input_process_*` functions, together
+ * with the frame it happened in, into a binary file. Cannot be combined with
+ * playback.
+ * @param path The file to write. Overwritten if it exists.
+ * @returns `true` if recording started.
+ */
+KAPI bool input_recording_start(const char *path);
+
+/**
+ * Stops recording and flushes the file. Does nothing if not recording.
+ */
+KAPI void input_recording_stop();
+
+/**
+ * Opens a recording made with `input_recording_start` for playback. While
+ * playback is active the application injects input from the file with
+ * `input_playback_frame` instead of pumping platform messages.
+ * @param path The recording to read.
+ * @returns `true` if the file was opened and is a valid recording.
+ */
+KAPI bool input_playback_start(const char *path);
+
+/**
+ * Closes the playback file. Does nothing if no playback is active.
+ */
+KAPI void input_playback_stop();
+
+/**
+ * @returns `true` while a playback file is open.
+ */
+KAPI bool input_playback_active();
+
+/**
+ * Injects every recorded input that belongs to the current frame, relative
+ * to when playback started, as if the platform layer had reported it.
+ * @returns `true` if the recording has more input left; `false` once it is
+ * exhausted.
+ */
+bool input_playback_frame();
+
 void input_process_button(buttons button, bool pressed);
 void input_process_mouse_move(i16 x, i16 y);
 void input_process_mouse_wheel(i8 z_delta);
+
+/**
+ * Switches the `input_process_*` functions between applying input directly
+ * and handing it over from a dedicated platform input thread. While threaded
+ * they may only be called from that one thread; input is queued for
+ * `input_drain_posted` and also published immediately for
+ * `input_sample_latest`. Must be called on the main thread while the input
+ * thread is not running.
+ */
+void input_set_threaded(bool threaded);
+
+/**
+ * Applies input queued by the platform input thread, in arrival order and
+ * with the time it arrived: updates state, fills the frame's event buffer
+ * and fires the input events. Call on the main thread once per frame, after
+ * pumping platform messages. Does nothing when input is not threaded.
+ * @returns The number of inputs applied.
+ */
+u32 input_drain_posted();
+
+/**
+ * The freshest known input state, see `input_sample_latest`.
+ */
+typedef struct input_snapshot {
+  // Packed key and button state, laid out like `input_get_state_bits`.
+  u64 state_bits[INPUT_STATE_WORDS];
+  i32 mouse_x;
+  i32 mouse_y;
+  // Absolute time at which the newest input included here arrived.
+  f64 timestamp;
+} input_snapshot;
+
+/**
+ * Samples the most recent input state without waiting for the next frame.
+ * With a dedicated input thread this includes input that arrived after the
+ * frame started, so code that runs late in the frame, such as camera updates
+ * right before rendering is recorded, can latch the newest mouse position.
+ * Without one it matches the current frame state. Safe to call from any
+ * thread and never blocks the input thread.
+ * @param out_snapshot Receives the state.
+ */
+KAPI void input_sample_latest(input_snapshot *out_snapshot);
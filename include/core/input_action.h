@@ -0,0 +1,82 @@
+#pragma once
+
+#include "core/input.h"
+#include "defines.h"
+
+/**
+ * Named game actions ("jump", "fire", ...) bound to keys and mouse buttons.
+ * All actions are evaluated together once per frame with bitmask operations
+ * over the packed input state, so querying an action is a single bit test and
+ * the set of actions that changed is available as one mask.
+ */
+
+// Actions are tracked as bits of a u64.
+#define MAX_INPUT_ACTIONS 64
+#define MAX_ACTION_BINDINGS 8
+
+#define INPUT_ACTION_INVALID 0xFF
+
+typedef u8 action_id;
+
+typedef enum input_modifier : u8 {
+  INPUT_MODIFIER_NONE = 0,
+  INPUT_MODIFIER_SHIFT = 1 << 0,
+  INPUT_MODIFIER_CONTROL = 1 << 1,
+  INPUT_MODIFIER_ALT = 1 << 2,
+} input_modifier;
+
+void input_action_initialize();
+void input_action_shutdown();
+
+/**
+ * Re-evaluates every action against the current input state. Called by the
+ * application once per frame after input has been pumped and before the game
+ * updates.
+ */
+void input_action_update();
+
+/**
+ * Registers a new action, or returns the existing one with the same name.
+ * @param name The action's name. Copied.
+ * @returns The action's id; `INPUT_ACTION_INVALID` if `MAX_INPUT_ACTIONS` are
+ * already registered.
+ */
+KAPI action_id input_action_register(const char *name);
+
+/**
+ * @returns The id of the action with the given name; `INPUT_ACTION_INVALID`
+ * if there is none.
+ */
+KAPI action_id input_action_find(const char *name);
+
+/**
+ * Binds a key to an action. The action is down while the key is down and all
+ * of `modifiers` are held (either side of the keyboard counts).
+ * @returns `true` if the binding was added; `false` if the action is invalid
+ * or already has `MAX_ACTION_BINDINGS` bindings.
+ */
+KAPI bool input_action_bind_key(action_id action, keys key,
+                                input_modifier modifiers);
+
+/**
+ * Binds a mouse button to an action. See `input_action_bind_key`.
+ */
+KAPI bool input_action_bind_button(action_id action, buttons button,
+                                   input_modifier modifiers);
+
+/**
+ * Removes every binding of an action. The action itself stays registered.
+ */
+KAPI void input_action_clear_bindings(action_id action);
+
+// True while any binding of the action is held.
+KAPI bool input_action_down(action_id action);
+// True on the frame the action went from up to down.
+KAPI bool input_action_pressed(action_id action);
+// True on the frame the action went from down to up.
+KAPI bool input_action_released(action_id action);
+
+// Bit `action` is set for every action that is currently down.
+KAPI u64 input_actions_down_mask();
+// Bit `action` is set for every action that went down or up this frame.
+KAPI u64 input_actions_changed_mask();
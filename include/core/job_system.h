@@ -0,0 +1,102 @@
+#pragma once
+
+#include "defines.h"
+
+/**
+ * Runs small units of work, jobs, on a worker thread per physical core. Each
+ * thread that submits jobs pushes them to a deque of its own, which it pops
+ * from the bottom while idle workers steal from the top, so that work spreads
+ * out without a shared queue to contend on. A job is ready as soon as it is
+ * submitted; work that depends on other work waits on the counter of the jobs
+ * it needs, and waiting runs other jobs until the counter reaches zero rather
+ * than blocking the thread.
+ *
+ * Jobs that wait for long, such as asset loads, can run on a fiber with a
+ * stack of its own instead. Waiting then suspends the job, its thread moves
+ * on to other jobs, and the job resumes on whichever thread next looks for
+ * work once its counter has reached zero.
+ */
+
+// Threads, workers and the main thread included, that can submit jobs.
+#define JOB_MAX_THREADS 64
+
+// Jobs a thread can have submitted and not yet finished. Submitting past it
+// first helps run jobs until the oldest one finishes. Must be a power of two.
+#define JOB_QUEUE_CAPACITY 1024
+
+// Fibers in the pool fiber jobs run on, and the size of their stacks. A fiber
+// job submitted while all are in use runs as a plain job.
+#define JOB_FIBER_COUNT 128
+#define JOB_FIBER_STACK_SIZE (64ULL * 1024)
+
+typedef void (*job_entry)(void *params);
+
+typedef struct job_desc {
+  job_entry entry;
+  void *params;
+  // Names the job in profiles, nullptr for "job". Must live until the
+  // profile is exported.
+  const char *name;
+  // Run on a fiber, so that `job_wait` suspends the job rather than its
+  // thread. The job may then continue on another thread, so it must not
+  // keep thread locals' addresses or profiler zones across a wait.
+  bool fiber;
+} job_desc;
+
+/**
+ * Counts the jobs of a batch that are not finished yet. Zeroed means none,
+ * and may be reused once it has reached zero again.
+ */
+typedef struct job_counter {
+  katomic u32 value;
+} job_counter;
+
+typedef struct job_system_stats {
+  u32 worker_count;
+  // Since the job system started, over all threads.
+  u64 jobs_executed;
+  // Jobs taken from another thread's deque.
+  u64 steals;
+  // Time the workers spent asleep for lack of jobs, counted as they wake up.
+  u64 idle_ns;
+} job_system_stats;
+
+/**
+ * Starts the workers. The calling thread becomes the main thread, which does
+ * not get a worker of its own but runs jobs while it waits for them.
+ * @param worker_count Workers to start, 0 for one per physical core besides
+ * the main thread's.
+ */
+KAPI bool job_system_initialize(u32 worker_count);
+
+/**
+ * Waits for the jobs that were submitted to finish and stops the workers.
+ */
+KAPI void job_system_shutdown();
+
+/**
+ * Submits jobs for any thread to run.
+ * @param counter If not nullptr, incremented by `count` and decremented as
+ * each job finishes, to wait for them with `job_wait`.
+ */
+KAPI void job_run(const job_desc *jobs, u32 count, job_counter *counter);
+
+/**
+ * Runs jobs until `counter` reaches zero, so that the jobs it counts can
+ * depend on jobs they submit themselves. Called from a fiber job, suspends
+ * it until then instead, and `counter` must stay valid meanwhile.
+ */
+KAPI void job_wait(job_counter *counter);
+
+/**
+ * Workers started, not counting the main thread.
+ */
+KAPI u32 job_system_worker_count();
+
+KAPI void job_system_get_stats(job_system_stats *out_stats);
+
+/**
+ * Plots the jobs run, steals and worker idle time of the frame that ends in
+ * the profiler. Called once per frame by the main loop.
+ */
+void job_system_frame_end();
@@ -10,6 +10,7 @@ typedef enum memory_tag : u64 {
   MEMORY_TAG_RING_QUEUE,
   MEMORY_TAG_BST,
   MEMORY_TAG_STRING,
+  MEMORY_TAG_LINEAR_ALLOCATOR,
   MEMORY_TAG_APPLICATION,
   MEMORY_TAG_JOB,
   MEMORY_TAG_TEXTURE,
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "defines.h"
+
+/**
+ * Data-parallel loops over the job system. A range of `count` elements is
+ * split into chunks of at least `grain` elements, which run as jobs; the
+ * calling thread runs chunks too until all are done.
+ *
+ * Chunks start at multiples of KPARALLEL_ALIGN_ELEMENTS, which for elements
+ * of any size are cache line boundaries of an array aligned to one, so that
+ * no two threads write to the same cache line. Each chunk should therefore
+ * only write to the elements of its own range.
+ */
+
+// Chunk sizes are rounded up to a multiple of this many elements.
+#define KPARALLEL_ALIGN_ELEMENTS 64
+
+// Chunks per thread a range is split into when no grain is given, so that
+// threads that finish early can take over some of the work of the others.
+#define KPARALLEL_CHUNKS_PER_THREAD 4
+
+// Most chunks a range is split into, larger grains are used past it.
+#define KPARALLEL_MAX_CHUNKS 128
+
+/**
+ * Processes the elements `[start, end)` of a range.
+ */
+typedef void (*kparallel_for_fn)(u64 start, u64 end, void *context);
+
+/**
+ * Folds the elements `[start, end)` of a range into `partial`.
+ */
+typedef void (*kparallel_reduce_fn)(u64 start, u64 end, void *context,
+                                    void *partial);
+
+/**
+ * Folds `partial` into `result`. Called for the partials in the order of
+ * their ranges, so the operation only needs to be associative.
+ */
+typedef void (*kparallel_combine_fn)(void *result, const void *partial,
+                                     void *context);
+
+/**
+ * Calls `fn` on chunks covering `[0, count)` in parallel and returns once
+ * all have returned.
+ * @param grain Fewest elements per chunk, 0 to split the range evenly over
+ * the threads.
+ */
+KAPI void kparallel_for(u64 count, u64 grain, kparallel_for_fn fn,
+                        void *context);
+
+/**
+ * Reduces `[0, count)` in parallel: each chunk is folded with `reduce` into
+ * a partial result, and the partials are then folded into `result` with
+ * `combine` on the calling thread.
+ * @param grain Fewest elements per chunk, 0 to split the range evenly over
+ * the threads.
+ * @param result Holds the identity of the operation on entry, such as 0 for
+ * a sum, which each partial starts as a copy of. Receives the result.
+ * @param result_size Size in bytes of `result` and the partials.
+ */
+KAPI void kparallel_reduce(u64 count, u64 grain, kparallel_reduce_fn reduce,
+                           kparallel_combine_fn combine, void *context,
+                           void *result, u64 result_size);
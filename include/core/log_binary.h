@@ -0,0 +1,78 @@
+#pragma once
+
+#include "core/logger.h"
+#include "defines.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+/**
+ * Deferred-format logging. Instead of formatting a message at the call site,
+ * the arguments are captured as raw values next to the format string, and
+ * formatted later: on the log writer thread for the console, or offline from
+ * a binary log file with the klogdecode tool.
+ *
+ * Enabled with the `binary_log` meson option. Format strings must then live
+ * for the whole run, which string literals passed to the k* macros do.
+ */
+
+// Upper bound on the captured arguments of a single message.
+#define LOG_BINARY_MAX_ARGS_SIZE 512
+// Longer string arguments are truncated to this many bytes.
+#define LOG_BINARY_MAX_STRING 255
+
+typedef enum log_arg_type : u8 {
+  LOG_ARG_I32 = 1,
+  LOG_ARG_I64,
+  LOG_ARG_F64,
+  LOG_ARG_STRING,
+  LOG_ARG_POINTER,
+} log_arg_type;
+
+/**
+ * Captures the arguments described by a printf-style format string as a
+ * sequence of tagged values. Does not touch the format string's `%n`
+ * targets.
+ * @param format The format string.
+ * @param args The arguments. Consumed.
+ * @param out Receives the captured values.
+ * @param capacity The size of `out`. Arguments that do not fit are dropped
+ * and formatted as `<?>`.
+ * @returns The number of bytes written to `out`.
+ */
+u32 log_binary_capture_args(const char *format, va_list args, u8 *out,
+                            u32 capacity);
+
+/**
+ * Formats a message from a format string and arguments captured with
+ * `log_binary_capture_args`, like `snprintf` would have.
+ * @returns The number of characters written, excluding the terminator.
+ */
+KAPI u32 log_binary_format(const char *format, const u8 *args, u32 args_size,
+                           char *out, u32 capacity);
+
+/**
+ * Writes the header of a binary log file.
+ */
+void log_binary_write_header(FILE *file);
+
+/**
+ * Defines the format string that later messages refer to by `format_id`.
+ */
+void log_binary_write_format(FILE *file, u32 format_id, const char *format);
+
+/**
+ * Writes one message to a binary log file.
+ * @param thread_index Identifies the thread the message was logged from.
+ */
+void log_binary_write_message(FILE *file, log_level level, u32 format_id,
+                              f64 timestamp, u32 thread_index, const u8 *args,
+                              u32 args_size);
+
+/**
+ * Decodes a binary log file into text, one message per line.
+ * @param in The binary log, positioned at its start.
+ * @param out Receives the text.
+ * @returns `true` if the whole file was decoded.
+ */
+KAPI bool log_binary_decode(FILE *in, FILE *out);
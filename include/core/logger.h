@@ -11,34 +11,164 @@ typedef enum log_level {
   LOG_LEVEL_TRACE = 5,
 } log_level;
 
-bool initialize_logging();
-void shutdown_logging();
+/**
+ * The subsystem a message comes from. Each category has its own runtime
+ * level, see `log_category_set_level`.
+ */
+typedef enum log_category : u8 {
+  LOG_CATEGORY_CORE,
+  LOG_CATEGORY_MEMORY,
+  LOG_CATEGORY_EVENT,
+  LOG_CATEGORY_INPUT,
+  LOG_CATEGORY_PLATFORM,
+  LOG_CATEGORY_RENDERER,
+  LOG_CATEGORY_VULKAN,
+  LOG_CATEGORY_GAME,
+  LOG_CATEGORY_MAX
+} log_category;
+
+/**
+ * The category the k* macros log to. Define it before any include to pick a
+ * different one for a whole file. Code outside the engine logs to
+ * LOG_CATEGORY_GAME by default.
+ */
+#if !defined(KLOG_CATEGORY)
+#if defined(KEXPORT)
+#define KLOG_CATEGORY LOG_CATEGORY_CORE
+#else
+#define KLOG_CATEGORY LOG_CATEGORY_GAME
+#endif
+#endif
+
+/**
+ * Most verbose level logged per category, indexed by log_category. Read
+ * directly by the logging macros; change it with `log_category_set_level`.
+ * A stale read on another thread only delays a level change, so it is a
+ * plain byte.
+ */
+KAPI extern u8 log_category_levels[LOG_CATEGORY_MAX];
+
+/**
+ * `true` if a message of `level` in `category` would be logged at runtime.
+ * Compile-time levels (the `log_level` meson option) still apply on top.
+ */
+#define KLOG_ENABLED(category, level)                                          \
+  ((level) <= log_category_levels[category])
+
+/**
+ * Sets the most verbose level logged for a category. Fatal messages are
+ * always logged.
+ */
+KAPI void log_category_set_level(log_category category, log_level level);
+
+KAPI log_level log_category_get_level(log_category category);
+
+/**
+ * @returns The lower case name of a category, as used in config files.
+ */
+KAPI const char *log_category_name(log_category category);
+
+/**
+ * Applies category levels from a text file with one `category=level` pair
+ * per line, e.g. `vulkan=warn`. `*` stands for every category, names are
+ * those of `log_category_name` and the lower case level names, and lines
+ * starting with `#` are comments.
+ * @returns `true` if the file was read; unknown entries are skipped with a
+ * warning.
+ */
+KAPI bool log_categories_load(const char *path);
+
+/**
+ * Logging state of one call site, created by the logging macros.
+ */
+typedef struct log_site {
+  const char *file;
+  u32 line;
+  // Messages per second allowed from this site; 0 defers to the category's
+  // limit, see log_category_set_rate_limit.
+  u32 limit;
+  _Atomic u64 window_start_ms;
+  _Atomic u32 count;
+  _Atomic u32 suppressed;
+} log_site;
+
+/**
+ * Limits how many messages per second each call site in a category may log.
+ * Sites that pass their own limit to the k*_limited macros keep it.
+ * @param messages_per_second The limit, or 0 for none, the default.
+ */
+KAPI void log_category_set_rate_limit(log_category category,
+                                      u32 messages_per_second);
+
+/**
+ * Decides whether a call site may log now under its rate limit. When a new
+ * one-second window starts, first logs how many of the site's messages were
+ * suppressed in the last one.
+ */
+KAPI bool log_site_admit(log_site *site, log_category category,
+                         log_level level);
+
+KAPI bool initialize_logging();
+KAPI void shutdown_logging();
+
+// The "[LEVEL]: " prefix messages of `level` are written with.
+const char *log_level_prefix(log_level level);
 
 KAPI void log_output(log_level level, ...);
 
+// Logs only if enabled for KLOG_CATEGORY at runtime, without evaluating the
+// arguments otherwise, and if the call site is within its rate limit.
+#define KLOG_CHECKED_LIMITED(level, per_second, ...)                           \
+  do {                                                                         \
+    if (KLOG_ENABLED(KLOG_CATEGORY, level)) {                                  \
+      static log_site klog_site = {                                            \
+          .file = __FILE__, .line = __LINE__, .limit = per_second};            \
+      if (log_site_admit(&klog_site, KLOG_CATEGORY, level)) {                  \
+        log_output(level, __VA_ARGS__);                                        \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+#define KLOG_CHECKED(level, ...) KLOG_CHECKED_LIMITED(level, 0, __VA_ARGS__)
+
 #define kfatal(...) log_output(LOG_LEVEL_FATAL, __VA_ARGS__)
-#define kerror(...) log_output(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define kerror(...) KLOG_CHECKED(LOG_LEVEL_ERROR, __VA_ARGS__)
+// Logs at most `per_second` messages per second from this call site.
+#define kerror_limited(per_second, ...)                                        \
+  KLOG_CHECKED_LIMITED(LOG_LEVEL_ERROR, per_second, __VA_ARGS__)
 
 #if defined(LOG_WARN_ENABLED)
-#define kwarn(...) log_output(LOG_LEVEL_WARN, __VA_ARGS__)
+#define kwarn(...) KLOG_CHECKED(LOG_LEVEL_WARN, __VA_ARGS__)
+#define kwarn_limited(per_second, ...)                                         \
+  KLOG_CHECKED_LIMITED(LOG_LEVEL_WARN, per_second, __VA_ARGS__)
 #else
 #define kwarn(...)
+#define kwarn_limited(per_second, ...)
 #endif
 
 #if defined(LOG_INFO_ENABLED)
-#define kinfo(...) log_output(LOG_LEVEL_INFO, __VA_ARGS__)
+#define kinfo(...) KLOG_CHECKED(LOG_LEVEL_INFO, __VA_ARGS__)
+#define kinfo_limited(per_second, ...)                                         \
+  KLOG_CHECKED_LIMITED(LOG_LEVEL_INFO, per_second, __VA_ARGS__)
 #else
 #define kinfo(...)
+#define kinfo_limited(per_second, ...)
 #endif
 
 #if defined(LOG_DEBUG_ENABLED)
-#define kdebug(...) log_output(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define kdebug(...) KLOG_CHECKED(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define kdebug_limited(per_second, ...)                                        \
+  KLOG_CHECKED_LIMITED(LOG_LEVEL_DEBUG, per_second, __VA_ARGS__)
 #else
 #define kdebug(...)
+#define kdebug_limited(per_second, ...)
 #endif
 
 #if defined(LOG_TRACE_ENABLED)
-#define ktrace(...) log_output(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define ktrace(...) KLOG_CHECKED(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define ktrace_limited(per_second, ...)                                        \
+  KLOG_CHECKED_LIMITED(LOG_LEVEL_TRACE, per_second, __VA_ARGS__)
 #else
 #define ktrace(...)
+#define ktrace_limited(per_second, ...)
 #endif
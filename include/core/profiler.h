@@ -0,0 +1,243 @@
+#pragma once
+
+#include "defines.h"
+
+/**
+ * Instrumented CPU profiler. Code marks zones with `KPROFILE_SCOPE`, which
+ * last until the end of the enclosing block. Each thread records the zones it
+ * closes into a ring of its own, so recording takes no lock. Zones closed on
+ * the main thread are aggregated per frame, and the zones of every thread can
+ * be exported as a Chrome trace, which chrome://tracing and
+ * https://ui.perfetto.dev open. Values such as queue lengths can be recorded
+ * alongside with `KPROFILE_PLOT`, and are plotted over time there.
+ *
+ * Enabled with the `profiler` meson option. Without it, the KPROFILE_*
+ * macros expand to nothing.
+ *
+ * Optionally, each thread also counts hardware events while it runs, and
+ * zones and frames carry how many occurred during them. Where the counters
+ * cannot be opened, for instance when perf_event_paranoid forbids it on
+ * Linux or on other platforms, their values stay 0.
+ *
+ * Sampling covers the code no zone marks. While it is on, the threads that
+ * record zones are interrupted at a fixed rate of the CPU time they use, and
+ * their call stacks are kept in per-thread rings. It can be switched on and
+ * off while the application runs, and exports folded stacks, one line per
+ * distinct stack with its frames outermost first separated by `;` and then
+ * its sample count, which flamegraph.pl, inferno and speedscope read. The
+ * stacks are walked through frame pointers, which the `profiler` option keeps
+ * in the engine's code. Linux on x86_64 only.
+ */
+
+// Zones kept per thread; older ones are overwritten. Must be a power of two.
+#define PROFILE_RING_CAPACITY 65536
+
+// Distinct zones aggregated per frame, further ones are left out.
+#define PROFILE_MAX_FRAME_ZONES 128
+
+// Call stacks kept per thread while sampling; older ones are overwritten.
+// Must be a power of two.
+#define PROFILE_SAMPLE_CAPACITY 16384
+
+// Samples per second of CPU time. Prime, so as not to run in step with work
+// done at a round rate.
+#define PROFILE_DEFAULT_SAMPLE_FREQUENCY 997
+
+// Where samples are exported unless configured otherwise.
+#define PROFILE_SAMPLES_PATH "profile.folded"
+
+// Hardware events counted per thread, in user space only.
+typedef enum profile_counter {
+  PROFILE_COUNTER_CYCLES,
+  PROFILE_COUNTER_INSTRUCTIONS,
+  // L1 data cache read misses.
+  PROFILE_COUNTER_L1D_MISSES,
+  // Last level cache misses.
+  PROFILE_COUNTER_LLC_MISSES,
+  PROFILE_COUNTER_BRANCH_MISSES,
+  PROFILE_COUNTER_COUNT
+} profile_counter;
+
+typedef struct profile_zone {
+  const char *name;
+  u64 start_ns;
+  // Nesting depth on the opening thread, 0 being outermost.
+  u32 depth;
+  // The thread's counters when the zone opened.
+  u64 counters[PROFILE_COUNTER_COUNT];
+} profile_zone;
+
+/**
+ * The zones of one name closed during a frame.
+ */
+typedef struct profile_zone_stats {
+  const char *name;
+  // Inclusive of nested zones.
+  u64 total_ns;
+  u64 max_ns;
+  u32 calls;
+  // Shallowest nesting depth the zone was seen at, 0 being outermost.
+  u32 depth;
+  // Hardware events, inclusive of nested zones.
+  u64 counters[PROFILE_COUNTER_COUNT];
+} profile_zone_stats;
+
+typedef struct profile_frame {
+  u64 frame_index;
+  u64 start_ns;
+  u64 duration_ns;
+  // Hardware events on the thread that ends frames, over the whole frame.
+  u64 counters[PROFILE_COUNTER_COUNT];
+  u32 zone_count;
+  // In the order the zones were first closed.
+  profile_zone_stats zones[PROFILE_MAX_FRAME_ZONES];
+} profile_frame;
+
+/**
+ * A timeline of zones timed by something other than the CPU thread that
+ * records them, such as the GPU. Shown next to the threads in exported
+ * traces.
+ */
+typedef struct profile_ring profile_track;
+
+typedef struct profiler_config {
+  // Whether threads count hardware events. Reading them costs a system call
+  // at each end of every zone.
+  bool hardware_counters;
+  // Samples per second to start sampling at, 0 to not sample from the start.
+  u32 sample_frequency;
+  // Where samples are exported when sampling is switched off from outside
+  // the process, PROFILE_SAMPLES_PATH if nullptr.
+  const char *samples_path;
+} profiler_config;
+
+#if defined(KPROFILE_ENABLED)
+
+bool profiler_initialize(profiler_config config);
+void profiler_shutdown();
+
+/**
+ * Opens a zone on the calling thread. Prefer `KPROFILE_SCOPE`.
+ * @param name Must live until the profile is exported, which string
+ * literals and `__func__` do.
+ */
+KAPI profile_zone profile_zone_begin(const char *name);
+
+/**
+ * Closes a zone opened with `profile_zone_begin` and records it in the
+ * calling thread's ring.
+ */
+KAPI void profile_zone_end(profile_zone *zone);
+
+/**
+ * Names the calling thread in exported traces. `name` must live until the
+ * profile is exported.
+ */
+KAPI void profiler_set_thread_name(const char *name);
+
+/**
+ * Reads the calling thread's hardware counters, the ones that are not counted
+ * as 0.
+ * @returns `false` if the thread does not count any.
+ */
+KAPI bool profiler_read_counters(u64 out_values[PROFILE_COUNTER_COUNT]);
+
+/**
+ * Records the current value of a quantity, such as a queue's length or work
+ * done in the last frame. Exported traces plot each name's values over time.
+ * @param name Must live until the profile is exported.
+ */
+KAPI void profiler_plot(const char *name, u64 value);
+
+/**
+ * Creates a track, kept until the profiler shuts down.
+ * @param name Must live until the profile is exported.
+ * @returns nullptr if it could not be allocated.
+ */
+KAPI profile_track *profiler_track_create(const char *name);
+
+/**
+ * Records a zone on a track. A track must only be recorded to by one thread
+ * at a time.
+ * @param name Must live until the profile is exported.
+ * @param start_ns On the `platform_get_absolute_time_ns` timeline.
+ * @param depth Nesting depth within the track, 0 being outermost.
+ */
+KAPI void profiler_track_record(profile_track *track, const char *name,
+                                u64 start_ns, u64 end_ns, u32 depth);
+
+/**
+ * Ends the current frame: aggregates the zones the calling thread closed
+ * since the last call, and records the frame itself as a zone. Also switches
+ * sampling on or off when that was asked for from outside the process, with
+ * SIGUSR2 on Linux, exporting the samples when it goes off. Called once per
+ * frame by the main loop.
+ */
+void profiler_frame_end();
+
+/**
+ * The aggregated zones of the last completed frame. Only valid on the thread
+ * that calls `profiler_frame_end`, until its next call.
+ */
+KAPI const profile_frame *profiler_last_frame();
+
+/**
+ * Starts sampling the call stacks of the threads that record zones. Each
+ * thread starts being sampled at its next zone.
+ * @param frequency_hz Samples per second of CPU time a thread uses.
+ * @returns `false` if sampling is not supported.
+ */
+KAPI bool profiler_sampling_start(u32 frequency_hz);
+
+/**
+ * Stops sampling. Threads stop being sampled at their next zone, or when the
+ * profiler shuts down. The samples are kept until sampling starts again.
+ */
+KAPI void profiler_sampling_stop();
+
+KAPI bool profiler_sampling_active();
+
+/**
+ * Writes the samples every thread still has in its ring as folded stacks,
+ * each rooted at its thread's name.
+ * @returns `true` if the file was written.
+ */
+KAPI bool profiler_export_folded_stacks(const char *path);
+
+/**
+ * Writes the zones every thread still has in its ring as Chrome trace JSON.
+ * Zones recorded while the export runs may or may not be included.
+ * @returns `true` if the file was written.
+ */
+KAPI bool profiler_export_chrome_trace(const char *path);
+
+#define KPROFILE_CONCAT_INNER(a, b) a##b
+#define KPROFILE_CONCAT(a, b) KPROFILE_CONCAT_INNER(a, b)
+
+/**
+ * Profiles the rest of the enclosing block as a zone called `name`.
+ */
+#define KPROFILE_SCOPE(name)                                                   \
+  profile_zone KPROFILE_CONCAT(kprofile_zone_, __LINE__)                       \
+      __attribute__((cleanup(profile_zone_end))) = profile_zone_begin(name)
+
+/**
+ * Profiles the rest of the enclosing function as a zone named after it.
+ */
+#define KPROFILE_FUNCTION() KPROFILE_SCOPE(__func__)
+
+#define KPROFILE_THREAD_NAME(name) profiler_set_thread_name(name)
+#define KPROFILE_FRAME_END() profiler_frame_end()
+#define KPROFILE_READ_COUNTERS(values) profiler_read_counters(values)
+#define KPROFILE_PLOT(name, value) profiler_plot(name, value)
+
+#else
+
+#define KPROFILE_SCOPE(name)
+#define KPROFILE_FUNCTION()
+#define KPROFILE_THREAD_NAME(name)
+#define KPROFILE_FRAME_END()
+#define KPROFILE_READ_COUNTERS(values)
+#define KPROFILE_PLOT(name, value)
+
+#endif
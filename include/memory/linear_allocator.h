@@ -0,0 +1,48 @@
+#pragma once
+
+#include "defines.h"
+
+#include <stdatomic.h>
+
+/**
+ * Bump allocator over a single fixed block. Individual allocations cannot be
+ * freed; the whole block is released at once with `linear_allocator_free_all`.
+ * Allocation is a single atomic add, so any thread may allocate, but
+ * `linear_allocator_free_all` must not race with allocations.
+ */
+typedef struct linear_allocator {
+  u64 total_size;
+  _Atomic u64 allocated;
+  void *memory;
+  bool owns_memory;
+} linear_allocator;
+
+// Alignment of every allocation handed out.
+#define LINEAR_ALLOCATOR_ALIGNMENT 16
+
+/**
+ * Creates a linear allocator.
+ * @param total_size The size of the block in bytes.
+ * @param memory Memory to allocate from, or nullptr to have the allocator
+ * allocate (and own) the block itself.
+ * @param out_allocator The allocator to initialize.
+ */
+KAPI void linear_allocator_create(u64 total_size, void *memory,
+                                  linear_allocator *out_allocator);
+
+/**
+ * Destroys a linear allocator, freeing its block if it owns it.
+ */
+KAPI void linear_allocator_destroy(linear_allocator *allocator);
+
+/**
+ * Allocates `size` bytes, aligned to `LINEAR_ALLOCATOR_ALIGNMENT`.
+ * @returns The memory, or nullptr if the allocator doesn't have enough space
+ * left.
+ */
+KAPI void *linear_allocator_allocate(linear_allocator *allocator, u64 size);
+
+/**
+ * Releases every allocation at once. Does not zero the memory.
+ */
+KAPI void linear_allocator_free_all(linear_allocator *allocator);
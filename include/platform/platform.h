@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/input.h"
+#include "core/profiler.h"
 #include "defines.h"
 #include "vulkan/vulkan_core.h"
 
@@ -10,12 +11,21 @@ typedef struct platform_config {
   i32 y;
   i32 width;
   i32 height;
+  // Read window system input on a dedicated thread that blocks on the
+  // display connection, see `input_sample_latest`. Linux only.
+  bool input_thread;
 } platform_config;
 
 bool platform_startup(void **plat_state, platform_config config);
 
 void platform_shutdown();
 
+/**
+ * Stops the input thread, if one runs, so that no more window events are
+ * posted. Called before the systems they are posted to shut down.
+ */
+void platform_input_thread_stop();
+
 bool platform_pump_messages();
 
 void *platform_allocate(u64 size, bool aligned);
@@ -24,19 +34,292 @@ void *platform_zero_memory(void *block, u64 size);
 void *platform_copy_memory(void *dest, const void *source, u64 size);
 void *platform_set_memory(void *dest, i32 value, u64 size);
 
+/**
+ * Monotonic time in nanoseconds since an unspecified point. Read from the
+ * TSC where it is invariant and trusted by the OS, from clock_gettime or
+ * QueryPerformanceCounter otherwise.
+ */
+u64 platform_get_absolute_time_ns();
+
+/**
+ * `platform_get_absolute_time_ns` in seconds, for gameplay code.
+ */
 f64 platform_get_absolute_time();
 
 void platform_sleep(u32 ms);
 
+/**
+ * Sleeps for at least `ns` nanoseconds, with as fine a granularity as the OS
+ * offers. Waking up can still take tens of microseconds past that.
+ */
+void platform_sleep_ns(u64 ns);
+
+typedef void (*platform_thread_entry)(void *params);
+
+typedef struct platform_thread {
+  void *internal_data;
+} platform_thread;
+
+/**
+ * Starts a new thread that runs `entry(params)`.
+ * @param out_thread Receives the thread, to be passed to
+ * `platform_thread_join`.
+ * @returns `true` if the thread was started.
+ */
+bool platform_thread_create(platform_thread_entry entry, void *params,
+                            platform_thread *out_thread);
+
+/**
+ * Waits for a thread to return from its entry function and releases it.
+ */
+void platform_thread_join(platform_thread *thread);
+
+/**
+ * The number of logical processors currently online, at least 1.
+ */
+u32 platform_get_processor_count();
+
+/**
+ * The number of physical cores currently online, counting the hardware
+ * threads of a core once. `platform_get_processor_count` where the topology
+ * is not known.
+ */
+u32 platform_get_physical_core_count();
+
+/**
+ * Gives the rest of the calling thread's time slice to another ready thread.
+ */
+void platform_thread_yield();
+
+// Timeout for a wait that only returns once woken.
+#define PLATFORM_WAIT_INFINITE 0xFFFFFFFFU
+// Wakes every thread waiting on an address.
+#define PLATFORM_WAKE_ALL 0xFFFFFFFFU
+
+/**
+ * Blocks the calling thread while `*address` holds `expected`, until
+ * `platform_futex_wake` is called on it or `timeout_ms` has passed. May
+ * return spuriously, so callers check the value again.
+ * @returns `false` if the timeout passed, `true` otherwise.
+ */
+bool platform_futex_wait(katomic u32 *address, u32 expected, u32 timeout_ms);
+
+/**
+ * Wakes up to `count` threads blocked in `platform_futex_wait` on `address`.
+ */
+void platform_futex_wake(katomic u32 *address, u32 count);
+
+/**
+ * A mutex that never enters the kernel while uncontended. Zeroed is unlocked.
+ * Not recursive.
+ */
+typedef struct platform_mutex {
+  katomic u32 state;
+} platform_mutex;
+
+void platform_mutex_lock(platform_mutex *mutex);
+
+/**
+ * @returns `true` if the mutex was free and is now held by the caller.
+ */
+bool platform_mutex_try_lock(platform_mutex *mutex);
+
+void platform_mutex_unlock(platform_mutex *mutex);
+
+/**
+ * A counting semaphore. Posting never enters the kernel while nobody waits.
+ */
+typedef struct platform_semaphore {
+  katomic u32 count;
+  katomic u32 waiters;
+} platform_semaphore;
+
+void platform_semaphore_create(u32 initial_count,
+                               platform_semaphore *out_semaphore);
+
+/**
+ * Adds `count` to the semaphore, waking as many waiters.
+ */
+void platform_semaphore_post(platform_semaphore *semaphore, u32 count);
+
+void platform_semaphore_wait(platform_semaphore *semaphore);
+
+/**
+ * @returns `true` if the count was taken, `false` if it stayed at 0 for
+ * `timeout_ms`. A timeout of 0 never blocks.
+ */
+bool platform_semaphore_timed_wait(platform_semaphore *semaphore,
+                                   u32 timeout_ms);
+
+/**
+ * A condition variable for `platform_mutex`. Zeroed is ready to use. Waits
+ * can return spuriously, so callers wait in a loop on their condition.
+ */
+typedef struct platform_condvar {
+  katomic u32 sequence;
+} platform_condvar;
+
+/**
+ * Releases `mutex`, which the caller holds, until the condition variable is
+ * signaled, then takes it again.
+ */
+void platform_condvar_wait(platform_condvar *condvar, platform_mutex *mutex);
+
+/**
+ * `platform_condvar_wait` that gives up after `timeout_ms`.
+ * @returns `false` if it timed out. The mutex is held again either way.
+ */
+bool platform_condvar_timed_wait(platform_condvar *condvar,
+                                 platform_mutex *mutex, u32 timeout_ms);
+
+void platform_condvar_signal(platform_condvar *condvar);
+
+void platform_condvar_broadcast(platform_condvar *condvar);
+
+/**
+ * Runs on a fiber once it is first switched to. Must not return; a fiber
+ * that is done switches away and is destroyed from elsewhere.
+ */
+typedef void (*platform_fiber_entry)(void *params);
+
+/**
+ * An execution context with a stack of its own, which threads switch to and
+ * from cooperatively. A fiber may be resumed on another thread than the one
+ * it last ran on, so code that can be suspended must not keep the address of
+ * a thread local across the switch.
+ */
+typedef struct platform_fiber {
+  void *internal_data;
+} platform_fiber;
+
+/**
+ * Creates a fiber that runs `entry(params)` on a stack of `stack_size`
+ * bytes, below which a guard page catches overflows.
+ */
+bool platform_fiber_create(u64 stack_size, platform_fiber_entry entry,
+                           void *params, platform_fiber *out_fiber);
+
+/**
+ * Creates a fiber for the calling thread as it is running now, for fibers
+ * that run on it to switch back to.
+ */
+bool platform_fiber_from_thread(platform_fiber *out_fiber);
+
+/**
+ * Releases a fiber, which must not be running. Releasing a thread's fiber
+ * leaves the thread itself as it is.
+ */
+void platform_fiber_destroy(platform_fiber *fiber);
+
+/**
+ * Saves what runs on the calling thread into `from` and continues `to`.
+ * Returns once another thread or fiber switches back to `from`.
+ * @param from The fiber currently running on the calling thread.
+ */
+void platform_fiber_switch(platform_fiber *from, platform_fiber *to);
+
+typedef struct platform_perf_counters {
+  void *internal_data;
+  // Bit (1 << counter) set for each profile_counter being counted.
+  u32 available;
+} platform_perf_counters;
+
+/**
+ * Starts counting the hardware events of `profile_counter` done by the
+ * calling thread in user space. Those the CPU or OS do not provide are left
+ * out. Linux only.
+ * @returns `false` if none of them can be counted.
+ */
+bool platform_perf_counters_open(platform_perf_counters *out_counters);
+
+/**
+ * Reads the events counted since the counters were opened, the ones not
+ * counted as 0.
+ */
+void platform_perf_counters_read(const platform_perf_counters *counters,
+                                 u64 out_values[PROFILE_COUNTER_COUNT]);
+
+void platform_perf_counters_close(platform_perf_counters *counters);
+
+// Deepest call stack a sample captures, further callers are cut off.
+#define PLATFORM_SAMPLE_MAX_DEPTH 64
+
+/**
+ * Receives the call stack of a sampled thread, innermost frame first: the
+ * interrupted instruction, then return addresses. Runs in a signal handler
+ * on that thread, so it must only do async-signal-safe work.
+ */
+typedef void (*platform_sample_handler)(void *context, const u64 *frames,
+                                        u32 depth);
+
+typedef struct platform_sample_timer {
+  void *internal_data;
+} platform_sample_timer;
+
+/**
+ * Sets the handler every sample timer reports to. Called once, before
+ * any timer is armed.
+ */
+bool platform_sampler_initialize(platform_sample_handler handler);
+
+/**
+ * Stops reporting samples and releases what symbolizing loaded.
+ */
+void platform_sampler_shutdown();
+
+/**
+ * Samples the calling thread `frequency_hz` times per second of CPU time it
+ * uses, walking its frame pointers. Linux on x86_64 only.
+ * @param context Passed to the handler with each of this thread's samples.
+ * @returns `false` if the timer could not be created.
+ */
+bool platform_sample_timer_arm(u32 frequency_hz, void *context,
+                               platform_sample_timer *out_timer);
+
+/**
+ * Stops and deletes a timer. May be called from any thread, also once the
+ * sampled thread has exited. Its handler may still run for a sample that
+ * was already pending.
+ */
+void platform_sample_timer_disarm(platform_sample_timer *timer);
+
+/**
+ * Whether sampling was asked to be switched on or off from outside the
+ * process since the last call. On Linux, by sending it SIGUSR2.
+ */
+bool platform_sampler_toggle_requested();
+
+/**
+ * Writes the name of the function containing `address`, or the module and
+ * offset it is at when its symbols are not available.
+ * @returns `false` if `address` is not in any loaded module.
+ */
+bool platform_symbolize(u64 address, char *out_name, u64 size);
+
 #if defined(KPLATFORM_LINUX)
+#include "core/event.h"
 #include <xkbcommon/xkbcommon.h>
 keys translate_keycode(u32 xkb_keycode);
+
+/**
+ * Fires an event raised by a backend's message handling. Posted for the main
+ * thread instead when messages are handled on the input thread.
+ */
+void platform_linux_fire_event(u16 code, event_context context);
+
+/**
+ * Narrows `[*low, *high)`, the calling thread's stack, to the stack of the
+ * fiber it runs, if any. Async-signal-safe, for the sampler to walk frames on
+ * fiber stacks.
+ */
+void platform_linux_fiber_stack(u64 *low, u64 *high);
 #endif
 
 #if defined(KBUILD_X11)
 bool x11_platform_startup(void *state, platform_config config);
 void x11_platform_shutdown();
 bool x11_platform_pump_messages();
+bool x11_platform_wait_messages(i32 timeout_ms);
 bool x11_platform_create_vulkan_surface(VkInstance instance,
                                         VkAllocationCallbacks *allocator,
                                         VkSurfaceKHR *surface);
@@ -46,6 +329,7 @@ bool x11_platform_create_vulkan_surface(VkInstance instance,
 bool wl_platform_startup(void *state, platform_config config);
 void wl_platform_shutdown();
 bool wl_platform_pump_messages();
+bool wl_platform_wait_messages(i32 timeout_ms);
 bool wl_platform_create_vulkan_surface(VkInstance instance,
                                        VkAllocationCallbacks *allocator,
                                        VkSurfaceKHR *surface);
@@ -1,23 +1,39 @@
 #include "core/application.h"
 #include "core/clock.h"
 #include "core/event.h"
+#include "core/frame_pacer.h"
+#include "core/frame_stats.h"
 #include "core/input.h"
+#include "core/input_action.h"
+#include "core/job_system.h"
 #include "core/kmemory.h"
 #include "core/logger.h"
+#include "core/profiler.h"
 #include "game_types.h"
 #include "platform/platform.h"
 
+#include <stdlib.h>
+
 #include "renderer/renderer_frontend.h"
+#include "renderer/renderer_thread.h"
 
 typedef struct application_state {
   game *game_inst;
   bool is_running;
   bool is_suspended;
+  bool headless;
+  // Frames are drawn on the render thread, see `renderer_thread.h`.
+  bool render_thread;
   void *platform_state;
   i16 width;
   i16 height;
   f64 last_time;
   clock clock;
+  event_handle quit_handle;
+  event_handle log_level_handle;
+  event_handle key_pressed_handle;
+  event_handle key_released_handle;
+  event_handle resized_handle;
 } application_state;
 
 static application_state app_state;
@@ -27,6 +43,8 @@ bool application_on_event(u16 code, void *sender, void *listener_inst,
                           event_context context);
 bool application_on_key(u16 code, void *sender, void *listener_inst,
                         event_context context);
+bool application_on_resized(u16 code, void *sender, void *listener_inst,
+                            event_context context);
 
 bool application_create(game *game_inst) {
   if (initialized) {
@@ -41,7 +59,32 @@ bool application_create(game *game_inst) {
     return false;
   }
 
+  const char *log_config_path = getenv("KLOG_CONFIG");
+  if (log_config_path) {
+    log_categories_load(log_config_path);
+  }
+
+#if defined(KPROFILE_ENABLED)
+  // KPROFILE_COUNTERS counts hardware events in zones. KPROFILE_SAMPLE=<hz>
+  // samples call stacks from the start, which SIGUSR2 otherwise switches on
+  // and off; they go to KPROFILE_SAMPLES=<file>.
+  const char *sample_frequency = getenv("KPROFILE_SAMPLE");
+  profiler_config profiler_conf = {
+      .hardware_counters = getenv("KPROFILE_COUNTERS") != nullptr,
+      .sample_frequency =
+          sample_frequency ? (u32)strtoul(sample_frequency, nullptr, 10) : 0,
+      .samples_path = getenv("KPROFILE_SAMPLES"),
+  };
+  profiler_initialize(profiler_conf);
+#endif
+
   input_initialize();
+  input_action_initialize();
+
+  if (!job_system_initialize(game_inst->app_config.job_worker_count)) {
+    kfatal("Job system failed initialization. Cannot continue");
+    return false;
+  }
 
   // TODO: Remove
   const float pi = 3.14F;
@@ -60,9 +103,51 @@ bool application_create(game *game_inst) {
     return false;
   }
 
-  event_register(EVENT_CODE_APPLICATION_QUIT, nullptr, application_on_event);
-  event_register(EVENT_CODE_KEY_PRESSED, nullptr, application_on_key);
-  event_register(EVENT_CODE_KEY_RELEASED, nullptr, application_on_key);
+  // Only the latest of these per frame is of interest; a resize in particular
+  // can trigger a swapchain rebuild.
+  event_set_coalesced(EVENT_CODE_MOUSE_MOVED, true);
+  event_set_coalesced(EVENT_CODE_RESIZED, true);
+
+  // Benchmarking aids: record this session's events, or replay a previous
+  // recording in place of platform input.
+  const char *record_path = getenv("KEVENT_RECORD");
+  const char *replay_path = getenv("KEVENT_REPLAY");
+  if (replay_path) {
+    if (!event_replay_start(replay_path)) {
+      kfatal("Could not start event replay from `%s`", replay_path);
+      return false;
+    }
+  } else if (record_path) {
+    event_recording_start(record_path);
+  }
+
+  app_state.quit_handle = event_register(EVENT_CODE_APPLICATION_QUIT, nullptr,
+                                         application_on_event);
+  app_state.log_level_handle =
+      event_register(EVENT_CODE_LOG_LEVEL, nullptr, application_on_event);
+  app_state.key_pressed_handle =
+      event_register(EVENT_CODE_KEY_PRESSED, nullptr, application_on_key);
+  app_state.key_released_handle =
+      event_register(EVENT_CODE_KEY_RELEASED, nullptr, application_on_key);
+  app_state.resized_handle =
+      event_register(EVENT_CODE_RESIZED, nullptr, application_on_resized);
+
+  app_state.headless = game_inst->app_config.headless;
+  app_state.width = game_inst->app_config.start_width;
+  app_state.height = game_inst->app_config.start_height;
+
+  frame_pacer_initialize(game_inst->app_config.target_fps);
+  frame_stats_initialize(game_inst->app_config.frame_stats_log_seconds);
+
+  if (game_inst->app_config.input_playback_path) {
+    if (!input_playback_start(game_inst->app_config.input_playback_path)) {
+      kfatal("Could not start input playback from `%s`",
+             game_inst->app_config.input_playback_path);
+      return false;
+    }
+  } else if (game_inst->app_config.input_record_path) {
+    input_recording_start(game_inst->app_config.input_record_path);
+  }
 
   platform_config conf = {
       .width = game_inst->app_config.start_width,
@@ -70,17 +155,27 @@ bool application_create(game *game_inst) {
       .application_name = game_inst->app_config.name,
       .x = game_inst->app_config.start_pos_x,
       .y = game_inst->app_config.start_pos_y,
+      // Played back input must not be mixed with live input.
+      .input_thread =
+          game_inst->app_config.input_thread && !input_playback_active(),
   };
 
-  if (!platform_startup(&app_state.platform_state, conf)) {
-    kfatal("Platform failed to start. Shutting down");
-    return false;
-  }
+  if (app_state.headless) {
+    kinfo("Running headless, no window or renderer will be created.");
+  } else {
+    if (!platform_startup(&app_state.platform_state, conf)) {
+      kfatal("Platform failed to start. Shutting down");
+      return false;
+    }
 
-  if (!renderer_initialize(game_inst->app_config.name,
-                           app_state.platform_state)) {
-    kfatal("Failed to initialize renderer!");
-    return false;
+    if (!renderer_initialize(game_inst->app_config.name,
+                             app_state.platform_state)) {
+      kfatal("Failed to initialize renderer!");
+      return false;
+    }
+
+    app_state.render_thread =
+        game_inst->app_config.render_thread && renderer_thread_start();
   }
 
   if (!app_state.game_inst->initialize(app_state.game_inst)) {
@@ -96,72 +191,155 @@ bool application_create(game *game_inst) {
   return true;
 }
 
-#define TARGET_FPS 60
+#define PROFILE_TRACE_PATH "profile.json"
+
+// Feeds this frame's input from wherever it comes from: a playback file, an
+// event replay, or the platform. Returns false when the application should
+// quit.
+static bool application_pump_input() {
+  KPROFILE_FUNCTION();
+  if (input_playback_active()) {
+    if (!input_playback_frame()) {
+      kinfo("Input playback finished, shutting down.");
+      return false;
+    }
+    return true;
+  }
+
+  if (event_replay_active()) {
+    if (!event_replay_frame()) {
+      kinfo("Event replay finished, shutting down.");
+      return false;
+    }
+    return true;
+  }
+
+  return app_state.headless || platform_pump_messages();
+}
 
 bool application_run() {
   clock_start(&app_state.clock);
   clock_update(&app_state.clock);
   app_state.last_time = app_state.clock.elapsed;
-  /* f64 running_time = 0; */
-  /* u8 frame_count = 0; */
-  f64 target_frame_seconds = 1.0F / TARGET_FPS;
 
   print_memory_usage_str();
   while (app_state.is_running) {
-    if (!platform_pump_messages()) {
+    u64 frame_start_ns = platform_get_absolute_time_ns();
+    u64 frame_start_counters[PROFILE_COUNTER_COUNT] = {};
+    KPROFILE_READ_COUNTERS(frame_start_counters);
+    if (!application_pump_input()) {
       app_state.is_running = false;
     }
 
+    {
+      KPROFILE_SCOPE("dispatch_events");
+      input_drain_posted();
+      event_drain_posted();
+      event_flush_coalesced();
+      input_action_update();
+    }
+
     if (!app_state.is_suspended) {
       clock_update(&app_state.clock);
       f64 current_time = app_state.clock.elapsed;
       f64 delta = (current_time - app_state.last_time);
-      f64 frame_start_time = platform_get_absolute_time();
 
-      if (!app_state.game_inst->update(app_state.game_inst, (f32)delta)) {
+      u64 update_start_ns = platform_get_absolute_time_ns();
+      bool updated;
+      {
+        KPROFILE_SCOPE("game_update");
+        updated = app_state.game_inst->update(app_state.game_inst, (f32)delta);
+      }
+      if (!updated) {
         kfatal("Game update failed, shutting down");
         app_state.is_running = false;
         break;
       }
 
-      if (!app_state.game_inst->render(app_state.game_inst, 0.0F)) {
+      u64 render_start_ns = platform_get_absolute_time_ns();
+      bool rendered;
+      {
+        KPROFILE_SCOPE("game_render");
+        rendered = app_state.game_inst->render(app_state.game_inst, 0.0F);
+      }
+      if (!rendered) {
         kfatal("Game render failed, shutting down");
         app_state.is_running = false;
         break;
       }
 
-      render_packet packet;
-      packet.delta_time = delta;
-      renderer_draw_frame(&packet);
-
-      f64 frame_end_time = platform_get_absolute_time();
-      f64 frame_elapsed_time = frame_end_time - frame_start_time;
-      /* running_time += frame_elapsed_time; */
-      f64 remaining_seconds = target_frame_seconds - frame_elapsed_time;
-
-      if (remaining_seconds > 0) {
-        u64 remaining_ms = (remaining_seconds * 1000);
-
-        bool limit_frames = false;
-        if (remaining_ms > 0 && limit_frames) {
-          platform_sleep(remaining_ms - 1);
+      if (!app_state.headless) {
+        // A snapshot of this frame. The render thread draws its copy while
+        // the next frame is updated, and the time spent here is then only
+        // the wait for a free slot.
+        render_packet packet = {
+            .delta_time = (f32)delta,
+            .width = (u16)app_state.width,
+            .height = (u16)app_state.height,
+        };
+        bool drawn = app_state.render_thread
+                         ? renderer_thread_submit(&packet)
+                         : renderer_draw_frame(&packet);
+        if (!drawn) {
+          kfatal("Renderer failed to draw a frame, shutting down");
+          app_state.is_running = false;
+          break;
         }
-
-        /* frame_count++; */
       }
+      u64 render_end_ns = platform_get_absolute_time_ns();
 
       input_update(delta);
+      event_end_frame();
 
       app_state.last_time = current_time;
+
+      // Last, so that the next frame reads input right after the wait.
+      u64 wait_start_ns = platform_get_absolute_time_ns();
+      frame_sample sample = {};
+      KPROFILE_READ_COUNTERS(sample.counters);
+      frame_pacer_wait();
+      sample.cpu_ns = wait_start_ns - frame_start_ns;
+      sample.update_ns = render_start_ns - update_start_ns;
+      sample.render_ns = render_end_ns - render_start_ns;
+      sample.wait_ns = platform_get_absolute_time_ns() - wait_start_ns;
+      for (u32 i = 0; i < PROFILE_COUNTER_COUNT; ++i) {
+        sample.counters[i] -= frame_start_counters[i];
+      }
+      frame_stats_record(&sample);
     }
+
+    job_system_frame_end();
+    KPROFILE_FRAME_END();
   }
   app_state.is_running = false;
-  event_unregister(EVENT_CODE_APPLICATION_QUIT, nullptr, application_on_event);
-  event_unregister(EVENT_CODE_KEY_PRESSED, nullptr, application_on_key);
-  event_unregister(EVENT_CODE_KEY_RELEASED, nullptr, application_on_key);
-  renderer_shutdown();
+  // The input thread posts events and logs until it is stopped.
+  platform_input_thread_stop();
+  event_unregister_handle(app_state.quit_handle);
+  event_unregister_handle(app_state.log_level_handle);
+  event_unregister_handle(app_state.key_pressed_handle);
+  event_unregister_handle(app_state.key_released_handle);
+  event_unregister_handle(app_state.resized_handle);
+  if (!app_state.headless) {
+    renderer_thread_stop();
+    renderer_shutdown();
+  }
+  job_system_shutdown();
   event_shutdown();
+  input_action_shutdown();
   input_shutdown();
+
+#if defined(KPROFILE_ENABLED)
+  const char *trace_path = getenv("KPROFILE_TRACE");
+  profiler_export_chrome_trace(trace_path ? trace_path : PROFILE_TRACE_PATH);
+  if (profiler_sampling_active()) {
+    profiler_sampling_stop();
+    const char *samples_path = getenv("KPROFILE_SAMPLES");
+    profiler_export_folded_stacks(samples_path ? samples_path
+                                               : PROFILE_SAMPLES_PATH);
+  }
+  profiler_shutdown();
+#endif
+
   shutdown_logging();
   shutdown_memory();
 
@@ -178,13 +356,24 @@ bool application_on_event(u16 code, void *sender, void *listener_inst,
                           event_context context) {
   (void)sender;
   (void)listener_inst;
-  (void)context;
   switch (code) {
   case EVENT_CODE_APPLICATION_QUIT: {
     kinfo("EVENT_CODE_APPLICATION_QUIT received, shutting down.");
     app_state.is_running = false;
     return true;
   }
+  case EVENT_CODE_LOG_LEVEL: {
+    u8 category = context.data.u8[0];
+    log_level level = (log_level)context.data.u8[1];
+    if (category >= LOG_CATEGORY_MAX) {
+      for (u8 i = 0; i < LOG_CATEGORY_MAX; ++i) {
+        log_category_set_level((log_category)i, level);
+      }
+    } else {
+      log_category_set_level((log_category)category, level);
+    }
+    return true;
+  }
   default:
     return false;
   }
@@ -217,3 +406,26 @@ bool application_on_key(u16 code, void *sender, void *listener_inst,
   }
   return false;
 }
+
+bool application_on_resized(u16 code, void *sender, void *listener_inst,
+                            event_context context) {
+  (void)code;
+  (void)sender;
+  (void)listener_inst;
+  u16 width = context.data.u16[0];
+  u16 height = context.data.u16[1];
+  // Window moves are reported the same way.
+  if (width == app_state.width && height == app_state.height) {
+    return false;
+  }
+
+  kdebug("Window resize: %hu, %hu", width, height);
+  app_state.width = (i16)width;
+  app_state.height = (i16)height;
+  // Drawn at the new size from the next render packet on, and minimized
+  // windows are not drawn at all.
+  if (width != 0 && height != 0) {
+    app_state.game_inst->on_resize(app_state.game_inst, width, height);
+  }
+  return false;
+}
@@ -2,14 +2,16 @@
 #include "platform/platform.h"
 
 void clock_update(clock *clock) {
-  if (clock->start_time != 0) {
-    clock->elapsed = platform_get_absolute_time() - clock->start_time;
+  if (clock->start_ns != 0) {
+    clock->elapsed_ns = platform_get_absolute_time_ns() - clock->start_ns;
+    clock->elapsed = (f64)clock->elapsed_ns * 0.000000001;
   }
 }
 
 void clock_start(clock *clock) {
-  clock->start_time = platform_get_absolute_time();
+  clock->start_ns = platform_get_absolute_time_ns();
+  clock->elapsed_ns = 0;
   clock->elapsed = 0;
 }
 
-void clock_stop(clock *clock) { clock->start_time = 0; }
+void clock_stop(clock *clock) { clock->start_ns = 0; }
@@ -1,22 +1,185 @@
+#define KLOG_CATEGORY LOG_CATEGORY_EVENT
+
 #include "core/event.h"
 #include "containers/darray.h"
 #include "core/kmemory.h"
 #include "core/logger.h"
+#include "memory/linear_allocator.h"
+#include "platform/platform.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
 
-typedef struct registered_event {
+#define EVENT_INVALID_INDEX 0xFFFFFFFFU
+
+/**
+ * A registered listener. Listeners live in a single pool and are chained per
+ * event code in dispatch order (highest priority first, then registration
+ * order). Unlinked slots keep their `next` link until they are reused, so a
+ * dispatch that is walking the chain can step past them safely.
+ */
+typedef struct event_listener {
   void *listener;
+  // nullptr once unregistered.
   PFN_on_event callback;
-} registered_event;
+  i32 priority;
+  // Bumped every time the slot is freed, invalidating old handles.
+  u32 generation;
+  u32 prev;
+  u32 next;
+  u16 code;
+} event_listener;
 
+/**
+ * An event code that is in use, i.e. has had a listener registered or been
+ * marked as coalesced.
+ */
 typedef struct event_code_entry {
-  // darray
-  registered_event *events;
+  u16 code;
+  bool occupied;
+  // Index + 1 into the coalesced table, 0 if the code is not coalesced.
+  u8 coalesced_slot;
+  // Head of the listener chain, EVENT_INVALID_INDEX if empty.
+  u32 first;
 } event_code_entry;
 
-#define MAX_MESSAGE_CODES 16384
+// Initial size of the code table, must be a power of two.
+#define EVENT_CODE_TABLE_INITIAL_BITS 5
+
+// Must be a power of two.
+#define EVENT_INBOX_CAPACITY 1024
+#define EVENT_INBOX_MASK (EVENT_INBOX_CAPACITY - 1)
+#define CACHE_LINE_SIZE 64
+
+#define MAX_COALESCED_CODES 16
+
+// Size of each payload arena. Two are kept so a payload outlives the frame
+// it was allocated in; see event_payload_allocate.
+#define EVENT_PAYLOAD_ARENA_SIZE (256ULL * 1024)
+
+/**
+ * A slot in the cross-thread inbox. `sequence` tells producers and the
+ * consumer whose turn it is: it equals the slot's write position when the
+ * slot is free, and the write position + 1 once it holds an event.
+ */
+typedef struct posted_event {
+  _Atomic u64 sequence;
+  u16 code;
+  // Arena of the payload, which is not reset before the event is drained.
+  u8 payload_arena;
+  void *sender;
+  event_context data;
+} posted_event;
+
+/**
+ * Precedes each payload in its arena, so that a post can tell whether the
+ * arena has been reclaimed since. Keeps payloads at the arena's alignment.
+ */
+typedef struct payload_header {
+  // Atomic since a post that comes too late can read it while the arena's
+  // memory is reused.
+  _Atomic u32 generation;
+  u32 padding[3];
+} payload_header;
+
+/**
+ * Bounded multi-producer, single-consumer queue. Any thread may post; only
+ * the main thread drains. Head and tail live on separate cache lines so
+ * producers and the consumer don't fight over them.
+ */
+typedef struct event_inbox {
+  alignas(CACHE_LINE_SIZE) _Atomic u64 head;
+  alignas(CACHE_LINE_SIZE) u64 tail;
+  _Atomic u64 dropped;
+  alignas(CACHE_LINE_SIZE) posted_event slots[EVENT_INBOX_CAPACITY];
+} event_inbox;
+
+/**
+ * The most recent event fired for a coalesced code, held until the next
+ * flush.
+ */
+typedef struct coalesced_event {
+  u16 code;
+  bool pending;
+  void *sender;
+  event_context data;
+} coalesced_event;
+
+#define EVENT_STREAM_MAGIC 0x56454B4FU // "OKEV"
+#define EVENT_STREAM_VERSION 1
+#define EVENT_STREAM_BUFFER_SIZE (64ULL * 1024)
+
+typedef struct event_stream_header {
+  u32 magic;
+  u16 version;
+  u16 reserved;
+} event_stream_header;
+
+/**
+ * One recorded event as stored on disk, followed by `payload_size` bytes of
+ * payload. Frames and timestamps are relative to the start of the recording.
+ */
+typedef struct event_stream_record {
+  u32 frame;
+  u16 code;
+  u16 reserved;
+  u32 payload_size;
+  u32 reserved2;
+  u64 timestamp_ns;
+  u8 data[16];
+} event_stream_record;
+
+static_assert(sizeof(event_stream_record) == 40,
+              "event_stream_record must stay 40 bytes, it is written as is.");
+
+typedef struct event_stream {
+  FILE *file;
+  u64 start_frame;
+  f64 start_time;
+  u64 event_count;
+  // Replay only: the next record, read ahead of its frame.
+  event_stream_record next;
+  bool has_next;
+} event_stream;
 
 typedef struct event_system_state {
-  event_code_entry registered[MAX_MESSAGE_CODES];
+  // Open-addressed (linear probing) table of the codes in use.
+  event_code_entry *codes;
+  u32 code_table_bits;
+  u32 code_count;
+
+  // darray
+  event_listener *listeners;
+  // darray, listener slots ready for reuse.
+  u32 *free_listeners;
+  // darray, slots unregistered during a dispatch. Released once the
+  // outermost dispatch returns.
+  u32 *deferred_frees;
+  u32 dispatch_depth;
+
+  event_inbox inbox;
+
+  coalesced_event coalesced[MAX_COALESCED_CODES];
+  u32 coalesced_code_count;
+  u64 collapsed_count;
+
+  linear_allocator payload_arenas[2];
+  // Index of the arena payloads are currently allocated from.
+  _Atomic u32 payload_arena_index;
+  // Threads allocating from each arena, which event_end_frame waits out
+  // before resetting it.
+  _Atomic u32 payload_arena_users[2];
+  // Bumped each time an arena is reclaimed. Payloads of an older generation
+  // can no longer be posted.
+  _Atomic u32 payload_arena_generations[2];
+  // Posted events with a payload in each arena that have not been drained
+  // yet. An arena is not reset while it has any.
+  _Atomic u32 payload_arena_posted[2];
+
+  // Number of times event_end_frame has been called.
+  u64 frame_number;
+  event_stream recording;
+  event_stream replay;
 } event_system_state;
 
 /**
@@ -25,6 +188,109 @@ typedef struct event_system_state {
 static bool is_initialized = false;
 static event_system_state state;
 
+static inline u32 event_code_hash(u16 code, u32 bits) {
+  // Fibonacci hashing, spreads the small sequential system codes apart.
+  return ((u32)code * 2654435769U) >> (32 - bits);
+}
+
+static event_code_entry *event_code_find(u16 code) {
+  u32 mask = (1U << state.code_table_bits) - 1;
+  u32 i = event_code_hash(code, state.code_table_bits);
+  for (;;) {
+    event_code_entry *entry = &state.codes[i];
+    if (!entry->occupied) {
+      return nullptr;
+    }
+    if (entry->code == code) {
+      return entry;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+static event_code_entry *event_code_insert_unchecked(event_code_entry *table,
+                                                     u32 bits, u16 code) {
+  u32 mask = (1U << bits) - 1;
+  u32 i = event_code_hash(code, bits);
+  while (table[i].occupied) {
+    i = (i + 1) & mask;
+  }
+  table[i].occupied = true;
+  table[i].code = code;
+  table[i].first = EVENT_INVALID_INDEX;
+  return &table[i];
+}
+
+static event_code_entry *event_code_find_or_insert(u16 code) {
+  event_code_entry *entry = event_code_find(code);
+  if (entry) {
+    return entry;
+  }
+
+  // Keep the load factor under 3/4 so probe chains stay short.
+  u32 capacity = 1U << state.code_table_bits;
+  if ((state.code_count + 1) * 4 > capacity * 3) {
+    u32 new_bits = state.code_table_bits + 1;
+    event_code_entry *new_table = kallocate(
+        sizeof(event_code_entry) * (1ULL << new_bits), MEMORY_TAG_DICT);
+    kzero_memory(new_table, sizeof(event_code_entry) * (1ULL << new_bits));
+    for (u32 i = 0; i < capacity; ++i) {
+      if (state.codes[i].occupied) {
+        event_code_entry *moved = event_code_insert_unchecked(
+            new_table, new_bits, state.codes[i].code);
+        *moved = state.codes[i];
+      }
+    }
+    kfree(state.codes);
+    state.codes = new_table;
+    state.code_table_bits = new_bits;
+  }
+
+  state.code_count++;
+  return event_code_insert_unchecked(state.codes, state.code_table_bits, code);
+}
+
+static inline event_handle event_make_handle(u32 index, u32 generation) {
+  return ((u64)generation << 32) | (u64)(index + 1);
+}
+
+static event_listener *event_handle_resolve(event_handle handle, u32 *index) {
+  u32 low = (u32)(handle & 0xFFFFFFFFU);
+  if (low == 0 || low > darray_length(state.listeners)) {
+    return nullptr;
+  }
+  event_listener *l = &state.listeners[low - 1];
+  if (l->generation != (u32)(handle >> 32) || !l->callback) {
+    return nullptr;
+  }
+  *index = low - 1;
+  return l;
+}
+
+static void event_listener_release(u32 index) {
+  if (state.dispatch_depth > 0) {
+    darray_push(&state.deferred_frees, index);
+  } else {
+    darray_push(&state.free_listeners, index);
+  }
+}
+
+static void event_listener_unlink(u32 index) {
+  event_listener *l = &state.listeners[index];
+  if (l->prev != EVENT_INVALID_INDEX) {
+    state.listeners[l->prev].next = l->next;
+  } else {
+    event_code_find(l->code)->first = l->next;
+  }
+  if (l->next != EVENT_INVALID_INDEX) {
+    state.listeners[l->next].prev = l->prev;
+  }
+  l->callback = nullptr;
+  l->listener = nullptr;
+  l->generation++;
+  event_listener_release(index);
+}
+
 bool event_initialize() {
   if (is_initialized) {
     return false;
@@ -32,42 +298,134 @@ bool event_initialize() {
 
   kzero_memory(&state, sizeof(state));
 
+  state.code_table_bits = EVENT_CODE_TABLE_INITIAL_BITS;
+  u64 table_size = sizeof(event_code_entry) * (1ULL << state.code_table_bits);
+  state.codes = kallocate(table_size, MEMORY_TAG_DICT);
+  kzero_memory(state.codes, table_size);
+  state.listeners = darray_create(event_listener);
+  state.free_listeners = darray_create(u32);
+  state.deferred_frees = darray_create(u32);
+
+  linear_allocator_create(EVENT_PAYLOAD_ARENA_SIZE, nullptr,
+                          &state.payload_arenas[0]);
+  linear_allocator_create(EVENT_PAYLOAD_ARENA_SIZE, nullptr,
+                          &state.payload_arenas[1]);
+  atomic_init(&state.payload_arena_index, 0);
+  for (u32 i = 0; i < 2; ++i) {
+    atomic_init(&state.payload_arena_users[i], 0);
+    atomic_init(&state.payload_arena_generations[i], 0);
+    atomic_init(&state.payload_arena_posted[i], 0);
+  }
+
+  for (u64 i = 0; i < EVENT_INBOX_CAPACITY; ++i) {
+    atomic_init(&state.inbox.slots[i].sequence, i);
+  }
+  atomic_init(&state.inbox.head, 0);
+  atomic_init(&state.inbox.dropped, 0);
+  state.inbox.tail = 0;
+
   is_initialized = true;
 
   return true;
 }
 void event_shutdown() {
-  for (u16 i = 0; i < MAX_MESSAGE_CODES; ++i) {
-    if (state.registered[i].events) {
-      darray_destroy(state.registered[i].events);
-      state.registered[i].events = nullptr;
-    }
+  if (!is_initialized) {
+    return;
   }
-}
 
-bool event_register(u16 code, void *listener, PFN_on_event on_event) {
-  if (!is_initialized) {
-    return false;
+  u64 pending = atomic_load_explicit(&state.inbox.head, memory_order_relaxed) -
+                state.inbox.tail;
+  if (pending > 0) {
+    kwarn("Event system shut down with %llu posted events undelivered",
+          pending);
   }
 
-  if (!state.registered[code].events) {
-    state.registered[code].events = darray_create(registered_event);
+  event_recording_stop();
+  event_replay_stop();
+
+  linear_allocator_destroy(&state.payload_arenas[0]);
+  linear_allocator_destroy(&state.payload_arenas[1]);
+
+  darray_destroy(state.deferred_frees);
+  darray_destroy(state.free_listeners);
+  darray_destroy(state.listeners);
+  kfree(state.codes);
+  state.codes = nullptr;
+  state.listeners = nullptr;
+  state.free_listeners = nullptr;
+  state.deferred_frees = nullptr;
+
+  is_initialized = false;
+}
+
+event_handle event_register(u16 code, void *listener, PFN_on_event on_event) {
+  return event_register_priority(code, listener, on_event,
+                                 EVENT_PRIORITY_DEFAULT);
+}
+
+event_handle event_register_priority(u16 code, void *listener,
+                                     PFN_on_event on_event, i32 priority) {
+  if (!is_initialized || !on_event) {
+    return EVENT_HANDLE_INVALID;
   }
 
-  registered_event *e;
-  darray_for_each(state.registered[code].events, e) {
+  event_code_entry *entry = event_code_find_or_insert(code);
+
+  // Walk the chain once to reject duplicates and find where this priority
+  // goes; equal priorities keep registration order.
+  u32 insert_after = EVENT_INVALID_INDEX;
+  for (u32 i = entry->first; i != EVENT_INVALID_INDEX;
+       i = state.listeners[i].next) {
+    event_listener *e = &state.listeners[i];
     if (e->listener == listener && e->callback == on_event) {
       kwarn("Tried to register event already registered");
-      return false;
+      return EVENT_HANDLE_INVALID;
+    }
+    if (e->priority >= priority) {
+      insert_after = i;
     }
   }
 
-  registered_event event;
-  event.listener = listener;
-  event.callback = on_event;
+  u32 index;
+  if (darray_length(state.free_listeners) > 0) {
+    darray_pop(state.free_listeners, &index);
+  } else {
+    index = (u32)darray_length(state.listeners);
+    event_listener blank = {.generation = 1};
+    darray_push(&state.listeners, blank);
+  }
+
+  event_listener *l = &state.listeners[index];
+  l->listener = listener;
+  l->callback = on_event;
+  l->priority = priority;
+  l->code = code;
+  l->prev = insert_after;
+  if (insert_after == EVENT_INVALID_INDEX) {
+    l->next = entry->first;
+    entry->first = index;
+  } else {
+    l->next = state.listeners[insert_after].next;
+    state.listeners[insert_after].next = index;
+  }
+  if (l->next != EVENT_INVALID_INDEX) {
+    state.listeners[l->next].prev = index;
+  }
+
+  return event_make_handle(index, l->generation);
+}
+
+bool event_unregister_handle(event_handle handle) {
+  if (!is_initialized) {
+    return false;
+  }
 
-  darray_push(&state.registered[code].events, event);
+  u32 index;
+  if (!event_handle_resolve(handle, &index)) {
+    return false;
+  }
 
+  event_listener_unlink(index);
   return true;
 }
 
@@ -76,16 +434,16 @@ bool event_unregister(u16 code, void *listener, PFN_on_event on_event) {
     return false;
   }
 
-  if (!state.registered[code].events) {
+  event_code_entry *entry = event_code_find(code);
+  if (!entry) {
     return false;
   }
 
-  registered_event *e;
-  u64 i;
-  darray_enum_for_each(state.registered[code].events, e, i) {
+  for (u32 i = entry->first; i != EVENT_INVALID_INDEX;
+       i = state.listeners[i].next) {
+    event_listener *e = &state.listeners[i];
     if (e->listener == listener && e->callback == on_event) {
-      registered_event popped_event;
-      darray_remove(state.registered[code].events, i, &popped_event);
+      event_listener_unlink(i);
       return true;
     }
   }
@@ -93,21 +451,464 @@ bool event_unregister(u16 code, void *listener, PFN_on_event on_event) {
   return false;
 }
 
+static bool event_dispatch(u16 code, u32 first, void *sender,
+                           event_context data) {
+  bool handled = false;
+  state.dispatch_depth++;
+
+  // Re-index the pool every step: a callback may register listeners and
+  // grow (move) it.
+  for (u32 i = first; i != EVENT_INVALID_INDEX; i = state.listeners[i].next) {
+    event_listener l = state.listeners[i];
+    if (!l.callback) {
+      continue;
+    }
+    if (l.callback(code, sender, l.listener, data)) {
+      handled = true;
+      break;
+    }
+  }
+
+  if (--state.dispatch_depth == 0) {
+    u32 index;
+    while (darray_length(state.deferred_frees) > 0) {
+      darray_pop(state.deferred_frees, &index);
+      darray_push(&state.free_listeners, index);
+    }
+  }
+
+  return handled;
+}
+
+static void event_recording_capture(u16 code, const event_context *data);
+
 bool event_fire(u16 code, void *sender, event_context data) {
   if (!is_initialized) {
     return false;
   }
 
-  if (!state.registered[code].events) {
+  // Events fired from inside a listener are consequences of another event
+  // and are reproduced by replaying that one.
+  if (state.recording.file && state.dispatch_depth == 0) {
+    event_recording_capture(code, &data);
+  }
+
+  event_code_entry *entry = event_code_find(code);
+  if (!entry) {
+    return false;
+  }
+
+  if (entry->coalesced_slot) {
+    coalesced_event *pending = &state.coalesced[entry->coalesced_slot - 1];
+    if (pending->pending) {
+      state.collapsed_count++;
+    }
+    pending->pending = true;
+    pending->sender = sender;
+    pending->data = data;
     return false;
   }
 
-  registered_event *e;
-  darray_for_each(state.registered[code].events, e) {
-    if (e->callback(code, sender, e->listener, data)) {
+  return event_dispatch(code, entry->first, sender, data);
+}
+
+bool event_set_coalesced(u16 code, bool coalesce) {
+  if (!is_initialized) {
+    return false;
+  }
+
+  if (coalesce) {
+    event_code_entry *entry = event_code_find_or_insert(code);
+    if (entry->coalesced_slot) {
       return true;
     }
+    if (state.coalesced_code_count == MAX_COALESCED_CODES) {
+      kwarn("Cannot coalesce event code %hu, limit of %d codes reached", code,
+            MAX_COALESCED_CODES);
+      return false;
+    }
+    coalesced_event *pending = &state.coalesced[state.coalesced_code_count++];
+    kzero_memory(pending, sizeof(coalesced_event));
+    pending->code = code;
+    entry->coalesced_slot = (u8)state.coalesced_code_count;
+    return true;
   }
 
-  return false;
+  event_code_entry *entry = event_code_find(code);
+  if (!entry || !entry->coalesced_slot) {
+    return true;
+  }
+
+  // Deliver whatever was held back so the last payload isn't lost.
+  u32 slot = entry->coalesced_slot - 1;
+  coalesced_event held = state.coalesced[slot];
+  entry->coalesced_slot = 0;
+  u32 last = --state.coalesced_code_count;
+  if (slot != last) {
+    state.coalesced[slot] = state.coalesced[last];
+    event_code_find(state.coalesced[slot].code)->coalesced_slot = (u8)(slot + 1);
+  }
+  if (held.pending) {
+    event_dispatch(held.code, entry->first, held.sender, held.data);
+  }
+  return true;
+}
+
+u32 event_flush_coalesced() {
+  if (!is_initialized) {
+    return 0;
+  }
+
+  u32 delivered = 0;
+  for (u32 i = 0; i < state.coalesced_code_count; ++i) {
+    coalesced_event *pending = &state.coalesced[i];
+    if (!pending->pending) {
+      continue;
+    }
+    // Cleared before dispatch so a listener firing the same code queues it
+    // for the next flush instead of being dropped.
+    pending->pending = false;
+    event_dispatch(pending->code, event_code_find(pending->code)->first,
+                   pending->sender, pending->data);
+    delivered++;
+  }
+
+  return delivered;
+}
+
+u64 event_get_collapsed_count() { return state.collapsed_count; }
+
+void *event_payload_allocate(u64 size) {
+  if (!is_initialized) {
+    return nullptr;
+  }
+
+  // A poster can be held up across two event_end_frame calls, so the arena
+  // it picked is only allocated from once it is known not to be reset:
+  // event_end_frame switches arenas only after it saw no users of the one it
+  // resets, and this sees the switch if it registered too late for that.
+  for (;;) {
+    u32 index = atomic_load(&state.payload_arena_index);
+    atomic_fetch_add(&state.payload_arena_users[index], 1);
+    if (atomic_load(&state.payload_arena_index) == index) {
+      payload_header *header = linear_allocator_allocate(
+          &state.payload_arenas[index], sizeof(payload_header) + size);
+      if (header) {
+        atomic_store_explicit(
+            &header->generation,
+            atomic_load_explicit(&state.payload_arena_generations[index],
+                                 memory_order_relaxed),
+            memory_order_relaxed);
+      }
+      atomic_fetch_sub_explicit(&state.payload_arena_users[index], 1,
+                                memory_order_release);
+      return header ? header + 1 : nullptr;
+    }
+    atomic_fetch_sub_explicit(&state.payload_arena_users[index], 1,
+                              memory_order_relaxed);
+  }
+}
+
+bool event_context_set_payload(event_context *context, const void *data,
+                               u64 size) {
+  void *payload = event_payload_allocate(size);
+  if (!payload) {
+    context->payload = nullptr;
+    context->payload_size = 0;
+    return false;
+  }
+
+  kcopy_memory(payload, data, size);
+  context->payload = payload;
+  context->payload_size = size;
+  return true;
+}
+
+void event_end_frame() {
+  if (!is_initialized) {
+    return;
+  }
+
+  // The other arena holds payloads from the previous frame, which have now
+  // been through both a synchronous dispatch and a drain of posted events.
+  // Payloads of it that are yet to be posted are retired first: a post
+  // either sees the new generation and is rejected, or is counted below.
+  u32 next =
+      atomic_load_explicit(&state.payload_arena_index, memory_order_relaxed) ^ 1;
+  atomic_fetch_add(&state.payload_arena_generations[next], 1);
+  // Posters still allocating from it since before the last switch.
+  while (atomic_load(&state.payload_arena_users[next]) != 0) {
+    kcpu_relax();
+  }
+  // Posted but not yet drained events keep their payloads, so the reset
+  // waits for a later frame and allocations go on after them meanwhile.
+  if (atomic_load(&state.payload_arena_posted[next]) == 0) {
+    linear_allocator_free_all(&state.payload_arenas[next]);
+  }
+  atomic_store(&state.payload_arena_index, next);
+
+  state.frame_number++;
+}
+
+bool event_recording_start(const char *path) {
+  if (!is_initialized || state.recording.file) {
+    return false;
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    kerror("Failed to open event recording `%s` for writing", path);
+    return false;
+  }
+  setvbuf(file, nullptr, _IOFBF, EVENT_STREAM_BUFFER_SIZE);
+
+  event_stream_header header = {
+      .magic = EVENT_STREAM_MAGIC,
+      .version = EVENT_STREAM_VERSION,
+  };
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    kerror("Failed to write event recording header to `%s`", path);
+    fclose(file);
+    return false;
+  }
+
+  kzero_memory(&state.recording, sizeof(event_stream));
+  state.recording.file = file;
+  state.recording.start_frame = state.frame_number;
+  state.recording.start_time = platform_get_absolute_time();
+  kinfo("Recording events to `%s`", path);
+  return true;
+}
+
+void event_recording_stop() {
+  if (!state.recording.file) {
+    return;
+  }
+
+  fclose(state.recording.file);
+  kinfo("Event recording stopped after %llu events",
+        state.recording.event_count);
+  kzero_memory(&state.recording, sizeof(event_stream));
+}
+
+static void event_recording_capture(u16 code, const event_context *data) {
+  event_stream *stream = &state.recording;
+  f64 elapsed = platform_get_absolute_time() - stream->start_time;
+  event_stream_record record = {
+      .frame = (u32)(state.frame_number - stream->start_frame),
+      .code = code,
+      .payload_size = data->payload ? (u32)data->payload_size : 0,
+      .timestamp_ns = (u64)(elapsed * 1000000000.0),
+  };
+  kcopy_memory(record.data, &data->data, sizeof(record.data));
+
+  bool ok = fwrite(&record, sizeof(record), 1, stream->file) == 1;
+  if (ok && record.payload_size > 0) {
+    ok = fwrite(data->payload, record.payload_size, 1, stream->file) == 1;
+  }
+  if (!ok) {
+    kerror("Failed to write to event recording, stopping");
+    event_recording_stop();
+    return;
+  }
+  stream->event_count++;
+}
+
+static bool event_replay_read_next() {
+  event_stream *stream = &state.replay;
+  stream->has_next =
+      fread(&stream->next, sizeof(event_stream_record), 1, stream->file) == 1;
+  return stream->has_next;
+}
+
+bool event_replay_start(const char *path) {
+  if (!is_initialized || state.replay.file) {
+    return false;
+  }
+
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    kerror("Failed to open event recording `%s` for replay", path);
+    return false;
+  }
+  setvbuf(file, nullptr, _IOFBF, EVENT_STREAM_BUFFER_SIZE);
+
+  event_stream_header header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != EVENT_STREAM_MAGIC ||
+      header.version != EVENT_STREAM_VERSION) {
+    kerror("`%s` is not an event recording this build can replay", path);
+    fclose(file);
+    return false;
+  }
+
+  kzero_memory(&state.replay, sizeof(event_stream));
+  state.replay.file = file;
+  state.replay.start_frame = state.frame_number;
+  event_replay_read_next();
+  kinfo("Replaying events from `%s`", path);
+  return true;
+}
+
+void event_replay_stop() {
+  if (!state.replay.file) {
+    return;
+  }
+
+  fclose(state.replay.file);
+  kinfo("Event replay stopped after %llu events", state.replay.event_count);
+  kzero_memory(&state.replay, sizeof(event_stream));
+}
+
+bool event_replay_active() { return state.replay.file != nullptr; }
+
+bool event_replay_frame() {
+  event_stream *stream = &state.replay;
+  if (!stream->file) {
+    return false;
+  }
+
+  u64 frame = state.frame_number - stream->start_frame;
+  while (stream->has_next && stream->next.frame <= frame) {
+    event_stream_record record = stream->next;
+    event_context data = {};
+    kcopy_memory(&data.data, record.data, sizeof(record.data));
+
+    if (record.payload_size > 0) {
+      data.payload = event_payload_allocate(record.payload_size);
+      if (!data.payload ||
+          fread(data.payload, record.payload_size, 1, stream->file) != 1) {
+        kerror("Event replay payload could not be restored, stopping");
+        event_replay_stop();
+        return false;
+      }
+      data.payload_size = record.payload_size;
+    }
+
+    stream->event_count++;
+    event_replay_read_next();
+    event_fire(record.code, nullptr, data);
+  }
+
+  return stream->has_next;
+}
+
+// Keeps the arena of a payload about to be posted from being reset until the
+// event is drained. Returns false if the arena was reclaimed since the
+// payload was allocated, or the payload is not from an arena at all.
+static bool event_payload_hold(const event_context *data, u8 *out_arena) {
+  const u8 *payload = data->payload;
+  u32 arena = 0;
+  while (arena < 2 &&
+         (payload < (const u8 *)state.payload_arenas[arena].memory ||
+          payload >= (const u8 *)state.payload_arenas[arena].memory +
+                         EVENT_PAYLOAD_ARENA_SIZE)) {
+    arena++;
+  }
+  if (arena == 2) {
+    kerror("Posted event payloads must come from event_payload_allocate");
+    return false;
+  }
+
+  // Read before the arena is held, while the payload is known to be intact
+  // for as long as posting is allowed.
+  u32 generation =
+      atomic_load_explicit(&((payload_header *)data->payload - 1)->generation,
+                           memory_order_relaxed);
+  atomic_fetch_add(&state.payload_arena_posted[arena], 1);
+  if (atomic_load(&state.payload_arena_generations[arena]) != generation) {
+    atomic_fetch_sub(&state.payload_arena_posted[arena], 1);
+    kwarn_limited(1, "Posted event payload was allocated before the last "
+                     "frame, dropping the event");
+    return false;
+  }
+  *out_arena = (u8)arena;
+  return true;
+}
+
+bool event_post(u16 code, void *sender, event_context data) {
+  if (!is_initialized) {
+    return false;
+  }
+
+  u8 payload_arena = 0;
+  if (data.payload && !event_payload_hold(&data, &payload_arena)) {
+    return false;
+  }
+
+  event_inbox *inbox = &state.inbox;
+  u64 pos = atomic_load_explicit(&inbox->head, memory_order_relaxed);
+  posted_event *slot;
+  for (;;) {
+    slot = &inbox->slots[pos & EVENT_INBOX_MASK];
+    u64 sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    i64 diff = (i64)sequence - (i64)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&inbox->head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The consumer hasn't caught up yet, the inbox is full.
+      atomic_fetch_add_explicit(&inbox->dropped, 1, memory_order_relaxed);
+      if (data.payload) {
+        atomic_fetch_sub(&state.payload_arena_posted[payload_arena], 1);
+      }
+      return false;
+    } else {
+      pos = atomic_load_explicit(&inbox->head, memory_order_relaxed);
+    }
+  }
+
+  slot->code = code;
+  slot->payload_arena = payload_arena;
+  slot->sender = sender;
+  slot->data = data;
+  atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+
+  return true;
+}
+
+u32 event_drain_posted() {
+  if (!is_initialized) {
+    return 0;
+  }
+
+  event_inbox *inbox = &state.inbox;
+
+  u64 dropped = atomic_exchange_explicit(&inbox->dropped, 0,
+                                         memory_order_relaxed);
+  if (dropped > 0) {
+    kwarn("Event inbox was full, %llu posted events were dropped", dropped);
+  }
+
+  // Bounded so that listeners posting from within a handler can't keep the
+  // main thread here forever; anything newer is picked up next drain.
+  u32 drained = 0;
+  while (drained < EVENT_INBOX_CAPACITY) {
+    posted_event *slot = &inbox->slots[inbox->tail & EVENT_INBOX_MASK];
+    u64 sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence != inbox->tail + 1) {
+      break;
+    }
+
+    u16 code = slot->code;
+    u8 payload_arena = slot->payload_arena;
+    void *sender = slot->sender;
+    event_context data = slot->data;
+    atomic_store_explicit(&slot->sequence,
+                          inbox->tail + EVENT_INBOX_CAPACITY,
+                          memory_order_release);
+    inbox->tail++;
+
+    event_fire(code, sender, data);
+    // Its payload stays valid for the rest of this frame.
+    if (data.payload) {
+      atomic_fetch_sub(&state.payload_arena_posted[payload_arena], 1);
+    }
+    drained++;
+  }
+
+  return drained;
 }
@@ -0,0 +1,111 @@
+#include "core/frame_pacer.h"
+#include "core/logger.h"
+#include "core/profiler.h"
+#include "platform/platform.h"
+
+#include <immintrin.h>
+
+// Bounds of how long before a deadline the pacer starts spinning.
+#define FRAME_PACER_SPIN_MIN_NS 50000ULL
+#define FRAME_PACER_SPIN_MAX_NS 4000000ULL
+#define FRAME_PACER_SPIN_INITIAL_NS 1000000ULL
+
+// The spin time tracks the latest wake-ups with this much headroom, in
+// quarters, and otherwise shrinks by 1/2^shift per frame.
+#define FRAME_PACER_SPIN_HEADROOM_QUARTERS 5
+#define FRAME_PACER_SPIN_DECAY_SHIFT 6
+
+// The average overshoot weighs the last frame at 1/2^shift.
+#define FRAME_PACER_AVERAGE_SHIFT 4
+
+typedef struct frame_pacer_state {
+  u64 period_ns;
+  // When the current frame should be released, 0 to start a new grid.
+  u64 deadline_ns;
+  frame_pacer_stats stats;
+} frame_pacer_state;
+
+static frame_pacer_state state;
+
+void frame_pacer_initialize(u32 target_fps) {
+  state = (frame_pacer_state){};
+  state.stats.spin_ns = FRAME_PACER_SPIN_INITIAL_NS;
+  frame_pacer_set_target_fps(target_fps);
+}
+
+void frame_pacer_set_target_fps(u32 target_fps) {
+  state.stats.target_fps = target_fps;
+  state.period_ns = target_fps ? 1000000000ULL / target_fps : 0;
+  state.deadline_ns = 0;
+  if (target_fps) {
+    kdebug("Pacing frames to %u per second", target_fps);
+  } else {
+    kdebug("Frame rate unlimited");
+  }
+}
+
+u32 frame_pacer_get_target_fps() { return state.stats.target_fps; }
+
+// Adapts the spin time to how late a sleep woke up.
+static void frame_pacer_adapt_spin(u64 wake_late_ns) {
+  frame_pacer_stats *stats = &state.stats;
+  u64 spin = stats->spin_ns - (stats->spin_ns >> FRAME_PACER_SPIN_DECAY_SHIFT);
+  u64 wanted = wake_late_ns * FRAME_PACER_SPIN_HEADROOM_QUARTERS / 4;
+  if (wanted > spin) {
+    spin = wanted;
+  }
+  stats->spin_ns =
+      KCLAMP(spin, FRAME_PACER_SPIN_MIN_NS, FRAME_PACER_SPIN_MAX_NS);
+}
+
+void frame_pacer_wait() {
+  if (state.period_ns == 0) {
+    return;
+  }
+
+  KPROFILE_FUNCTION();
+  frame_pacer_stats *stats = &state.stats;
+  u64 now = platform_get_absolute_time_ns();
+  if (state.deadline_ns == 0) {
+    state.deadline_ns = now + state.period_ns;
+    return;
+  }
+
+  if (now >= state.deadline_ns) {
+    stats->missed_deadlines++;
+    // Keep the grid after a slightly late frame, but start over after a long
+    // one rather than rushing the next frames to catch up.
+    if (now - state.deadline_ns < state.period_ns) {
+      state.deadline_ns += state.period_ns;
+    } else {
+      state.deadline_ns = now + state.period_ns;
+    }
+    return;
+  }
+
+  if (state.deadline_ns - now > stats->spin_ns) {
+    u64 wake_at = state.deadline_ns - stats->spin_ns;
+    platform_sleep_ns(wake_at - now);
+    now = platform_get_absolute_time_ns();
+    frame_pacer_adapt_spin(now > wake_at ? now - wake_at : 0);
+  }
+
+  while (now < state.deadline_ns) {
+    _mm_pause();
+    now = platform_get_absolute_time_ns();
+  }
+
+  u64 overshoot = now - state.deadline_ns;
+  stats->last_overshoot_ns = overshoot;
+  stats->average_overshoot_ns +=
+      (overshoot >> FRAME_PACER_AVERAGE_SHIFT) -
+      (stats->average_overshoot_ns >> FRAME_PACER_AVERAGE_SHIFT);
+  if (overshoot > stats->max_overshoot_ns) {
+    stats->max_overshoot_ns = overshoot;
+  }
+  state.deadline_ns += state.period_ns;
+}
+
+void frame_pacer_get_stats(frame_pacer_stats *out_stats) {
+  *out_stats = state.stats;
+}
@@ -0,0 +1,171 @@
+#include "core/frame_stats.h"
+#include "core/frame_pacer.h"
+#include "core/logger.h"
+#include "platform/platform.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+
+#define FRAME_STATS_FALLBACK_FPS 60
+
+typedef struct frame_stats_state {
+  frame_sample samples[FRAME_STATS_WINDOW];
+  // Next sample to overwrite.
+  u32 next;
+  u32 count;
+  u64 total_frames;
+  u64 total_stutters;
+  u64 budget_ns;
+  f32 stutter_factor;
+  u64 log_interval_ns;
+  u64 next_log_ns;
+  // Sorting scratch space for percentiles.
+  u64 sorted[FRAME_STATS_WINDOW];
+} frame_stats_state;
+
+static frame_stats_state state;
+
+void frame_stats_initialize(f32 log_interval_seconds) {
+  state = (frame_stats_state){};
+  state.stutter_factor = FRAME_STATS_DEFAULT_STUTTER_FACTOR;
+  frame_stats_set_log_interval(log_interval_seconds);
+}
+
+static u64 frame_stats_budget() {
+  if (state.budget_ns) {
+    return state.budget_ns;
+  }
+  u32 fps = frame_pacer_get_target_fps();
+  return 1000000000ULL / (fps ? fps : FRAME_STATS_FALLBACK_FPS);
+}
+
+static bool frame_stats_is_stutter(const frame_sample *sample, u64 budget_ns) {
+  return (f64)sample->cpu_ns > (f64)budget_ns * state.stutter_factor;
+}
+
+static void frame_stats_log() {
+  frame_stats_report report;
+  frame_stats_get_report(&report);
+  kinfo("Frames: cpu avg %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f ms, "
+        "update avg %.2f ms, render avg %.2f ms, wait avg %.2f ms, "
+        "%u/%u over %.2f ms",
+        report.cpu.average_ns / 1000000.0, report.cpu.p50_ns / 1000000.0,
+        report.cpu.p95_ns / 1000000.0, report.cpu.p99_ns / 1000000.0,
+        report.cpu.max_ns / 1000000.0, report.update.average_ns / 1000000.0,
+        report.render.average_ns / 1000000.0,
+        report.wait.average_ns / 1000000.0, report.window_stutters,
+        report.frame_count,
+        report.budget_ns * report.stutter_factor / 1000000.0);
+
+  const u64 *counters = report.counters;
+  if (counters[PROFILE_COUNTER_CYCLES]) {
+    kinfo("Frame counters: %.2f instructions per cycle, %llu L1D misses, %llu "
+          "LLC misses, %llu branch misses per frame",
+          (f64)counters[PROFILE_COUNTER_INSTRUCTIONS] /
+              (f64)counters[PROFILE_COUNTER_CYCLES],
+          counters[PROFILE_COUNTER_L1D_MISSES],
+          counters[PROFILE_COUNTER_LLC_MISSES],
+          counters[PROFILE_COUNTER_BRANCH_MISSES]);
+  }
+}
+
+void frame_stats_record(const frame_sample *sample) {
+  state.samples[state.next] = *sample;
+  state.next = (state.next + 1) % FRAME_STATS_WINDOW;
+  if (state.count < FRAME_STATS_WINDOW) {
+    state.count++;
+  }
+  state.total_frames++;
+  if (frame_stats_is_stutter(sample, frame_stats_budget())) {
+    state.total_stutters++;
+  }
+
+  if (state.log_interval_ns) {
+    u64 now = platform_get_absolute_time_ns();
+    if (state.next_log_ns == 0) {
+      state.next_log_ns = now + state.log_interval_ns;
+    } else if (now >= state.next_log_ns) {
+      frame_stats_log();
+      state.next_log_ns = now + state.log_interval_ns;
+    }
+  }
+}
+
+void frame_stats_set_budget(u64 budget_ns) { state.budget_ns = budget_ns; }
+
+void frame_stats_set_stutter_factor(f32 factor) {
+  state.stutter_factor = factor;
+}
+
+void frame_stats_set_log_interval(f32 seconds) {
+  state.log_interval_ns = seconds > 0 ? (u64)(seconds * 1000000000.0) : 0;
+  state.next_log_ns = 0;
+}
+
+static i32 frame_stats_compare(const void *a, const void *b) {
+  u64 left = *(const u64 *)a;
+  u64 right = *(const u64 *)b;
+  return (left > right) - (left < right);
+}
+
+// Nearest-rank percentile of the sorted scratch values.
+static u64 frame_stats_percentile(u32 count, u32 percent) {
+  u32 rank = (count * percent + 99) / 100;
+  return state.sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * Summarizes one of the u64 fields of the samples in the window.
+ * @param offset The field's offset in frame_sample.
+ */
+static frame_time_summary frame_stats_summarize(u64 offset) {
+  frame_time_summary summary = {};
+  u32 count = state.count;
+  if (count == 0) {
+    return summary;
+  }
+
+  u64 total = 0;
+  for (u32 i = 0; i < count; ++i) {
+    u64 value = *(const u64 *)((const u8 *)&state.samples[i] + offset);
+    state.sorted[i] = value;
+    total += value;
+  }
+  qsort(state.sorted, count, sizeof(u64), frame_stats_compare);
+
+  summary.average_ns = total / count;
+  summary.p50_ns = frame_stats_percentile(count, 50);
+  summary.p95_ns = frame_stats_percentile(count, 95);
+  summary.p99_ns = frame_stats_percentile(count, 99);
+  summary.max_ns = state.sorted[count - 1];
+  return summary;
+}
+
+void frame_stats_get_report(frame_stats_report *out_report) {
+  frame_stats_report report = {
+      .frame_count = state.count,
+      .total_frames = state.total_frames,
+      .cpu = frame_stats_summarize(offsetof(frame_sample, cpu_ns)),
+      .update = frame_stats_summarize(offsetof(frame_sample, update_ns)),
+      .render = frame_stats_summarize(offsetof(frame_sample, render_ns)),
+      .wait = frame_stats_summarize(offsetof(frame_sample, wait_ns)),
+      .budget_ns = frame_stats_budget(),
+      .stutter_factor = state.stutter_factor,
+      .total_stutters = state.total_stutters,
+  };
+  for (u32 i = 0; i < state.count; ++i) {
+    const frame_sample *sample = &state.samples[i];
+    if (frame_stats_is_stutter(sample, report.budget_ns)) {
+      report.window_stutters++;
+    }
+    for (u32 c = 0; c < PROFILE_COUNTER_COUNT; ++c) {
+      report.counters[c] += sample->counters[c];
+    }
+  }
+  if (state.count > 0) {
+    for (u32 c = 0; c < PROFILE_COUNTER_COUNT; ++c) {
+      report.counters[c] /= state.count;
+    }
+  }
+  *out_report = report;
+}
@@ -1,7 +1,21 @@
+#define KLOG_CATEGORY LOG_CATEGORY_INPUT
+
 #include "core/input.h"
 #include "core/event.h"
 #include "core/kmemory.h"
 #include "core/logger.h"
+#include "platform/platform.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+// Must be a power of two.
+#define INPUT_EVENT_BUFFER_CAPACITY 256
+#define INPUT_EVENT_BUFFER_MASK (INPUT_EVENT_BUFFER_CAPACITY - 1)
+
+// Must be a power of two.
+#define INPUT_POSTED_CAPACITY 1024
+#define INPUT_POSTED_MASK (INPUT_POSTED_CAPACITY - 1)
 
 typedef struct keyboard_state {
   bool keys[256];
@@ -13,11 +27,99 @@ typedef struct mouse_state {
   bool buttons[BUTTON_MAX_BUTTONS];
 } mouse_state;
 
+#define INPUT_STREAM_MAGIC 0x4E494B4FU // "OKIN"
+#define INPUT_STREAM_VERSION 1
+#define INPUT_STREAM_BUFFER_SIZE (64ULL * 1024)
+
+typedef struct input_stream_header {
+  u32 magic;
+  u16 version;
+  u16 reserved;
+} input_stream_header;
+
+/**
+ * One recorded input_process_* call as stored on disk. `code` is the key or
+ * button; `frame` is relative to the start of the recording.
+ */
+typedef struct input_stream_record {
+  u32 frame;
+  u8 type;
+  u8 code;
+  u8 pressed;
+  i8 z_delta;
+  i16 x;
+  i16 y;
+} input_stream_record;
+
+static_assert(sizeof(input_stream_record) == 12,
+              "input_stream_record must stay 12 bytes, it is written as is.");
+
+typedef struct input_stream {
+  FILE *file;
+  u64 start_frame;
+  u64 record_count;
+  // Playback only: the next record, read ahead of its frame.
+  input_stream_record next;
+  bool has_next;
+} input_stream;
+
+/**
+ * Single-producer, single-consumer ring carrying raw input from the platform
+ * input thread to the main thread. Producer and consumer positions live on
+ * separate cache lines.
+ */
+typedef struct input_posted_queue {
+  alignas(64) _Atomic u64 head;
+  alignas(64) _Atomic u64 tail;
+  _Atomic u64 dropped;
+  input_event events[INPUT_POSTED_CAPACITY];
+} input_posted_queue;
+
+/**
+ * Latest input state as seen by the input thread, published with a sequence
+ * lock. The fields are atomics so that torn reads are well defined; readers
+ * discard them when the sequence changed underneath.
+ */
+typedef struct input_live_state {
+  alignas(64) _Atomic u64 sequence;
+  _Atomic u64 state_bits[INPUT_STATE_WORDS];
+  _Atomic i32 mouse_x;
+  _Atomic i32 mouse_y;
+  _Atomic f64 timestamp;
+} input_live_state;
+
 typedef struct input_state {
   keyboard_state keyboard_current;
   keyboard_state keyboard_previous;
   mouse_state mouse_current;
   mouse_state mouse_previous;
+
+  // Ring of raw events. `event_head` is the total number ever written and
+  // `frame_start` the value it had at the start of the current frame.
+  input_event events[INPUT_EVENT_BUFFER_CAPACITY];
+  u64 event_head;
+  u64 frame_start;
+  u64 dropped_events;
+
+  // Current key and button state packed one bit each, see
+  // input_get_state_bits.
+  u64 state_bits[INPUT_STATE_WORDS];
+
+  // Number of times input_update has been called.
+  u64 frame_number;
+  input_stream recording;
+  input_stream playback;
+
+  // Set while the platform layer reads input on its own thread. The
+  // `input_process_*` functions then only queue input for
+  // `input_drain_posted`.
+  bool threaded;
+  input_posted_queue posted;
+  input_live_state live;
+  // Owned by the input thread: the state it publishes to `live`.
+  u64 live_bits[INPUT_STATE_WORDS];
+  i16 live_mouse_x;
+  i16 live_mouse_y;
 } input_state;
 
 static bool initialized = false;
@@ -29,7 +131,11 @@ void input_initialize() {
   kinfo("Input subsystem initialized");
 }
 
-void input_shutdown() { initialized = false; }
+void input_shutdown() {
+  input_recording_stop();
+  input_playback_stop();
+  initialized = false;
+}
 
 void input_update(f64 delta_time) {
   (void)delta_time;
@@ -41,8 +147,66 @@ void input_update(f64 delta_time) {
                sizeof(keyboard_state));
   kcopy_memory(&state.mouse_previous, &state.mouse_current,
                sizeof(mouse_state));
+
+  u64 received = state.event_head - state.frame_start;
+  if (received > INPUT_EVENT_BUFFER_CAPACITY) {
+    state.dropped_events += received - INPUT_EVENT_BUFFER_CAPACITY;
+  }
+  state.frame_start = state.event_head;
+  state.frame_number++;
+}
+
+static void input_record(input_event_type type, u8 code, bool pressed, i16 x,
+                         i16 y, i8 z_delta) {
+  input_stream_record record = {
+      .frame = (u32)(state.frame_number - state.recording.start_frame),
+      .type = type,
+      .code = code,
+      .pressed = pressed,
+      .z_delta = z_delta,
+      .x = x,
+      .y = y,
+  };
+  if (fwrite(&record, sizeof(record), 1, state.recording.file) != 1) {
+    kerror("Failed to write to input recording, stopping");
+    input_recording_stop();
+    return;
+  }
+  state.recording.record_count++;
+}
+
+static void input_set_bit(u64 *bits, u32 index, bool set) {
+  if (set) {
+    bits[index / 64] |= 1ULL << (index % 64);
+  } else {
+    bits[index / 64] &= ~(1ULL << (index % 64));
+  }
 }
 
+static input_event *input_push_event(input_event_type type, f64 timestamp) {
+  input_event *event =
+      &state.events[state.event_head++ & INPUT_EVENT_BUFFER_MASK];
+  event->timestamp = timestamp;
+  event->type = type;
+  return event;
+}
+
+const u64 *input_get_state_bits() { return state.state_bits; }
+
+u32 input_get_frame_event_count() {
+  u64 received = state.event_head - state.frame_start;
+  return received > INPUT_EVENT_BUFFER_CAPACITY ? INPUT_EVENT_BUFFER_CAPACITY
+                                                : (u32)received;
+}
+
+const input_event *input_get_frame_event(u32 index) {
+  // Once a frame overflows the ring, only the newest events are left.
+  u64 first = state.event_head - input_get_frame_event_count();
+  return &state.events[(first + index) & INPUT_EVENT_BUFFER_MASK];
+}
+
+u64 input_get_dropped_event_count() { return state.dropped_events; }
+
 bool input_is_key_down(keys key) { return state.keyboard_current.keys[key]; }
 
 bool input_is_key_up(keys key) { return !state.keyboard_current.keys[key]; }
@@ -51,11 +215,19 @@ bool input_was_key_down(keys key) { return state.keyboard_previous.keys[key]; }
 
 bool input_was_key_up(keys key) { return !state.keyboard_previous.keys[key]; }
 
-void input_process_key(keys key, bool pressed) {
+static void input_apply_key(keys key, bool pressed, f64 timestamp) {
+  if (state.recording.file) {
+    input_record(INPUT_EVENT_KEY, key, pressed, 0, 0, 0);
+  }
   if (state.keyboard_current.keys[key] != pressed) {
     state.keyboard_current.keys[key] = pressed;
+    input_set_bit(state.state_bits, key, pressed);
+
+    input_event *event = input_push_event(INPUT_EVENT_KEY, timestamp);
+    event->key.key = key;
+    event->key.pressed = pressed;
 
-    event_context context;
+    event_context context = {};
     context.data.u16[0] = key;
     event_fire(pressed ? EVENT_CODE_KEY_PRESSED : EVENT_CODE_KEY_RELEASED,
                nullptr, context);
@@ -88,30 +260,355 @@ void input_get_previous_mouse_position(i32 *x, i32 *y) {
   *y = state.mouse_previous.y;
 }
 
-void input_process_button(buttons button, bool pressed) {
+static void input_apply_button(buttons button, bool pressed, f64 timestamp) {
+  if (state.recording.file) {
+    input_record(INPUT_EVENT_BUTTON, (u8)button, pressed, 0, 0, 0);
+  }
   if (state.mouse_current.buttons[button] != pressed) {
     state.mouse_current.buttons[button] = pressed;
+    input_set_bit(state.state_bits, INPUT_STATE_BUTTON_WORD * 64 + button,
+                  pressed);
 
-    event_context context;
+    input_event *event = input_push_event(INPUT_EVENT_BUTTON, timestamp);
+    event->button.button = button;
+    event->button.pressed = pressed;
+
+    event_context context = {};
     context.data.u16[0] = button;
     event_fire(pressed ? EVENT_CODE_BUTTON_PRESSED : EVENT_CODE_BUTTON_RELEASED,
                nullptr, context);
   }
 }
-void input_process_mouse_move(i16 x, i16 y) {
+
+static void input_apply_mouse_move(i16 x, i16 y, f64 timestamp) {
+  if (state.recording.file) {
+    input_record(INPUT_EVENT_MOUSE_MOVE, 0, false, x, y, 0);
+  }
   if (state.mouse_current.x != x || state.mouse_current.y != y) {
-    kdebug("Mouse pos: %d, %d", x, y);
+    kdebug_limited(10, "Mouse pos: %d, %d", x, y);
     state.mouse_current.x = x;
     state.mouse_current.y = y;
 
-    event_context context;
+    input_event *event = input_push_event(INPUT_EVENT_MOUSE_MOVE, timestamp);
+    event->move.x = x;
+    event->move.y = y;
+
+    event_context context = {};
     context.data.u16[0] = x;
     context.data.u16[1] = y;
     event_fire(EVENT_CODE_MOUSE_MOVED, nullptr, context);
   }
 }
-void input_process_mouse_wheel(i8 z_delta) {
-  event_context context;
+
+static void input_apply_mouse_wheel(i8 z_delta, f64 timestamp) {
+  if (state.recording.file) {
+    input_record(INPUT_EVENT_MOUSE_WHEEL, 0, false, 0, 0, z_delta);
+  }
+  input_event *event = input_push_event(INPUT_EVENT_MOUSE_WHEEL, timestamp);
+  event->wheel.z_delta = z_delta;
+
+  event_context context = {};
   context.data.i8[0] = z_delta;
   event_fire(EVENT_CODE_MOUSE_WHEEL, nullptr, context);
 }
+
+static void input_apply(const input_event *event) {
+  switch (event->type) {
+  case INPUT_EVENT_KEY:
+    input_apply_key(event->key.key, event->key.pressed, event->timestamp);
+    break;
+  case INPUT_EVENT_BUTTON:
+    input_apply_button(event->button.button, event->button.pressed,
+                       event->timestamp);
+    break;
+  case INPUT_EVENT_MOUSE_MOVE:
+    input_apply_mouse_move(event->move.x, event->move.y, event->timestamp);
+    break;
+  case INPUT_EVENT_MOUSE_WHEEL:
+    input_apply_mouse_wheel(event->wheel.z_delta, event->timestamp);
+    break;
+  }
+}
+
+// Runs on the input thread: the only producer of `state.posted`.
+static void input_post(const input_event *event) {
+  input_posted_queue *queue = &state.posted;
+  u64 head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  u64 tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+  if (head - tail >= INPUT_POSTED_CAPACITY) {
+    atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+    return;
+  }
+  queue->events[head & INPUT_POSTED_MASK] = *event;
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+// Runs on the input thread: the only writer of `state.live`.
+static void input_publish_live(f64 timestamp) {
+  input_live_state *live = &state.live;
+  u64 sequence = atomic_load_explicit(&live->sequence, memory_order_relaxed);
+  atomic_store_explicit(&live->sequence, sequence + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  for (u32 i = 0; i < INPUT_STATE_WORDS; ++i) {
+    atomic_store_explicit(&live->state_bits[i], state.live_bits[i],
+                          memory_order_relaxed);
+  }
+  atomic_store_explicit(&live->mouse_x, state.live_mouse_x,
+                        memory_order_relaxed);
+  atomic_store_explicit(&live->mouse_y, state.live_mouse_y,
+                        memory_order_relaxed);
+  atomic_store_explicit(&live->timestamp, timestamp, memory_order_relaxed);
+
+  atomic_store_explicit(&live->sequence, sequence + 2, memory_order_release);
+}
+
+void input_process_key(keys key, bool pressed) {
+  f64 timestamp = platform_get_absolute_time();
+  if (!state.threaded) {
+    input_apply_key(key, pressed, timestamp);
+    return;
+  }
+
+  input_set_bit(state.live_bits, key, pressed);
+  input_publish_live(timestamp);
+  input_post(&(input_event){.timestamp = timestamp,
+                            .type = INPUT_EVENT_KEY,
+                            .key = {key, pressed}});
+}
+
+void input_process_button(buttons button, bool pressed) {
+  f64 timestamp = platform_get_absolute_time();
+  if (!state.threaded) {
+    input_apply_button(button, pressed, timestamp);
+    return;
+  }
+
+  input_set_bit(state.live_bits, INPUT_STATE_BUTTON_WORD * 64 + button,
+                pressed);
+  input_publish_live(timestamp);
+  input_post(&(input_event){.timestamp = timestamp,
+                            .type = INPUT_EVENT_BUTTON,
+                            .button = {button, pressed}});
+}
+
+void input_process_mouse_move(i16 x, i16 y) {
+  f64 timestamp = platform_get_absolute_time();
+  if (!state.threaded) {
+    input_apply_mouse_move(x, y, timestamp);
+    return;
+  }
+
+  state.live_mouse_x = x;
+  state.live_mouse_y = y;
+  input_publish_live(timestamp);
+  input_post(&(input_event){.timestamp = timestamp,
+                            .type = INPUT_EVENT_MOUSE_MOVE,
+                            .move = {x, y}});
+}
+
+void input_process_mouse_wheel(i8 z_delta) {
+  f64 timestamp = platform_get_absolute_time();
+  if (!state.threaded) {
+    input_apply_mouse_wheel(z_delta, timestamp);
+    return;
+  }
+
+  input_post(&(input_event){.timestamp = timestamp,
+                            .type = INPUT_EVENT_MOUSE_WHEEL,
+                            .wheel = {z_delta}});
+}
+
+u32 input_drain_posted() {
+  input_posted_queue *queue = &state.posted;
+  u64 tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  u64 head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+  u32 count = 0;
+  for (; tail != head; ++tail, ++count) {
+    input_apply(&queue->events[tail & INPUT_POSTED_MASK]);
+  }
+  atomic_store_explicit(&queue->tail, tail, memory_order_release);
+
+  state.dropped_events +=
+      atomic_exchange_explicit(&queue->dropped, 0, memory_order_relaxed);
+  return count;
+}
+
+void input_set_threaded(bool threaded) {
+  if (threaded == state.threaded) {
+    return;
+  }
+
+  if (threaded) {
+    // Start the input thread's view from the state the main thread has.
+    kcopy_memory(state.live_bits, state.state_bits, sizeof(state.live_bits));
+    state.live_mouse_x = state.mouse_current.x;
+    state.live_mouse_y = state.mouse_current.y;
+    input_publish_live(platform_get_absolute_time());
+    state.threaded = true;
+  } else {
+    // The input thread has been joined, pick up what it left behind.
+    state.threaded = false;
+    input_drain_posted();
+  }
+}
+
+void input_sample_latest(input_snapshot *out_snapshot) {
+  if (!state.threaded) {
+    kcopy_memory(out_snapshot->state_bits, state.state_bits,
+                 sizeof(out_snapshot->state_bits));
+    out_snapshot->mouse_x = state.mouse_current.x;
+    out_snapshot->mouse_y = state.mouse_current.y;
+    out_snapshot->timestamp =
+        state.event_head
+            ? state.events[(state.event_head - 1) & INPUT_EVENT_BUFFER_MASK]
+                  .timestamp
+            : 0.0;
+    return;
+  }
+
+  input_live_state *live = &state.live;
+  u64 before, after;
+  do {
+    before = atomic_load_explicit(&live->sequence, memory_order_acquire);
+    for (u32 i = 0; i < INPUT_STATE_WORDS; ++i) {
+      out_snapshot->state_bits[i] =
+          atomic_load_explicit(&live->state_bits[i], memory_order_relaxed);
+    }
+    out_snapshot->mouse_x =
+        atomic_load_explicit(&live->mouse_x, memory_order_relaxed);
+    out_snapshot->mouse_y =
+        atomic_load_explicit(&live->mouse_y, memory_order_relaxed);
+    out_snapshot->timestamp =
+        atomic_load_explicit(&live->timestamp, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    after = atomic_load_explicit(&live->sequence, memory_order_relaxed);
+  } while ((before & 1) || before != after);
+}
+
+bool input_recording_start(const char *path) {
+  if (!initialized || state.recording.file || state.playback.file) {
+    return false;
+  }
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    kerror("Failed to open input recording `%s` for writing", path);
+    return false;
+  }
+  setvbuf(file, nullptr, _IOFBF, INPUT_STREAM_BUFFER_SIZE);
+
+  input_stream_header header = {
+      .magic = INPUT_STREAM_MAGIC,
+      .version = INPUT_STREAM_VERSION,
+  };
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    kerror("Failed to write input recording header to `%s`", path);
+    fclose(file);
+    return false;
+  }
+
+  kzero_memory(&state.recording, sizeof(input_stream));
+  state.recording.file = file;
+  state.recording.start_frame = state.frame_number;
+  kinfo("Recording input to `%s`", path);
+  return true;
+}
+
+void input_recording_stop() {
+  if (!state.recording.file) {
+    return;
+  }
+
+  fclose(state.recording.file);
+  kinfo("Input recording stopped after %llu inputs",
+        state.recording.record_count);
+  kzero_memory(&state.recording, sizeof(input_stream));
+}
+
+static bool input_playback_read_next() {
+  state.playback.has_next = fread(&state.playback.next,
+                                  sizeof(input_stream_record), 1,
+                                  state.playback.file) == 1;
+  return state.playback.has_next;
+}
+
+bool input_playback_start(const char *path) {
+  if (!initialized || state.playback.file || state.recording.file) {
+    return false;
+  }
+
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    kerror("Failed to open input recording `%s` for playback", path);
+    return false;
+  }
+  setvbuf(file, nullptr, _IOFBF, INPUT_STREAM_BUFFER_SIZE);
+
+  input_stream_header header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != INPUT_STREAM_MAGIC ||
+      header.version != INPUT_STREAM_VERSION) {
+    kerror("`%s` is not an input recording this build can play back", path);
+    fclose(file);
+    return false;
+  }
+
+  kzero_memory(&state.playback, sizeof(input_stream));
+  state.playback.file = file;
+  state.playback.start_frame = state.frame_number;
+  input_playback_read_next();
+  kinfo("Playing back input from `%s`", path);
+  return true;
+}
+
+void input_playback_stop() {
+  if (!state.playback.file) {
+    return;
+  }
+
+  fclose(state.playback.file);
+  kinfo("Input playback stopped after %llu inputs",
+        state.playback.record_count);
+  kzero_memory(&state.playback, sizeof(input_stream));
+}
+
+bool input_playback_active() { return state.playback.file != nullptr; }
+
+bool input_playback_frame() {
+  input_stream *stream = &state.playback;
+  if (!stream->file) {
+    return false;
+  }
+
+  u64 frame = state.frame_number - stream->start_frame;
+  while (stream->has_next && stream->next.frame <= frame) {
+    input_stream_record record = stream->next;
+    stream->record_count++;
+    input_playback_read_next();
+
+    f64 timestamp = platform_get_absolute_time();
+    switch (record.type) {
+    case INPUT_EVENT_KEY:
+      input_apply_key((keys)record.code, record.pressed, timestamp);
+      break;
+    case INPUT_EVENT_BUTTON:
+      if (record.code < BUTTON_MAX_BUTTONS) {
+        input_apply_button((buttons)record.code, record.pressed, timestamp);
+      }
+      break;
+    case INPUT_EVENT_MOUSE_MOVE:
+      input_apply_mouse_move(record.x, record.y, timestamp);
+      break;
+    case INPUT_EVENT_MOUSE_WHEEL:
+      input_apply_mouse_wheel(record.z_delta, timestamp);
+      break;
+    default:
+      kwarn("Unknown input type %hhu in playback, skipping", record.type);
+      break;
+    }
+  }
+
+  return stream->has_next;
+}
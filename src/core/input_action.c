@@ -0,0 +1,200 @@
+#define KLOG_CATEGORY LOG_CATEGORY_INPUT
+
+#include "core/input_action.h"
+
+#include "core/kmemory.h"
+#include "core/kstring.h"
+#include "core/logger.h"
+
+/**
+ * A binding compiled to bitmasks: `trigger` has the single key or button bit
+ * set, `modifiers` the modifier groups that must also be held.
+ */
+typedef struct action_binding {
+  u64 trigger[INPUT_STATE_WORDS];
+  input_modifier modifiers;
+} action_binding;
+
+typedef struct input_action {
+  char *name;
+  u8 binding_count;
+  action_binding bindings[MAX_ACTION_BINDINGS];
+} input_action;
+
+typedef struct input_action_state {
+  input_action actions[MAX_INPUT_ACTIONS];
+  u8 action_count;
+
+  // Per modifier group, every key that satisfies it.
+  u64 modifier_masks[3][INPUT_STATE_WORDS];
+
+  u64 down;
+  u64 previous;
+} input_action_state;
+
+static bool initialized = false;
+static input_action_state state;
+
+static void set_bit(u64 *words, u32 bit) {
+  words[bit / 64] |= 1ULL << (bit % 64);
+}
+
+static bool any_bits(const u64 *a, const u64 *b) {
+  u64 result = 0;
+  for (u32 i = 0; i < INPUT_STATE_WORDS; ++i) {
+    result |= a[i] & b[i];
+  }
+  return result != 0;
+}
+
+void input_action_initialize() {
+  kzero_memory(&state, sizeof(state));
+
+  set_bit(state.modifier_masks[0], KKEY_SHIFT);
+  set_bit(state.modifier_masks[0], KKEY_LSHIFT);
+  set_bit(state.modifier_masks[0], KKEY_RSHIFT);
+  set_bit(state.modifier_masks[1], KKEY_CONTROL);
+  set_bit(state.modifier_masks[1], KKEY_LCONTROL);
+  set_bit(state.modifier_masks[1], KKEY_RCONTROL);
+  set_bit(state.modifier_masks[2], KKEY_LMENU);
+  set_bit(state.modifier_masks[2], KKEY_RMENU);
+
+  initialized = true;
+}
+
+void input_action_shutdown() {
+  for (u8 i = 0; i < state.action_count; ++i) {
+    kfree(state.actions[i].name);
+  }
+  kzero_memory(&state, sizeof(state));
+  initialized = false;
+}
+
+void input_action_update() {
+  if (!initialized) {
+    return;
+  }
+
+  const u64 *bits = input_get_state_bits();
+
+  u8 held_modifiers = 0;
+  for (u32 m = 0; m < 3; ++m) {
+    if (any_bits(bits, state.modifier_masks[m])) {
+      held_modifiers |= 1 << m;
+    }
+  }
+
+  u64 down = 0;
+  for (u8 a = 0; a < state.action_count; ++a) {
+    const input_action *action = &state.actions[a];
+    for (u8 b = 0; b < action->binding_count; ++b) {
+      const action_binding *binding = &action->bindings[b];
+      if ((binding->modifiers & held_modifiers) == binding->modifiers &&
+          any_bits(bits, binding->trigger)) {
+        down |= 1ULL << a;
+        break;
+      }
+    }
+  }
+
+  state.previous = state.down;
+  state.down = down;
+}
+
+action_id input_action_find(const char *name) {
+  for (u8 i = 0; i < state.action_count; ++i) {
+    if (strings_equal(state.actions[i].name, name)) {
+      return i;
+    }
+  }
+  return INPUT_ACTION_INVALID;
+}
+
+action_id input_action_register(const char *name) {
+  if (!initialized) {
+    return INPUT_ACTION_INVALID;
+  }
+
+  action_id existing = input_action_find(name);
+  if (existing != INPUT_ACTION_INVALID) {
+    return existing;
+  }
+
+  if (state.action_count == MAX_INPUT_ACTIONS) {
+    kerror("Cannot register action `%s`, limit of %d actions reached", name,
+           MAX_INPUT_ACTIONS);
+    return INPUT_ACTION_INVALID;
+  }
+
+  action_id id = state.action_count++;
+  state.actions[id].name = string_duplicate(name);
+  state.actions[id].binding_count = 0;
+  return id;
+}
+
+static action_binding *input_action_add_binding(action_id action,
+                                                input_modifier modifiers) {
+  if (action >= state.action_count) {
+    kwarn("Tried to bind invalid action %hhu", action);
+    return nullptr;
+  }
+
+  input_action *a = &state.actions[action];
+  if (a->binding_count == MAX_ACTION_BINDINGS) {
+    kwarn("Action `%s` already has %d bindings", a->name,
+          MAX_ACTION_BINDINGS);
+    return nullptr;
+  }
+
+  action_binding *binding = &a->bindings[a->binding_count++];
+  kzero_memory(binding, sizeof(action_binding));
+  binding->modifiers = modifiers;
+  return binding;
+}
+
+bool input_action_bind_key(action_id action, keys key,
+                           input_modifier modifiers) {
+  action_binding *binding = input_action_add_binding(action, modifiers);
+  if (!binding) {
+    return false;
+  }
+  set_bit(binding->trigger, key);
+  return true;
+}
+
+bool input_action_bind_button(action_id action, buttons button,
+                              input_modifier modifiers) {
+  if (button >= BUTTON_MAX_BUTTONS) {
+    return false;
+  }
+  action_binding *binding = input_action_add_binding(action, modifiers);
+  if (!binding) {
+    return false;
+  }
+  set_bit(binding->trigger, (INPUT_STATE_BUTTON_WORD * 64) + button);
+  return true;
+}
+
+void input_action_clear_bindings(action_id action) {
+  if (action < state.action_count) {
+    state.actions[action].binding_count = 0;
+  }
+}
+
+bool input_action_down(action_id action) {
+  return action < MAX_INPUT_ACTIONS && ((state.down >> action) & 1);
+}
+
+bool input_action_pressed(action_id action) {
+  return action < MAX_INPUT_ACTIONS &&
+         (((state.down & ~state.previous) >> action) & 1);
+}
+
+bool input_action_released(action_id action) {
+  return action < MAX_INPUT_ACTIONS &&
+         (((~state.down & state.previous) >> action) & 1);
+}
+
+u64 input_actions_down_mask() { return state.down; }
+
+u64 input_actions_changed_mask() { return state.down ^ state.previous; }
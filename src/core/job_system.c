@@ -0,0 +1,618 @@
+#include "core/job_system.h"
+
+#include "core/kmemory.h"
+#include "core/logger.h"
+#include "core/profiler.h"
+#include "platform/platform.h"
+
+#include <stdio.h>
+
+#define JOB_QUEUE_MASK (JOB_QUEUE_CAPACITY - 1)
+
+// Slots kept for threads other than the main thread and the workers that
+// submit jobs, such as a render thread.
+#define JOB_EXTERNAL_THREADS 8
+
+// Rounds of looking for a job before an idle worker goes to sleep, or a
+// waiting thread yields.
+#define JOB_SPIN_COUNT 64
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct job {
+  job_entry entry;
+  void *params;
+  const char *name;
+  job_counter *counter;
+  bool fiber;
+  // Set from submission until a thread takes the job to run it. The slot is
+  // not reused before.
+  katomic u32 pending;
+} job;
+
+/**
+ * Runs fiber jobs, one after the other. Taken from the pool when such a job
+ * starts and returned once it finishes, so its stack is only allocated once.
+ */
+typedef struct job_fiber {
+  platform_fiber fiber;
+  job_entry entry;
+  void *params;
+  const char *name;
+  job_counter *counter;
+  // The fiber of the thread that resumed it last, to switch back to when the
+  // job finishes or waits.
+  platform_fiber *resumer;
+  // What the job waits on while it is parked.
+  job_counter *waiting_on;
+  // Jobs run on the fiber by helping, which wait without parking it since
+  // their caller holds on to the thread it runs on.
+  u32 nesting;
+  // In the free or the waiting list.
+  struct job_fiber *next;
+} job_fiber;
+
+/**
+ * A thread that submits or runs jobs. Its jobs are in a Chase-Lev deque: the
+ * thread pushes and pops at `bottom`, other threads steal at `top`. Since
+ * the deque only holds pending jobs of `jobs`, it never fills up.
+ */
+typedef struct job_thread {
+  alignas(CACHE_LINE_SIZE) katomic i64 top;
+  alignas(CACHE_LINE_SIZE) katomic i64 bottom;
+  katomic(job *) *slots;
+  // Only used by the owning thread from here on.
+  alignas(CACHE_LINE_SIZE) job *jobs;
+  // Jobs ever taken from `jobs`, the next one being at `next_job` modulo its
+  // capacity.
+  u64 next_job;
+  // xorshift state, to pick which thread to steal from first.
+  u32 random;
+  // Written by the owning thread, read by job_system_get_stats.
+  katomic u64 jobs_executed;
+  katomic u64 steals;
+  katomic u64 idle_ns;
+  platform_thread thread;
+  // The thread's own context, which fibers switch back to. Created on its
+  // first fiber job.
+  platform_fiber fiber;
+  char name[16];
+} job_thread;
+
+typedef struct job_system_state {
+  katomic bool running;
+  u32 worker_count;
+  // Slots with deques, the main thread's first, then the workers'.
+  u32 thread_capacity;
+  // Slots handed out to threads.
+  katomic u32 thread_count;
+  // Workers that are about to sleep or asleep on `wake`.
+  katomic u32 sleepers;
+  platform_semaphore wake;
+  // Guards the fiber lists.
+  platform_mutex fiber_lock;
+  job_fiber *fibers;
+  job_fiber *free_fibers;
+  // Parked in job_wait until their counter reaches zero.
+  job_fiber *waiting_fibers;
+  katomic u32 waiting_fiber_count;
+  // As of the last job_system_frame_end.
+  job_system_stats frame_stats;
+  job_thread threads[JOB_MAX_THREADS];
+} job_system_state;
+
+static job_system_state state;
+
+static kthread_local job_thread *current_thread;
+
+// The fiber the calling thread is running, if any.
+static kthread_local job_fiber *current_fiber;
+
+/**
+ * Gives the calling thread a slot on its first call. nullptr if the job
+ * system is not running or has no slot left.
+ *
+ * Thread locals are only read through functions that are not inlined: after
+ * waiting, a fiber job may continue on another thread, and the address of a
+ * thread local looked up before must not be reused.
+ */
+static KNOINLINE job_thread *job_thread_current() {
+  if (!katomic_load(&state.running, acquire)) {
+    return nullptr;
+  }
+  if (current_thread) {
+    return current_thread;
+  }
+
+  u32 index = katomic_load(&state.thread_count, relaxed);
+  do {
+    if (index >= state.thread_capacity) {
+      kwarn_limited(1, "More than %u threads submit jobs, running them inline",
+                    state.thread_capacity);
+      return nullptr;
+    }
+  } while (!katomic_compare_exchange_weak(&state.thread_count, &index,
+                                          index + 1, acq_rel, relaxed));
+  current_thread = &state.threads[index];
+  return current_thread;
+}
+
+static void job_push(job_thread *thread, job *job) {
+  i64 bottom = katomic_load(&thread->bottom, relaxed);
+  katomic_store(&thread->slots[bottom & JOB_QUEUE_MASK], job, relaxed);
+  // Sequentially consistent, paired with job_worker_sleep: either a worker
+  // about to sleep sees the job, or the submitter sees it sleeping.
+  katomic_store(&thread->bottom, bottom + 1, seq_cst);
+}
+
+static job *job_pop(job_thread *thread) {
+  i64 bottom = katomic_load(&thread->bottom, relaxed) - 1;
+  katomic_store(&thread->bottom, bottom, seq_cst);
+  i64 top = katomic_load(&thread->top, seq_cst);
+  if (top > bottom) {
+    katomic_store(&thread->bottom, bottom + 1, relaxed);
+    return nullptr;
+  }
+
+  job *job = katomic_load(&thread->slots[bottom & JOB_QUEUE_MASK], relaxed);
+  if (top == bottom) {
+    // The last job, which a thief may be taking at the same time.
+    if (!katomic_compare_exchange(&thread->top, &top, top + 1, seq_cst,
+                                  relaxed)) {
+      job = nullptr;
+    }
+    katomic_store(&thread->bottom, bottom + 1, relaxed);
+  }
+  return job;
+}
+
+static job *job_steal(job_thread *victim) {
+  i64 top = katomic_load(&victim->top, seq_cst);
+  i64 bottom = katomic_load(&victim->bottom, seq_cst);
+  if (top >= bottom) {
+    return nullptr;
+  }
+
+  job *job = katomic_load(&victim->slots[top & JOB_QUEUE_MASK], relaxed);
+  // Lost to the owner or another thief.
+  if (!katomic_compare_exchange(&victim->top, &top, top + 1, seq_cst,
+                                relaxed)) {
+    return nullptr;
+  }
+  return job;
+}
+
+static KNOINLINE job_fiber *job_fiber_current() { return current_fiber; }
+
+// Whether the calling thread can switch to fibers: from the fiber it is on,
+// or from a fiber of its own to switch back to.
+static bool job_can_resume_fibers(job_thread *thread) {
+  return job_fiber_current() || thread->fiber.internal_data ||
+         platform_fiber_from_thread(&thread->fiber);
+}
+
+static job_fiber *job_fiber_acquire() {
+  platform_mutex_lock(&state.fiber_lock);
+  job_fiber *fiber = state.free_fibers;
+  if (fiber) {
+    state.free_fibers = fiber->next;
+  }
+  platform_mutex_unlock(&state.fiber_lock);
+  return fiber;
+}
+
+static void job_fiber_release(job_fiber *fiber) {
+  platform_mutex_lock(&state.fiber_lock);
+  fiber->next = state.free_fibers;
+  state.free_fibers = fiber;
+  platform_mutex_unlock(&state.fiber_lock);
+}
+
+// Takes a parked fiber whose counter has reached zero off the waiting list.
+static job_fiber *job_fiber_take_ready() {
+  job_fiber *ready = nullptr;
+  platform_mutex_lock(&state.fiber_lock);
+  for (job_fiber **link = &state.waiting_fibers; *link;
+       link = &(*link)->next) {
+    if (katomic_load(&(*link)->waiting_on->value, acquire) == 0) {
+      ready = *link;
+      *link = ready->next;
+      ready->waiting_on = nullptr;
+      katomic_fetch_sub(&state.waiting_fiber_count, 1, relaxed);
+      break;
+    }
+  }
+  platform_mutex_unlock(&state.fiber_lock);
+  return ready;
+}
+
+static bool job_fiber_any_ready() {
+  bool ready = false;
+  platform_mutex_lock(&state.fiber_lock);
+  for (job_fiber *fiber = state.waiting_fibers; fiber && !ready;
+       fiber = fiber->next) {
+    ready = katomic_load(&fiber->waiting_on->value, acquire) == 0;
+  }
+  platform_mutex_unlock(&state.fiber_lock);
+  return ready;
+}
+
+// Counts a job of `counter` as finished. Wakes a worker when that may let a
+// parked fiber go on, which no submission would otherwise.
+static void job_counter_finish(job_counter *counter) {
+  if (katomic_fetch_sub(&counter->value, 1, seq_cst) == 1 &&
+      katomic_load(&state.waiting_fiber_count, seq_cst) > 0 &&
+      katomic_load(&state.sleepers, seq_cst) > 0) {
+    platform_semaphore_post(&state.wake, 1);
+  }
+}
+
+/**
+ * Runs a fiber on the calling thread until its job finishes or waits. A job
+ * that waits is parked, for whichever thread sees its counter reach zero to
+ * resume. Called on a fiber, that fiber is switched back to, which keeps
+ * fiber jobs run while helping off its stack.
+ */
+static void job_fiber_resume(job_thread *thread, job_fiber *fiber) {
+  job_fiber *outer = job_fiber_current();
+  platform_fiber *from = outer ? &outer->fiber : &thread->fiber;
+  fiber->resumer = from;
+  current_fiber = fiber;
+  {
+    KPROFILE_SCOPE(fiber->name);
+    platform_fiber_switch(from, &fiber->fiber);
+  }
+  current_fiber = outer;
+
+  // The fiber has switched away, so its stack is no longer in use.
+  if (fiber->waiting_on) {
+    platform_mutex_lock(&state.fiber_lock);
+    fiber->next = state.waiting_fibers;
+    state.waiting_fibers = fiber;
+    katomic_fetch_add(&state.waiting_fiber_count, 1, seq_cst);
+    // Paired with job_counter_finish: a counter that reached zero before the
+    // fiber was parked woke nobody for it.
+    bool ready = katomic_load(&fiber->waiting_on->value, seq_cst) == 0;
+    platform_mutex_unlock(&state.fiber_lock);
+    if (ready && katomic_load(&state.sleepers, seq_cst) > 0) {
+      platform_semaphore_post(&state.wake, 1);
+    }
+  } else {
+    job_fiber_release(fiber);
+  }
+}
+
+static void job_fiber_main(void *params) {
+  job_fiber *fiber = params;
+  for (;;) {
+    fiber->entry(fiber->params);
+    if (fiber->counter) {
+      job_counter_finish(fiber->counter);
+    }
+    // Maybe not the thread it started on.
+    job_thread *thread = job_thread_current();
+    if (thread) {
+      katomic_store(&thread->jobs_executed,
+                    katomic_load(&thread->jobs_executed, relaxed) + 1,
+                    relaxed);
+    }
+    platform_fiber_switch(&fiber->fiber, fiber->resumer);
+  }
+}
+
+// Starts a fiber job on a fiber from the pool. Returns false if it has to
+// run as a plain job instead.
+static bool job_execute_on_fiber(job_thread *thread, job *job) {
+  if (!job_can_resume_fibers(thread)) {
+    return false;
+  }
+  job_fiber *fiber = job_fiber_acquire();
+  if (!fiber) {
+    kwarn_limited(1, "All %u fibers are in use, running `%s` without one",
+                  JOB_FIBER_COUNT, job->name);
+    return false;
+  }
+
+  fiber->entry = job->entry;
+  fiber->params = job->params;
+  fiber->name = job->name;
+  fiber->counter = job->counter;
+  katomic_store(&job->pending, 0, release);
+  job_fiber_resume(thread, fiber);
+  return true;
+}
+
+static u32 job_random(job_thread *thread) {
+  u32 x = thread->random;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  thread->random = x;
+  return x;
+}
+
+static void job_execute(job_thread *thread, job *job) {
+  if (job->fiber && job_execute_on_fiber(thread, job)) {
+    return;
+  }
+
+  // Opened before the slot can be reused.
+  KPROFILE_SCOPE(job->name);
+  job_entry entry = job->entry;
+  void *params = job->params;
+  job_counter *counter = job->counter;
+  katomic_store(&job->pending, 0, release);
+
+  job_fiber *fiber = job_fiber_current();
+  if (fiber) {
+    fiber->nesting++;
+  }
+  entry(params);
+  if (fiber) {
+    fiber->nesting--;
+  }
+  if (counter) {
+    job_counter_finish(counter);
+  }
+  katomic_store(&thread->jobs_executed,
+                katomic_load(&thread->jobs_executed, relaxed) + 1, relaxed);
+}
+
+// Resumes a fiber job that can go on, or runs a job of the thread's own or
+// one stolen from another thread. Returns false if there was none.
+static bool job_run_one(job_thread *thread) {
+  if (katomic_load(&state.waiting_fiber_count, acquire) > 0 &&
+      job_can_resume_fibers(thread)) {
+    job_fiber *fiber = job_fiber_take_ready();
+    if (fiber) {
+      job_fiber_resume(thread, fiber);
+      return true;
+    }
+  }
+
+  job *job = job_pop(thread);
+  if (!job) {
+    u32 count = katomic_load(&state.thread_count, acquire);
+    u32 start = job_random(thread) % count;
+    for (u32 i = 0; i < count && !job; ++i) {
+      job_thread *victim = &state.threads[(start + i) % count];
+      if (victim != thread) {
+        job = job_steal(victim);
+      }
+    }
+    if (!job) {
+      return false;
+    }
+    katomic_store(&thread->steals, katomic_load(&thread->steals, relaxed) + 1,
+                  relaxed);
+  }
+  job_execute(thread, job);
+  return true;
+}
+
+static bool job_available() {
+  u32 count = katomic_load(&state.thread_count, acquire);
+  for (u32 i = 0; i < count; ++i) {
+    job_thread *thread = &state.threads[i];
+    if (katomic_load(&thread->bottom, seq_cst) >
+        katomic_load(&thread->top, seq_cst)) {
+      return true;
+    }
+  }
+  return katomic_load(&state.waiting_fiber_count, seq_cst) > 0 &&
+         job_fiber_any_ready();
+}
+
+static void job_worker_sleep(job_thread *thread) {
+  katomic_fetch_add(&state.sleepers, 1, seq_cst);
+  if (!job_available()) {
+    KPROFILE_SCOPE("job_idle");
+    u64 start_ns = platform_get_absolute_time_ns();
+    platform_semaphore_wait(&state.wake);
+    katomic_store(&thread->idle_ns,
+                  katomic_load(&thread->idle_ns, relaxed) +
+                      (platform_get_absolute_time_ns() - start_ns),
+                  relaxed);
+  }
+  katomic_fetch_sub(&state.sleepers, 1, relaxed);
+}
+
+static void job_worker_main(void *params) {
+  job_thread *thread = params;
+  current_thread = thread;
+  KPROFILE_THREAD_NAME(thread->name);
+
+  while (katomic_load(&state.running, acquire)) {
+    bool found = false;
+    for (u32 i = 0; i < JOB_SPIN_COUNT && !found; ++i) {
+      found = job_run_one(thread);
+      if (!found) {
+        kcpu_relax();
+      }
+    }
+    if (!found) {
+      job_worker_sleep(thread);
+    }
+  }
+  // What was submitted before the job system stopped.
+  while (job_run_one(thread)) {
+  }
+  current_thread = nullptr;
+}
+
+bool job_system_initialize(u32 worker_count) {
+  if (worker_count == 0) {
+    u32 cores = platform_get_physical_core_count();
+    worker_count = cores > 1 ? cores - 1 : 0;
+  }
+  u32 max_workers = JOB_MAX_THREADS - 1 - JOB_EXTERNAL_THREADS;
+  if (worker_count > max_workers) {
+    worker_count = max_workers;
+  }
+
+  state.worker_count = worker_count;
+  state.thread_capacity = 1 + worker_count + JOB_EXTERNAL_THREADS;
+  for (u32 i = 0; i < state.thread_capacity; ++i) {
+    job_thread *thread = &state.threads[i];
+    thread->slots =
+        kallocate(sizeof(*thread->slots) * JOB_QUEUE_CAPACITY, MEMORY_TAG_JOB);
+    thread->jobs =
+        kallocate(sizeof(*thread->jobs) * JOB_QUEUE_CAPACITY, MEMORY_TAG_JOB);
+    // Any odd seed, different per thread.
+    thread->random = (i + 1) * 2654435761U | 1;
+  }
+
+  state.fibers = kallocate(sizeof(job_fiber) * JOB_FIBER_COUNT, MEMORY_TAG_JOB);
+  for (u32 i = 0; i < JOB_FIBER_COUNT; ++i) {
+    job_fiber *fiber = &state.fibers[i];
+    if (!platform_fiber_create(JOB_FIBER_STACK_SIZE, job_fiber_main, fiber,
+                               &fiber->fiber)) {
+      kwarn("Could only create %u of %u fibers", i, JOB_FIBER_COUNT);
+      break;
+    }
+    fiber->next = state.free_fibers;
+    state.free_fibers = fiber;
+  }
+  platform_semaphore_create(0, &state.wake);
+  katomic_store(&state.thread_count, 1 + worker_count, release);
+  katomic_store(&state.running, true, release);
+  current_thread = &state.threads[0];
+
+  for (u32 i = 1; i <= worker_count; ++i) {
+    job_thread *thread = &state.threads[i];
+    snprintf(thread->name, sizeof(thread->name), "job_worker_%u", i - 1);
+    // A missing worker's jobs are stolen by the others.
+    if (!platform_thread_create(job_worker_main, thread, &thread->thread)) {
+      kerror("Failed to start %s", thread->name);
+    }
+  }
+  kinfo("Job system started with %u workers", worker_count);
+  return true;
+}
+
+void job_system_shutdown() {
+  if (!katomic_exchange(&state.running, false, seq_cst)) {
+    return;
+  }
+  platform_semaphore_post(&state.wake, state.worker_count);
+  for (u32 i = 1; i <= state.worker_count; ++i) {
+    platform_thread_join(&state.threads[i].thread);
+  }
+  // What no worker took before they stopped, or all of it without workers.
+  while (job_run_one(&state.threads[0])) {
+  }
+  u32 waiting = katomic_load(&state.waiting_fiber_count, relaxed);
+  if (waiting > 0) {
+    kwarn("%u fiber jobs still wait on counters that never reached zero",
+          waiting);
+  }
+
+  for (u32 i = 0; i < JOB_FIBER_COUNT; ++i) {
+    platform_fiber_destroy(&state.fibers[i].fiber);
+  }
+  kfree(state.fibers);
+  for (u32 i = 0; i < state.thread_capacity; ++i) {
+    job_thread *thread = &state.threads[i];
+    platform_fiber_destroy(&thread->fiber);
+    kfree(thread->slots);
+    kfree(thread->jobs);
+  }
+  platform_zero_memory(&state, sizeof(state));
+  current_thread = nullptr;
+}
+
+void job_run(const job_desc *jobs, u32 count, job_counter *counter) {
+  if (counter) {
+    katomic_fetch_add(&counter->value, count, relaxed);
+  }
+
+  job_thread *thread = job_thread_current();
+  if (!thread) {
+    for (u32 i = 0; i < count; ++i) {
+      jobs[i].entry(jobs[i].params);
+      if (counter) {
+        katomic_fetch_sub(&counter->value, 1, release);
+      }
+    }
+    return;
+  }
+
+  for (u32 i = 0; i < count; ++i) {
+    // Taken before helping, so that jobs run meanwhile and submitting jobs
+    // of their own take the following slots.
+    job *job = &thread->jobs[thread->next_job++ & JOB_QUEUE_MASK];
+    while (katomic_load(&job->pending, acquire)) {
+      if (!job_run_one(thread)) {
+        kcpu_relax();
+      }
+    }
+    job->entry = jobs[i].entry;
+    job->params = jobs[i].params;
+    job->name = jobs[i].name ? jobs[i].name : "job";
+    job->counter = counter;
+    job->fiber = jobs[i].fiber;
+    katomic_store(&job->pending, 1, relaxed);
+    job_push(thread, job);
+  }
+
+  u32 sleepers = katomic_load(&state.sleepers, seq_cst);
+  if (sleepers > 0) {
+    platform_semaphore_post(&state.wake, count < sleepers ? count : sleepers);
+  }
+}
+
+// Waits by running other jobs on the calling thread.
+static void job_wait_helping(job_counter *counter) {
+  KPROFILE_SCOPE("job_wait");
+  job_thread *thread = job_thread_current();
+  u32 spins = 0;
+  while (katomic_load(&counter->value, acquire) != 0) {
+    if (thread && job_run_one(thread)) {
+      spins = 0;
+    } else if (++spins < JOB_SPIN_COUNT) {
+      kcpu_relax();
+    } else {
+      // The remaining jobs are running on other threads.
+      platform_thread_yield();
+    }
+  }
+}
+
+void job_wait(job_counter *counter) {
+  job_fiber *fiber = job_fiber_current();
+  if (!fiber || fiber->nesting > 0) {
+    job_wait_helping(counter);
+    return;
+  }
+
+  if (katomic_load(&counter->value, acquire) != 0) {
+    fiber->waiting_on = counter;
+    platform_fiber_switch(&fiber->fiber, fiber->resumer);
+    // Resumed once the counter reached zero, maybe on another thread.
+  }
+}
+
+u32 job_system_worker_count() { return state.worker_count; }
+
+void job_system_get_stats(job_system_stats *out_stats) {
+  *out_stats = (job_system_stats){.worker_count = state.worker_count};
+  u32 count = katomic_load(&state.thread_count, acquire);
+  for (u32 i = 0; i < count; ++i) {
+    job_thread *thread = &state.threads[i];
+    out_stats->jobs_executed += katomic_load(&thread->jobs_executed, relaxed);
+    out_stats->steals += katomic_load(&thread->steals, relaxed);
+    out_stats->idle_ns += katomic_load(&thread->idle_ns, relaxed);
+  }
+}
+
+void job_system_frame_end() {
+#if defined(KPROFILE_ENABLED)
+  job_system_stats stats;
+  job_system_get_stats(&stats);
+  KPROFILE_PLOT("jobs", stats.jobs_executed - state.frame_stats.jobs_executed);
+  KPROFILE_PLOT("job_steals", stats.steals - state.frame_stats.steals);
+  KPROFILE_PLOT("job_idle_us",
+                (stats.idle_ns - state.frame_stats.idle_ns) / 1000);
+  state.frame_stats = stats;
+#endif
+}
@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_MEMORY
+
 #include "core/kmemory.h"
 
 #include "core/asserts.h"
@@ -6,16 +8,17 @@
 #include <stdio.h>
 #include <string.h>
 
+// Updated from any thread that allocates, such as the render thread.
 struct memory_stats {
-  u64 total_allocated;
-  u64 tagged_allocations[MEMORY_TAG_MAX_TAGS];
+  katomic u64 total_allocated;
+  katomic u64 tagged_allocations[MEMORY_TAG_MAX_TAGS];
 };
 
 static const char *memory_tag_strings[MEMORY_TAG_MAX_TAGS] = {
     "UNKNOWN    ", "ARRAY      ", "DARRAY     ", "DICT       ", "RING_QUEUE ",
-    "BST        ", "STRING     ", "APPLICATION", "JOB        ", "TEXTURE    ",
-    "MAT_INST   ", "RENDERER   ", "GAME       ", "TRANSFORM  ", "ENTITY     ",
-    "ENTITY_NODE", "SCENE      ",
+    "BST        ", "STRING     ", "LINEAR_ALLC", "APPLICATION", "JOB        ",
+    "TEXTURE    ", "MAT_INST   ", "RENDERER   ", "GAME       ", "TRANSFORM  ",
+    "ENTITY     ", "ENTITY_NODE", "SCENE      ",
 };
 
 static struct memory_stats stats;
@@ -36,7 +39,12 @@ void memory_field_set(void *memory, u64 field, u64 val) {
   header[field] = val;
 }
 
-void initialize_memory() { platform_zero_memory(&stats, sizeof(stats)); }
+void initialize_memory() {
+  katomic_store(&stats.total_allocated, 0, relaxed);
+  for (u32 i = 0; i < MEMORY_TAG_MAX_TAGS; ++i) {
+    katomic_store(&stats.tagged_allocations[i], 0, relaxed);
+  }
+}
 
 void shutdown_memory() {}
 
@@ -45,8 +53,8 @@ void *kallocate(u64 size, memory_tag tag) {
     kwarn(
         "kallocate called using MEMORY_TAG_UNKNOWN. Re-class this allocation.");
   }
-  stats.total_allocated += size;
-  stats.tagged_allocations[tag] += size;
+  katomic_fetch_add(&stats.total_allocated, size, relaxed);
+  katomic_fetch_add(&stats.tagged_allocations[tag], size, relaxed);
 
   // TODO: Memory alignment
   void *block =
@@ -65,8 +73,8 @@ void kfree(void *block) {
     kwarn("kfree called using MEMORY_TAG_UNKNOWN. Re-class this allocation.");
   }
   u64 size = memory_field_get(block, MEMORY_FIELD_SIZE);
-  stats.total_allocated -= size;
-  stats.tagged_allocations[tag] -= size;
+  katomic_fetch_sub(&stats.total_allocated, size, relaxed);
+  katomic_fetch_sub(&stats.tagged_allocations[tag], size, relaxed);
   // TODO: Memory alignment
   platform_free((u64 *)block - MEMORY_FIELD_LENGTH, false);
 }
@@ -96,19 +104,20 @@ void print_memory_usage_str() {
     char unit[4] = "XiB";
     f32 amount = 1.0F;
 
-    if (stats.tagged_allocations[i] >= gib) {
+    u64 allocated = katomic_load(&stats.tagged_allocations[i], relaxed);
+    if (allocated >= gib) {
       unit[0] = 'G';
-      amount = (f32)stats.tagged_allocations[i] / (f32)gib;
-    } else if (stats.tagged_allocations[i] >= mib) {
+      amount = (f32)allocated / (f32)gib;
+    } else if (allocated >= mib) {
       unit[0] = 'M';
-      amount = (f32)stats.tagged_allocations[i] / (f32)mib;
-    } else if (stats.tagged_allocations[i] >= kib) {
+      amount = (f32)allocated / (f32)mib;
+    } else if (allocated >= kib) {
       unit[0] = 'K';
-      amount = (f32)stats.tagged_allocations[i] / (f32)kib;
+      amount = (f32)allocated / (f32)kib;
     } else {
       unit[0] = 'B';
       unit[1] = '\0';
-      amount = (f32)stats.tagged_allocations[i];
+      amount = (f32)allocated;
     }
 
     i32 length =
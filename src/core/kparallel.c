@@ -0,0 +1,127 @@
+#include "core/kparallel.h"
+
+#include "core/job_system.h"
+#include "core/kmemory.h"
+#include "core/profiler.h"
+#include "platform/platform.h"
+
+#include <stdint.h>
+
+#define CACHE_LINE_SIZE 64
+
+typedef struct kparallel_chunk {
+  u64 start;
+  u64 end;
+  void *context;
+  union {
+    kparallel_for_fn for_fn;
+    kparallel_reduce_fn reduce_fn;
+  };
+  // Reductions only.
+  void *partial;
+} kparallel_chunk;
+
+static void kparallel_for_job(void *params) {
+  kparallel_chunk *chunk = params;
+  chunk->for_fn(chunk->start, chunk->end, chunk->context);
+}
+
+static void kparallel_reduce_job(void *params) {
+  kparallel_chunk *chunk = params;
+  chunk->reduce_fn(chunk->start, chunk->end, chunk->context, chunk->partial);
+}
+
+// Elements per chunk, a multiple of KPARALLEL_ALIGN_ELEMENTS.
+static u64 kparallel_chunk_size(u64 count, u64 grain) {
+  if (grain == 0) {
+    u64 threads = job_system_worker_count() + 1;
+    grain = count / (threads * KPARALLEL_CHUNKS_PER_THREAD);
+  }
+  u64 fewest = (count + KPARALLEL_MAX_CHUNKS - 1) / KPARALLEL_MAX_CHUNKS;
+  if (grain < fewest) {
+    grain = fewest;
+  }
+  if (grain < KPARALLEL_ALIGN_ELEMENTS) {
+    return KPARALLEL_ALIGN_ELEMENTS;
+  }
+  return (grain + KPARALLEL_ALIGN_ELEMENTS - 1) / KPARALLEL_ALIGN_ELEMENTS *
+         KPARALLEL_ALIGN_ELEMENTS;
+}
+
+// Splits `[0, count)` into `chunks` and runs them as jobs until all are done.
+static void kparallel_run(kparallel_chunk *chunks, u32 chunk_count,
+                          u64 chunk_size, u64 count, job_entry entry,
+                          const char *name) {
+  job_desc jobs[KPARALLEL_MAX_CHUNKS];
+  for (u32 i = 0; i < chunk_count; ++i) {
+    chunks[i].start = i * chunk_size;
+    chunks[i].end = chunks[i].start + chunk_size < count
+                        ? chunks[i].start + chunk_size
+                        : count;
+    jobs[i] = (job_desc){.entry = entry, .params = &chunks[i], .name = name};
+  }
+  job_counter counter = {};
+  job_run(jobs, chunk_count, &counter);
+  job_wait(&counter);
+}
+
+void kparallel_for(u64 count, u64 grain, kparallel_for_fn fn,
+                   void *context) {
+  u64 chunk_size = kparallel_chunk_size(count, grain);
+  u32 chunk_count = (u32)((count + chunk_size - 1) / chunk_size);
+  if (chunk_count <= 1) {
+    if (count > 0) {
+      fn(0, count, context);
+    }
+    return;
+  }
+
+  kparallel_chunk chunks[KPARALLEL_MAX_CHUNKS];
+  for (u32 i = 0; i < chunk_count; ++i) {
+    chunks[i] = (kparallel_chunk){.context = context, .for_fn = fn};
+  }
+  kparallel_run(chunks, chunk_count, chunk_size, count, kparallel_for_job,
+                "kparallel_for");
+}
+
+void kparallel_reduce(u64 count, u64 grain, kparallel_reduce_fn reduce,
+                      kparallel_combine_fn combine, void *context,
+                      void *result, u64 result_size) {
+  u64 chunk_size = kparallel_chunk_size(count, grain);
+  u32 chunk_count = (u32)((count + chunk_size - 1) / chunk_size);
+  if (chunk_count <= 1) {
+    if (count > 0) {
+      reduce(0, count, context, result);
+    }
+    return;
+  }
+
+  // The first chunk folds into `result` itself. The others get partials
+  // starting on their own cache lines, so they do not share any.
+  u64 stride =
+      (result_size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  u8 *block = kallocate(stride * (chunk_count - 1) + CACHE_LINE_SIZE - 1,
+                        MEMORY_TAG_JOB);
+  u8 *partials = (u8 *)(((uintptr_t)block + CACHE_LINE_SIZE - 1) &
+                        ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+  kparallel_chunk chunks[KPARALLEL_MAX_CHUNKS];
+  for (u32 i = 0; i < chunk_count; ++i) {
+    void *partial = result;
+    if (i > 0) {
+      partial = partials + stride * (i - 1);
+      platform_copy_memory(partial, result, result_size);
+    }
+    chunks[i] = (kparallel_chunk){
+        .context = context, .reduce_fn = reduce, .partial = partial};
+  }
+  kparallel_run(chunks, chunk_count, chunk_size, count, kparallel_reduce_job,
+                "kparallel_reduce");
+
+  {
+    KPROFILE_SCOPE("kparallel_combine");
+    for (u32 i = 1; i < chunk_count; ++i) {
+      combine(result, chunks[i].partial, context);
+    }
+  }
+  kfree(block);
+}
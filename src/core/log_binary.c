@@ -0,0 +1,493 @@
+#include "core/log_binary.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_BINARY_MAGIC 0x474C4B4FU // "OKLG"
+#define LOG_BINARY_VERSION 1
+
+typedef enum log_record_kind : u8 {
+  LOG_RECORD_FORMAT = 1,
+  LOG_RECORD_MESSAGE = 2,
+} log_record_kind;
+
+typedef struct log_binary_header {
+  u32 magic;
+  u16 version;
+  u16 reserved;
+} log_binary_header;
+
+// Followed by `length` bytes of format string, without a terminator.
+typedef struct log_format_record {
+  u32 format_id;
+  u16 length;
+} log_format_record;
+
+// Followed by `args_size` bytes of captured arguments.
+typedef struct log_message_record {
+  f64 timestamp;
+  u32 format_id;
+  u32 thread_index;
+  u16 args_size;
+  u8 level;
+} log_message_record;
+
+/**
+ * A conversion specification, split into the parts needed to format it
+ * again from a captured value.
+ */
+typedef struct log_spec {
+  // Flags, width and precision, with any `*` still in place.
+  const char *options;
+  u32 options_length;
+  // Length modifier as written, e.g. "ll".
+  const char *length;
+  u32 length_length;
+  char conversion;
+  u8 star_count;
+  // Points past the specification.
+  const char *end;
+} log_spec;
+
+static bool log_parse_spec(const char *c, log_spec *out_spec) {
+  out_spec->options = c;
+  out_spec->star_count = 0;
+  while (*c && strchr("-+ #0", *c)) {
+    ++c;
+  }
+  if (*c == '*') {
+    out_spec->star_count++;
+    ++c;
+  } else {
+    while (*c >= '0' && *c <= '9') {
+      ++c;
+    }
+  }
+  if (*c == '.') {
+    ++c;
+    if (*c == '*') {
+      out_spec->star_count++;
+      ++c;
+    } else {
+      while (*c >= '0' && *c <= '9') {
+        ++c;
+      }
+    }
+  }
+  out_spec->options_length = (u32)(c - out_spec->options);
+
+  out_spec->length = c;
+  while (*c && strchr("hlLjzt", *c)) {
+    ++c;
+  }
+  out_spec->length_length = (u32)(c - out_spec->length);
+
+  if (!*c) {
+    return false;
+  }
+  out_spec->conversion = *c;
+  out_spec->end = c + 1;
+  return true;
+}
+
+static bool log_has_length(const log_spec *spec, const char *length) {
+  return spec->length_length == strlen(length) &&
+         strncmp(spec->length, length, spec->length_length) == 0;
+}
+
+static bool log_push(u8 *out, u32 *size, u32 capacity, log_arg_type type,
+                     const void *value, u32 value_size) {
+  if (*size + 1 + value_size > capacity) {
+    return false;
+  }
+  out[(*size)++] = type;
+  memcpy(out + *size, value, value_size);
+  *size += value_size;
+  return true;
+}
+
+static bool log_push_string(u8 *out, u32 *size, u32 capacity,
+                            const char *string) {
+  if (!string) {
+    string = "(null)";
+  }
+  u16 length = (u16)strnlen(string, LOG_BINARY_MAX_STRING);
+  if (*size + 1 + sizeof(u16) + length + 1 > capacity) {
+    return false;
+  }
+  out[(*size)++] = LOG_ARG_STRING;
+  memcpy(out + *size, &length, sizeof(u16));
+  *size += sizeof(u16);
+  memcpy(out + *size, string, length);
+  *size += length;
+  out[(*size)++] = '\0';
+  return true;
+}
+
+u32 log_binary_capture_args(const char *format, va_list args, u8 *out,
+                            u32 capacity) {
+  u32 size = 0;
+  bool room = true;
+  for (const char *c = format; *c && room; ++c) {
+    if (*c != '%') {
+      continue;
+    }
+    if (c[1] == '%') {
+      ++c;
+      continue;
+    }
+
+    log_spec spec;
+    if (!log_parse_spec(c + 1, &spec)) {
+      break;
+    }
+    c = spec.end - 1;
+
+    for (u8 i = 0; i < spec.star_count && room; ++i) {
+      i32 value = va_arg(args, i32);
+      room = log_push(out, &size, capacity, LOG_ARG_I32, &value, sizeof(i32));
+    }
+    if (!room) {
+      break;
+    }
+
+    switch (spec.conversion) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c':
+      if (log_has_length(&spec, "ll") || log_has_length(&spec, "j")) {
+        i64 value = va_arg(args, i64);
+        room = log_push(out, &size, capacity, LOG_ARG_I64, &value, 8);
+      } else if (log_has_length(&spec, "l")) {
+        i64 value = va_arg(args, long);
+        room = log_push(out, &size, capacity, LOG_ARG_I64, &value, 8);
+      } else if (log_has_length(&spec, "z") || log_has_length(&spec, "t")) {
+        i64 value = (i64)va_arg(args, size_t);
+        room = log_push(out, &size, capacity, LOG_ARG_I64, &value, 8);
+      } else {
+        i32 value = va_arg(args, i32);
+        room = log_push(out, &size, capacity, LOG_ARG_I32, &value, 4);
+      }
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A': {
+      f64 value = log_has_length(&spec, "L") ? (f64)va_arg(args, long double)
+                                             : va_arg(args, f64);
+      room = log_push(out, &size, capacity, LOG_ARG_F64, &value, 8);
+    } break;
+    case 's':
+      room = log_push_string(out, &size, capacity, va_arg(args, const char *));
+      break;
+    case 'p': {
+      u64 value = (u64)(uintptr_t)va_arg(args, void *);
+      room = log_push(out, &size, capacity, LOG_ARG_POINTER, &value, 8);
+    } break;
+    case 'n':
+      (void)va_arg(args, void *);
+      break;
+    default:
+      return size;
+    }
+  }
+  return size;
+}
+
+/**
+ * Reads the next captured value, checking that it has the expected type.
+ * @returns A pointer to the value, or nullptr if there is none.
+ */
+static const u8 *log_next_arg(const u8 *args, u32 args_size, u32 *offset,
+                              log_arg_type type) {
+  if (*offset >= args_size || args[*offset] != type) {
+    *offset = args_size;
+    return nullptr;
+  }
+  const u8 *value = args + *offset + 1;
+  u32 value_size = 8;
+  if (type == LOG_ARG_I32) {
+    value_size = 4;
+  } else if (type == LOG_ARG_STRING) {
+    u16 length;
+    memcpy(&length, value, sizeof(u16));
+    value_size = sizeof(u16) + length + 1;
+  }
+  *offset += 1 + value_size;
+  return value;
+}
+
+static u32 log_append(char *out, u32 capacity, u32 written, const char *text,
+                      u32 length) {
+  if (written + 1 >= capacity) {
+    return written;
+  }
+  if (length > capacity - 1 - written) {
+    length = capacity - 1 - written;
+  }
+  memcpy(out + written, text, length);
+  out[written + length] = '\0';
+  return written + length;
+}
+
+u32 log_binary_format(const char *format, const u8 *args, u32 args_size,
+                      char *out, u32 capacity) {
+  if (capacity == 0) {
+    return 0;
+  }
+  out[0] = '\0';
+
+  u32 written = 0;
+  u32 offset = 0;
+  const char *c = format;
+  while (*c) {
+    const char *literal = c;
+    while (*c && *c != '%') {
+      ++c;
+    }
+    written = log_append(out, capacity, written, literal, (u32)(c - literal));
+    if (!*c) {
+      break;
+    }
+    if (c[1] == '%') {
+      written = log_append(out, capacity, written, "%", 1);
+      c += 2;
+      continue;
+    }
+
+    log_spec spec;
+    if (!log_parse_spec(c + 1, &spec)) {
+      break;
+    }
+    c = spec.end;
+    if (spec.conversion == 'n') {
+      continue;
+    }
+
+    // Rebuild the specification with `*` replaced by the captured values
+    // and the length modifier matching the captured type.
+    char rebuilt[64];
+    u32 length = 0;
+    rebuilt[length++] = '%';
+    for (u32 i = 0; i < spec.options_length && length < 40; ++i) {
+      if (spec.options[i] != '*') {
+        rebuilt[length++] = spec.options[i];
+        continue;
+      }
+      const u8 *value = log_next_arg(args, args_size, &offset, LOG_ARG_I32);
+      i32 star = 0;
+      if (value) {
+        memcpy(&star, value, sizeof(i32));
+      }
+      length += (u32)snprintf(rebuilt + length, sizeof(rebuilt) - length, "%d",
+                              star);
+    }
+
+    char *remaining = out + written;
+    u32 remaining_capacity = capacity - written;
+    i32 result = -1;
+    switch (spec.conversion) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c': {
+      bool wide = offset < args_size && args[offset] == LOG_ARG_I64;
+      const u8 *value = log_next_arg(args, args_size, &offset,
+                                     wide ? LOG_ARG_I64 : LOG_ARG_I32);
+      if (!value) {
+        break;
+      }
+      if (wide) {
+        i64 number;
+        memcpy(&number, value, sizeof(i64));
+        snprintf(rebuilt + length, sizeof(rebuilt) - length, "ll%c",
+                 spec.conversion);
+        result = snprintf(remaining, remaining_capacity, rebuilt, number);
+      } else {
+        i32 number;
+        memcpy(&number, value, sizeof(i32));
+        snprintf(rebuilt + length, sizeof(rebuilt) - length, "%.*s%c",
+                 log_has_length(&spec, "h") || log_has_length(&spec, "hh")
+                     ? (i32)spec.length_length
+                     : 0,
+                 spec.length, spec.conversion);
+        result = snprintf(remaining, remaining_capacity, rebuilt, number);
+      }
+    } break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A': {
+      const u8 *value = log_next_arg(args, args_size, &offset, LOG_ARG_F64);
+      if (!value) {
+        break;
+      }
+      f64 number;
+      memcpy(&number, value, sizeof(f64));
+      snprintf(rebuilt + length, sizeof(rebuilt) - length, "%c",
+               spec.conversion);
+      result = snprintf(remaining, remaining_capacity, rebuilt, number);
+    } break;
+    case 's': {
+      const u8 *value = log_next_arg(args, args_size, &offset, LOG_ARG_STRING);
+      if (!value) {
+        break;
+      }
+      snprintf(rebuilt + length, sizeof(rebuilt) - length, "s");
+      result = snprintf(remaining, remaining_capacity, rebuilt,
+                        (const char *)value + sizeof(u16));
+    } break;
+    case 'p': {
+      const u8 *value = log_next_arg(args, args_size, &offset, LOG_ARG_POINTER);
+      if (!value) {
+        break;
+      }
+      u64 pointer;
+      memcpy(&pointer, value, sizeof(u64));
+      snprintf(rebuilt + length, sizeof(rebuilt) - length, "p");
+      result = snprintf(remaining, remaining_capacity, rebuilt,
+                        (void *)(uintptr_t)pointer);
+    } break;
+    default:
+      break;
+    }
+
+    if (result < 0) {
+      written = log_append(out, capacity, written, "<?>", 3);
+    } else {
+      written += (u32)result < remaining_capacity ? (u32)result
+                                                  : remaining_capacity - 1;
+    }
+  }
+  return written;
+}
+
+void log_binary_write_header(FILE *file) {
+  log_binary_header header = {
+      .magic = LOG_BINARY_MAGIC,
+      .version = LOG_BINARY_VERSION,
+  };
+  fwrite(&header, sizeof(header), 1, file);
+}
+
+void log_binary_write_format(FILE *file, u32 format_id, const char *format) {
+  u8 kind = LOG_RECORD_FORMAT;
+  log_format_record record = {
+      .format_id = format_id,
+      .length = (u16)strnlen(format, UINT16_MAX),
+  };
+  fwrite(&kind, sizeof(kind), 1, file);
+  fwrite(&record, sizeof(record), 1, file);
+  fwrite(format, 1, record.length, file);
+}
+
+void log_binary_write_message(FILE *file, log_level level, u32 format_id,
+                              f64 timestamp, u32 thread_index, const u8 *args,
+                              u32 args_size) {
+  u8 kind = LOG_RECORD_MESSAGE;
+  log_message_record record = {
+      .timestamp = timestamp,
+      .format_id = format_id,
+      .thread_index = thread_index,
+      .args_size = (u16)args_size,
+      .level = level,
+  };
+  fwrite(&kind, sizeof(kind), 1, file);
+  fwrite(&record, sizeof(record), 1, file);
+  fwrite(args, 1, args_size, file);
+}
+
+bool log_binary_decode(FILE *in, FILE *out) {
+  log_binary_header header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      header.magic != LOG_BINARY_MAGIC ||
+      header.version != LOG_BINARY_VERSION) {
+    return false;
+  }
+
+  // Format strings by id, in the order the file defines them.
+  char **formats = nullptr;
+  u32 format_capacity = 0;
+  bool ok = true;
+
+  u8 kind;
+  while (fread(&kind, sizeof(kind), 1, in) == 1) {
+    if (kind == LOG_RECORD_FORMAT) {
+      log_format_record record;
+      if (fread(&record, sizeof(record), 1, in) != 1) {
+        ok = false;
+        break;
+      }
+      if (record.format_id >= format_capacity) {
+        u32 new_capacity = format_capacity ? format_capacity * 2 : 64;
+        while (new_capacity <= record.format_id) {
+          new_capacity *= 2;
+        }
+        char **grown = realloc(formats, new_capacity * sizeof(char *));
+        if (!grown) {
+          ok = false;
+          break;
+        }
+        memset(grown + format_capacity, 0,
+               (new_capacity - format_capacity) * sizeof(char *));
+        formats = grown;
+        format_capacity = new_capacity;
+      }
+      char *format = malloc(record.length + 1);
+      if (!format || fread(format, 1, record.length, in) != record.length) {
+        free(format);
+        ok = false;
+        break;
+      }
+      format[record.length] = '\0';
+      free(formats[record.format_id]);
+      formats[record.format_id] = format;
+    } else if (kind == LOG_RECORD_MESSAGE) {
+      log_message_record record;
+      u8 args[UINT16_MAX];
+      if (fread(&record, sizeof(record), 1, in) != 1 ||
+          fread(args, 1, record.args_size, in) != record.args_size) {
+        ok = false;
+        break;
+      }
+      const char *format = record.format_id < format_capacity
+                               ? formats[record.format_id]
+                               : nullptr;
+      char message[2048];
+      if (format) {
+        log_binary_format(format, args, record.args_size, message,
+                          sizeof(message));
+      } else {
+        snprintf(message, sizeof(message), "<unknown format %u>",
+                 record.format_id);
+      }
+      fprintf(out, "%.6f [%u] %s%s\n", record.timestamp, record.thread_index,
+              log_level_prefix((log_level)record.level), message);
+    } else {
+      ok = false;
+      break;
+    }
+  }
+
+  for (u32 i = 0; i < format_capacity; ++i) {
+    free(formats[i]);
+  }
+  free(formats);
+  return ok;
+}
@@ -1,8 +1,13 @@
 #include "core/logger.h"
 #include "core/asserts.h"
+#include "core/log_binary.h"
+#include "platform/platform.h"
 
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 static const char *colors[] = {
     "\x1b[1;38;2;0;0;0;41m", "\x1b[4;31m", "\x1b[33m", "\x1b[34m", "\x1b[32m",
@@ -13,27 +18,738 @@ static const char *level_strings[] = {
 
 static const char *reset = "\x1b[0m";
 
+static const char *level_names[] = {"fatal", "error", "warn",
+                                    "info",  "debug", "trace"};
+
+static const char *category_names[LOG_CATEGORY_MAX] = {
+    [LOG_CATEGORY_CORE] = "core",         [LOG_CATEGORY_MEMORY] = "memory",
+    [LOG_CATEGORY_EVENT] = "event",       [LOG_CATEGORY_INPUT] = "input",
+    [LOG_CATEGORY_PLATFORM] = "platform", [LOG_CATEGORY_RENDERER] = "renderer",
+    [LOG_CATEGORY_VULKAN] = "vulkan",     [LOG_CATEGORY_GAME] = "game",
+};
+
+// Everything the build has compiled in is logged until told otherwise.
+u8 log_category_levels[LOG_CATEGORY_MAX] = {
+    [LOG_CATEGORY_CORE] = LOG_LEVEL_TRACE,
+    [LOG_CATEGORY_MEMORY] = LOG_LEVEL_TRACE,
+    [LOG_CATEGORY_EVENT] = LOG_LEVEL_TRACE,
+    [LOG_CATEGORY_INPUT] = LOG_LEVEL_TRACE,
+    [LOG_CATEGORY_PLATFORM] = LOG_LEVEL_TRACE,
+    [LOG_CATEGORY_RENDERER] = LOG_LEVEL_TRACE,
+    [LOG_CATEGORY_VULKAN] = LOG_LEVEL_TRACE,
+    [LOG_CATEGORY_GAME] = LOG_LEVEL_TRACE,
+};
+
+#define BUFFER_SIZE 1600
+
+// Must be a power of two.
+#define LOG_QUEUE_CAPACITY 512
+#define LOG_QUEUE_MASK (LOG_QUEUE_CAPACITY - 1)
+
+#define LOG_FILE_PATH "console.log"
+#define LOG_BINARY_FILE_PATH "console.klog"
+#define LOG_FILE_BUFFER_SIZE (64ULL * 1024)
+
+// Size of each thread's deferred-format ring. Must be a power of two.
+#define LOG_RING_SIZE (64ULL * 1024)
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+
+// Must be a power of two.
+#define LOG_FORMAT_TABLE_SIZE 4096
+
+// While a message keeps repeating, how often to say so.
+#define LOG_REPEAT_REPORT_SECONDS 1.0
+
+#define LOG_RATE_WINDOW_MS 1000
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * A slot in the log queue. `sequence` equals the slot's write position while
+ * it is free and the write position + 1 once the message in it is complete.
+ */
+typedef struct log_entry {
+  _Atomic u64 sequence;
+  log_level level;
+  char message[BUFFER_SIZE];
+} log_entry;
+
+/**
+ * A deferred-format message in a thread's ring, followed by its captured
+ * arguments and padded to 8 bytes. A `wrap` record only fills the rest of
+ * the ring so that the next record starts at its beginning; only its first
+ * 8 bytes are written.
+ */
+typedef struct log_ring_record {
+  u32 size;
+  u16 args_size;
+  u8 level;
+  u8 wrap;
+  f64 timestamp;
+  const char *format;
+} log_ring_record;
+
+/**
+ * Single-producer, single-consumer byte ring of deferred-format messages
+ * owned by one logging thread. Rings are created on a thread's first message
+ * and kept until shutdown_logging.
+ */
+typedef struct log_ring {
+  alignas(CACHE_LINE_SIZE) _Atomic u64 head;
+  alignas(CACHE_LINE_SIZE) _Atomic u64 tail;
+  // Value of `tail` when the sinks were last flushed.
+  _Atomic u64 flushed;
+  struct log_ring *next;
+  u32 thread_index;
+  alignas(8) u8 data[LOG_RING_SIZE];
+} log_ring;
+
+/**
+ * The last message the writer thread wrote, so that identical ones right
+ * after it can be counted instead of written.
+ */
+typedef struct log_repeat {
+  log_level level;
+  u32 thread_index;
+  u32 count;
+  // When the first repeat not yet reported arrived.
+  f64 since;
+  char message[BUFFER_SIZE];
+} log_repeat;
+
+// Maps format string addresses to the ids used in the binary log file.
+typedef struct log_format_entry {
+  const char *format;
+  u32 id;
+} log_format_entry;
+
+/**
+ * Bounded multi-producer, single-consumer queue of formatted messages,
+ * written out by a background thread.
+ */
+typedef struct logger_state {
+  alignas(CACHE_LINE_SIZE) _Atomic u64 head;
+  // Only touched by the writer thread.
+  alignas(CACHE_LINE_SIZE) u64 tail;
+  // Number of messages written and flushed to every sink so far.
+  alignas(CACHE_LINE_SIZE) _Atomic u64 written;
+  atomic_bool running;
+  platform_thread writer;
+  // Set while the writer thread waits for messages, see log_wake_writer.
+  atomic_bool writer_waiting;
+  platform_semaphore wake;
+  FILE *file;
+  log_entry entries[LOG_QUEUE_CAPACITY];
+
+  // Deferred-format logging, see core/log_binary.h.
+  _Atomic(log_ring *) rings;
+  _Atomic u32 ring_count;
+  FILE *binary_file;
+  log_format_entry formats[LOG_FORMAT_TABLE_SIZE];
+  u32 format_count;
+
+  log_repeat repeat;
+} logger_state;
+
+static logger_state state;
+
+#if defined(KLOG_BINARY_ENABLED)
+static kthread_local log_ring *thread_ring;
+#endif
+
+static u32 category_rate_limits[LOG_CATEGORY_MAX];
+
+static const char *log_repeat_format = "last message repeated %u times";
+
+const char *log_level_prefix(log_level level) { return level_strings[level]; }
+
+static void log_write(log_level level, const char *message) {
+  printf("%s%s%s\n", colors[level], message, reset);
+  if (state.file) {
+    fputs(message, state.file);
+    fputc('\n', state.file);
+  }
+}
+
+static void log_write_flush() {
+  fflush(stdout);
+  if (state.file) {
+    fflush(state.file);
+  }
+}
+
+/**
+ * @returns The id of a format string in the binary log file, writing its
+ * definition first if this is its first use.
+ */
+static u32 log_format_id(const char *format) {
+  u64 hash = ((uintptr_t)format >> 3) * 11400714819323198485ULL;
+  u32 index = (u32)(hash >> 52) & (LOG_FORMAT_TABLE_SIZE - 1);
+  for (u32 probe = 0; probe < LOG_FORMAT_TABLE_SIZE / 4; ++probe) {
+    log_format_entry *entry =
+        &state.formats[(index + probe) & (LOG_FORMAT_TABLE_SIZE - 1)];
+    if (entry->format == format) {
+      return entry->id;
+    }
+    if (!entry->format) {
+      entry->format = format;
+      entry->id = state.format_count++;
+      log_binary_write_format(state.binary_file, entry->id, format);
+      return entry->id;
+    }
+  }
+  // Table crowded: define the format again under a fresh id.
+  u32 id = state.format_count++;
+  log_binary_write_format(state.binary_file, id, format);
+  return id;
+}
+
+/**
+ * Writes out how often the last message was repeated, if it was.
+ */
+static void log_report_repeats() {
+  log_repeat *repeat = &state.repeat;
+  if (repeat->count == 0) {
+    return;
+  }
+
+  char buffer[BUFFER_SIZE];
+  u32 written =
+      snprintf(buffer, BUFFER_SIZE, "%s", level_strings[repeat->level]);
+  snprintf(buffer + written, BUFFER_SIZE - written, log_repeat_format,
+           repeat->count);
+  log_write(repeat->level, buffer);
+
+  if (state.binary_file) {
+    u8 args[1 + sizeof(u32)] = {LOG_ARG_I32};
+    platform_copy_memory(args + 1, &repeat->count, sizeof(u32));
+    log_binary_write_message(state.binary_file, repeat->level,
+                             log_format_id(log_repeat_format),
+                             platform_get_absolute_time(),
+                             repeat->thread_index, args, sizeof(args));
+  }
+  repeat->count = 0;
+}
+
+/**
+ * Counts `message` instead of writing it if it is the same as the last one.
+ * @returns `true` if the message was collapsed into the last one.
+ */
+static bool log_collapse(log_level level, const char *message,
+                         u32 thread_index) {
+  log_repeat *repeat = &state.repeat;
+  if (repeat->level == level && strcmp(repeat->message, message) == 0) {
+    if (repeat->count++ == 0) {
+      repeat->since = platform_get_absolute_time();
+    }
+    return true;
+  }
+
+  log_report_repeats();
+  repeat->level = level;
+  repeat->thread_index = thread_index;
+  snprintf(repeat->message, BUFFER_SIZE, "%s", message);
+  return false;
+}
+
+/**
+ * Writes out the complete messages at the front of the queue, at most one
+ * queue's worth so that producers cannot keep the writer here.
+ * @returns The number of messages written.
+ */
+static u32 log_writer_drain() {
+  u32 count = 0;
+  while (count < LOG_QUEUE_CAPACITY) {
+    log_entry *entry = &state.entries[state.tail & LOG_QUEUE_MASK];
+    u64 sequence = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+    if (sequence != state.tail + 1) {
+      break;
+    }
+
+    if (!log_collapse(entry->level, entry->message, 0)) {
+      log_write(entry->level, entry->message);
+    }
+    atomic_store_explicit(&entry->sequence, state.tail + LOG_QUEUE_CAPACITY,
+                          memory_order_release);
+    state.tail++;
+    count++;
+  }
+
+  if (count > 0) {
+    log_write_flush();
+    atomic_store_explicit(&state.written, state.tail, memory_order_release);
+  }
+  return count;
+}
+
+static void log_write_deferred(const log_ring *ring,
+                               const log_ring_record *record) {
+  const u8 *args = (const u8 *)(record + 1);
+
+  char buffer[BUFFER_SIZE];
+  u32 written =
+      snprintf(buffer, BUFFER_SIZE, "%s", level_strings[record->level]);
+  log_binary_format(record->format, args, record->args_size, buffer + written,
+                    BUFFER_SIZE - written);
+  if (log_collapse(record->level, buffer, ring->thread_index)) {
+    return;
+  }
+  printf("%s%s%s\n", colors[record->level], buffer, reset);
+
+  if (state.binary_file) {
+    log_binary_write_message(state.binary_file, record->level,
+                             log_format_id(record->format), record->timestamp,
+                             ring->thread_index, args, record->args_size);
+  }
+}
+
+/**
+ * Formats and writes out everything in every thread's ring.
+ * @returns The number of messages written.
+ */
+static u32 log_rings_drain() {
+  u32 count = 0;
+  log_ring *rings = atomic_load_explicit(&state.rings, memory_order_acquire);
+  for (log_ring *ring = rings; ring; ring = ring->next) {
+    u64 tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    u64 head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    while (tail != head) {
+      const log_ring_record *record =
+          (const log_ring_record *)&ring->data[tail & LOG_RING_MASK];
+      if (!record->wrap) {
+        log_write_deferred(ring, record);
+        count++;
+      }
+      tail += record->size;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  }
+
+  if (count > 0) {
+    log_write_flush();
+    if (state.binary_file) {
+      fflush(state.binary_file);
+    }
+  }
+  for (log_ring *ring = rings; ring; ring = ring->next) {
+    atomic_store_explicit(&ring->flushed,
+                          atomic_load_explicit(&ring->tail,
+                                               memory_order_relaxed),
+                          memory_order_release);
+  }
+  return count;
+}
+
+/**
+ * @returns `true` if a complete message is waiting in the queue or in any
+ * thread's ring.
+ */
+static bool log_writer_pending() {
+  log_entry *entry = &state.entries[state.tail & LOG_QUEUE_MASK];
+  if (atomic_load_explicit(&entry->sequence, memory_order_acquire) ==
+      state.tail + 1) {
+    return true;
+  }
+  log_ring *rings = atomic_load_explicit(&state.rings, memory_order_acquire);
+  for (log_ring *ring = rings; ring; ring = ring->next) {
+    if (atomic_load_explicit(&ring->head, memory_order_acquire) !=
+        atomic_load_explicit(&ring->tail, memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @returns How long the writer thread may wait before repeats of the last
+ * message are due to be reported.
+ */
+static u32 log_writer_timeout() {
+  if (state.repeat.count == 0) {
+    return PLATFORM_WAIT_INFINITE;
+  }
+  f64 remaining = state.repeat.since + LOG_REPEAT_REPORT_SECONDS -
+                  platform_get_absolute_time();
+  return remaining > 0 ? (u32)(remaining * 1000.0) + 1 : 0;
+}
+
+/**
+ * Blocks the writer thread until a message is queued, logging is shut down
+ * or `timeout_ms` passes.
+ */
+static void log_writer_wait(u32 timeout_ms) {
+  atomic_store_explicit(&state.writer_waiting, true, memory_order_relaxed);
+  // Paired with log_wake_writer: either this sees the new message or its
+  // producer sees the writer waiting.
+  atomic_thread_fence(memory_order_seq_cst);
+  if (!log_writer_pending()) {
+    platform_semaphore_timed_wait(&state.wake, timeout_ms);
+  }
+  atomic_store_explicit(&state.writer_waiting, false, memory_order_relaxed);
+}
+
+// Called after publishing a message, wakes the writer thread if it waits.
+static void log_wake_writer() {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&state.writer_waiting, memory_order_relaxed) &&
+      atomic_exchange_explicit(&state.writer_waiting, false,
+                               memory_order_relaxed)) {
+    platform_semaphore_post(&state.wake, 1);
+  }
+}
+
+static void log_writer_main(void *params) {
+  (void)params;
+  while (atomic_load_explicit(&state.running, memory_order_acquire)) {
+    u32 count = log_writer_drain() + log_rings_drain();
+    // Also while messages keep coming, or a flood of one message would go
+    // unreported until something else is logged.
+    if (state.repeat.count > 0 &&
+        platform_get_absolute_time() - state.repeat.since >=
+            LOG_REPEAT_REPORT_SECONDS) {
+      log_report_repeats();
+      log_write_flush();
+    }
+    if (count == 0) {
+      log_writer_wait(log_writer_timeout());
+    }
+  }
+  log_writer_drain();
+  log_rings_drain();
+  log_report_repeats();
+  log_write_flush();
+}
+
+/**
+ * Claims the next free slot, waiting for the writer if the queue is full
+ * rather than losing the message.
+ */
+static log_entry *log_claim(u64 *out_position) {
+  u64 position = atomic_load_explicit(&state.head, memory_order_relaxed);
+  for (;;) {
+    log_entry *entry = &state.entries[position & LOG_QUEUE_MASK];
+    u64 sequence = atomic_load_explicit(&entry->sequence, memory_order_acquire);
+    i64 diff = (i64)sequence - (i64)position;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&state.head, &position,
+                                                position + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *out_position = position;
+        return entry;
+      }
+    } else if (diff < 0) {
+      platform_sleep(0);
+      position = atomic_load_explicit(&state.head, memory_order_relaxed);
+    } else {
+      position = atomic_load_explicit(&state.head, memory_order_relaxed);
+    }
+  }
+}
+
+// Blocks until everything logged so far has reached every sink.
+static void log_flush() {
+  u64 target = atomic_load_explicit(&state.head, memory_order_acquire);
+  while (atomic_load_explicit(&state.written, memory_order_acquire) < target) {
+    platform_sleep(0);
+  }
+}
+
+#if defined(KLOG_BINARY_ENABLED)
+static log_ring *log_thread_ring() {
+  if (thread_ring) {
+    return thread_ring;
+  }
+
+  log_ring *ring = platform_allocate(sizeof(log_ring), false);
+  if (!ring) {
+    return nullptr;
+  }
+  platform_zero_memory(ring, sizeof(log_ring));
+  ring->thread_index = atomic_fetch_add(&state.ring_count, 1);
+
+  log_ring *rings = atomic_load_explicit(&state.rings, memory_order_relaxed);
+  do {
+    ring->next = rings;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &state.rings, &rings, ring, memory_order_release, memory_order_relaxed));
+
+  thread_ring = ring;
+  return ring;
+}
+
+/**
+ * Queues a message without formatting it: only the format string's address
+ * and the raw argument values are copied into this thread's ring.
+ * @returns `false` if the thread has no ring, in which case nothing was
+ * consumed from `args`.
+ */
+static bool log_output_deferred(log_level level, const char *format,
+                                va_list args) {
+  log_ring *ring = log_thread_ring();
+  if (!ring) {
+    return false;
+  }
+
+  u8 captured[LOG_BINARY_MAX_ARGS_SIZE];
+  u32 args_size =
+      log_binary_capture_args(format, args, captured, sizeof(captured));
+  u64 size = (sizeof(log_ring_record) + args_size + 7) & ~7ULL;
+
+  u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  u64 contiguous = LOG_RING_SIZE - (head & LOG_RING_MASK);
+  u64 needed = size <= contiguous ? size : contiguous + size;
+  // Wait for the writer rather than lose the message.
+  while (head + needed -
+             atomic_load_explicit(&ring->tail, memory_order_acquire) >
+         LOG_RING_SIZE) {
+    platform_sleep(0);
+  }
+
+  if (size > contiguous) {
+    log_ring_record *wrap =
+        (log_ring_record *)&ring->data[head & LOG_RING_MASK];
+    wrap->size = (u32)contiguous;
+    wrap->wrap = true;
+    head += contiguous;
+  }
+
+  log_ring_record *record =
+      (log_ring_record *)&ring->data[head & LOG_RING_MASK];
+  record->size = (u32)size;
+  record->args_size = (u16)args_size;
+  record->level = level;
+  record->wrap = false;
+  record->timestamp = platform_get_absolute_time();
+  record->format = format;
+  platform_copy_memory(record + 1, captured, args_size);
+  atomic_store_explicit(&ring->head, head + size, memory_order_release);
+  log_wake_writer();
+
+  if (level == LOG_LEVEL_FATAL) {
+    while (atomic_load_explicit(&ring->flushed, memory_order_acquire) <
+           head + size) {
+      platform_sleep(0);
+    }
+  }
+  return true;
+}
+#endif
+
 bool initialize_logging() {
-  // TODO: create log file
+  for (u64 i = 0; i < LOG_QUEUE_CAPACITY; ++i) {
+    atomic_init(&state.entries[i].sequence, i);
+  }
+  atomic_init(&state.head, 0);
+  atomic_init(&state.written, 0);
+  state.tail = 0;
+  atomic_init(&state.writer_waiting, false);
+  platform_semaphore_create(0, &state.wake);
+
+#if defined(KLOG_BINARY_ENABLED)
+  // The binary log replaces the text one; decode it with klogdecode.
+  state.binary_file = fopen(LOG_BINARY_FILE_PATH, "wb");
+  if (state.binary_file) {
+    setvbuf(state.binary_file, nullptr, _IOFBF, LOG_FILE_BUFFER_SIZE);
+    log_binary_write_header(state.binary_file);
+  }
+#else
+  state.file = fopen(LOG_FILE_PATH, "w");
+  if (state.file) {
+    setvbuf(state.file, nullptr, _IOFBF, LOG_FILE_BUFFER_SIZE);
+  }
+#endif
+
+  atomic_store(&state.running, true);
+  if (!platform_thread_create(log_writer_main, nullptr, &state.writer)) {
+    atomic_store(&state.running, false);
+    kwarn("Failed to start the log writer thread, logging synchronously");
+  }
+
+#if defined(KLOG_BINARY_ENABLED)
+  if (!state.binary_file) {
+    kwarn("Failed to open log file `%s`, logging to the console only",
+          LOG_BINARY_FILE_PATH);
+  }
+#else
+  if (!state.file) {
+    kwarn("Failed to open log file `%s`, logging to the console only",
+          LOG_FILE_PATH);
+  }
+#endif
   return true;
 }
+
 void shutdown_logging() {
-  // TODO: cleanup logging/write queued entries
-}
+  if (atomic_load(&state.running)) {
+    atomic_store_explicit(&state.running, false, memory_order_release);
+    platform_semaphore_post(&state.wake, 1);
+    platform_thread_join(&state.writer);
+  }
 
-#define BUFFER_SIZE 1600
+  if (state.file) {
+    fclose(state.file);
+    state.file = nullptr;
+  }
+  if (state.binary_file) {
+    fclose(state.binary_file);
+    state.binary_file = nullptr;
+  }
+
+  // Threads that log again from here on write synchronously, so their rings
+  // are no longer used.
+  log_ring *ring = atomic_exchange(&state.rings, nullptr);
+  while (ring) {
+    log_ring *next = ring->next;
+    platform_free(ring, false);
+    ring = next;
+  }
+}
 
 void log_output(log_level level, ...) {
-  char buffer[BUFFER_SIZE];
   va_list args;
   va_start(args, level);
   char *message = va_arg(args, char *);
-  u32 written = snprintf(buffer, BUFFER_SIZE, "%s", level_strings[level]);
-  written += vsnprintf(buffer + written, BUFFER_SIZE - written, message, args);
-  printf("%s%s%s\n", colors[level], buffer, reset);
-  snprintf(buffer + written, BUFFER_SIZE - written, "\n");
 
+  if (!atomic_load_explicit(&state.running, memory_order_acquire)) {
+    // Before initialize_logging or after shutdown_logging: write directly.
+    char buffer[BUFFER_SIZE];
+    u32 written = snprintf(buffer, BUFFER_SIZE, "%s", level_strings[level]);
+    vsnprintf(buffer + written, BUFFER_SIZE - written, message, args);
+    va_end(args);
+    log_write(level, buffer);
+    if (level == LOG_LEVEL_FATAL) {
+      log_write_flush();
+    }
+    return;
+  }
+
+#if defined(KLOG_BINARY_ENABLED)
+  if (log_output_deferred(level, message, args)) {
+    va_end(args);
+    return;
+  }
+#endif
+
+  u64 position;
+  log_entry *entry = log_claim(&position);
+  entry->level = level;
+  u32 written =
+      snprintf(entry->message, BUFFER_SIZE, "%s", level_strings[level]);
+  vsnprintf(entry->message + written, BUFFER_SIZE - written, message, args);
   va_end(args);
+  atomic_store_explicit(&entry->sequence, position + 1, memory_order_release);
+  log_wake_writer();
+
+  if (level == LOG_LEVEL_FATAL) {
+    // Whatever comes next may well take the process down.
+    log_flush();
+  }
+}
+
+void log_category_set_level(log_category category, log_level level) {
+  if (category >= LOG_CATEGORY_MAX || level > LOG_LEVEL_TRACE) {
+    return;
+  }
+  log_category_levels[category] = level;
+}
+
+log_level log_category_get_level(log_category category) {
+  return category < LOG_CATEGORY_MAX ? (log_level)log_category_levels[category]
+                                     : LOG_LEVEL_TRACE;
+}
+
+const char *log_category_name(log_category category) {
+  return category < LOG_CATEGORY_MAX ? category_names[category] : "unknown";
+}
+
+bool log_categories_load(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    kwarn("Could not open log category config `%s`", path);
+    return false;
+  }
+
+  char line[128];
+  u32 line_number = 0;
+  while (fgets(line, sizeof(line), file)) {
+    line_number++;
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#') {
+      continue;
+    }
+
+    char *separator = strchr(line, '=');
+    if (!separator) {
+      kwarn("%s:%u: expected `category=level`", path, line_number);
+      continue;
+    }
+    *separator = '\0';
+    const char *name = line;
+    const char *level_name = separator + 1;
+
+    log_level level = LOG_LEVEL_TRACE + 1;
+    for (u32 i = 0; i <= LOG_LEVEL_TRACE; ++i) {
+      if (strcmp(level_name, level_names[i]) == 0) {
+        level = (log_level)i;
+      }
+    }
+    if (level > LOG_LEVEL_TRACE) {
+      kwarn("%s:%u: unknown log level `%s`", path, line_number, level_name);
+      continue;
+    }
+
+    bool matched = false;
+    for (u32 i = 0; i < LOG_CATEGORY_MAX; ++i) {
+      if (strcmp(name, "*") == 0 || strcmp(name, category_names[i]) == 0) {
+        log_category_set_level((log_category)i, level);
+        matched = true;
+      }
+    }
+    if (!matched) {
+      kwarn("%s:%u: unknown log category `%s`", path, line_number, name);
+    }
+  }
+
+  fclose(file);
+  return true;
+}
+
+void log_category_set_rate_limit(log_category category,
+                                 u32 messages_per_second) {
+  if (category < LOG_CATEGORY_MAX) {
+    category_rate_limits[category] = messages_per_second;
+  }
+}
+
+bool log_site_admit(log_site *site, log_category category, log_level level) {
+  u32 limit = site->limit ? site->limit : category_rate_limits[category];
+  if (limit == 0) {
+    return true;
+  }
+
+  u64 now = platform_get_absolute_time_ns() / 1000000;
+  u64 window_start =
+      atomic_load_explicit(&site->window_start_ms, memory_order_relaxed);
+  if (now - window_start >= LOG_RATE_WINDOW_MS &&
+      atomic_compare_exchange_strong(&site->window_start_ms, &window_start,
+                                     now)) {
+    // Only the thread that moved the window on resets and reports it.
+    atomic_store_explicit(&site->count, 0, memory_order_relaxed);
+    u32 suppressed = atomic_exchange(&site->suppressed, 0);
+    if (suppressed > 0) {
+      log_output(level, "%s:%u: suppressed %u messages over the last %.1fs",
+                 site->file, site->line, suppressed,
+                 (f64)(now - window_start) / 1000.0);
+    }
+  }
+
+  if (atomic_fetch_add_explicit(&site->count, 1, memory_order_relaxed) <
+      limit) {
+    return true;
+  }
+  atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+  return false;
 }
 
 void report_assertion_failure(assertion_msg *msg) {
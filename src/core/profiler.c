@@ -0,0 +1,778 @@
+#include "core/profiler.h"
+
+#if defined(KPROFILE_ENABLED)
+
+#include "core/logger.h"
+#include "platform/platform.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_RING_MASK (PROFILE_RING_CAPACITY - 1)
+#define PROFILE_SAMPLE_MASK (PROFILE_SAMPLE_CAPACITY - 1)
+
+// Longest symbol name, and longest stack, written to folded stacks.
+#define PROFILE_SYMBOL_SIZE 256
+#define PROFILE_FOLDED_LINE_SIZE (16ULL * 1024)
+
+#define PROFILE_FILE_BUFFER_SIZE (64ULL * 1024)
+
+#define CACHE_LINE_SIZE 64
+
+// Argument names of the counters in exported traces.
+static const char *profile_counter_names[PROFILE_COUNTER_COUNT] = {
+    [PROFILE_COUNTER_CYCLES] = "cycles",
+    [PROFILE_COUNTER_INSTRUCTIONS] = "instructions",
+    [PROFILE_COUNTER_L1D_MISSES] = "l1d_misses",
+    [PROFILE_COUNTER_LLC_MISSES] = "llc_misses",
+    [PROFILE_COUNTER_BRANCH_MISSES] = "branch_misses",
+};
+
+typedef enum profile_event_type : u8 {
+  PROFILE_EVENT_ZONE,
+  // A value plotted with profiler_plot, at start_ns.
+  PROFILE_EVENT_PLOT,
+} profile_event_type;
+
+typedef struct profile_event {
+  const char *name;
+  u64 start_ns;
+  union {
+    // Zones.
+    u64 end_ns;
+    // Plots.
+    u64 value;
+  };
+  u32 depth;
+  profile_event_type type;
+} profile_event;
+
+typedef struct profile_sample {
+  u32 depth;
+  // Innermost first, see platform_sample_handler.
+  u64 frames[PLATFORM_SAMPLE_MAX_DEPTH];
+} profile_sample;
+
+/**
+ * The zones a thread has closed, or a track's zones. Only the owning thread
+ * writes to it; `head` is published so that exporting can read the events
+ * below it. Allocated on a thread's first zone or by profiler_track_create,
+ * and kept until profiler_shutdown.
+ */
+typedef struct profile_ring {
+  alignas(CACHE_LINE_SIZE) _Atomic u64 head;
+  // Position of the first event not yet aggregated into a frame.
+  u64 frame_tail;
+  // Nesting depth of the zones currently open.
+  u32 depth;
+  u32 thread_index;
+  const char *thread_name;
+  struct profile_ring *next;
+  // The thread's hardware counters, if they are open.
+  platform_perf_counters counters;
+  // What the counters counted during each event, alongside `events`. Only
+  // allocated when the counters are open.
+  u64 (*event_counters)[PROFILE_COUNTER_COUNT];
+  // Armed and disarmed by the owning thread, to follow the sampling state.
+  platform_sample_timer sample_timer;
+  // The state's sample_generation the timer was last armed or disarmed for.
+  u32 sample_generation;
+  // Published by the signal handler, which writes `samples` on the owning
+  // thread. Allocated when the thread is first sampled.
+  _Atomic u64 sample_head;
+  profile_sample *samples;
+  profile_event events[PROFILE_RING_CAPACITY];
+} profile_ring;
+
+typedef struct profiler_state {
+  _Atomic bool running;
+  bool hardware_counters;
+  bool sampling_supported;
+  _Atomic bool sampling;
+  _Atomic u32 sample_frequency;
+  // Bumped when sampling starts or stops, for threads to follow at their
+  // next zone.
+  _Atomic u32 sample_generation;
+  const char *samples_path;
+  _Atomic(profile_ring *) rings;
+  _Atomic u32 ring_count;
+  u64 frame_start_ns;
+  u64 frame_start_counters[PROFILE_COUNTER_COUNT];
+  profile_frame last_frame;
+} profiler_state;
+
+static profiler_state state;
+
+static kthread_local profile_ring *thread_ring;
+
+static u64 profile_now_ns() { return platform_get_absolute_time_ns(); }
+
+static profile_ring *profile_ring_create() {
+  profile_ring *ring = platform_allocate(sizeof(profile_ring), false);
+  if (!ring) {
+    return nullptr;
+  }
+  platform_zero_memory(ring, sizeof(profile_ring));
+  ring->thread_index = atomic_fetch_add(&state.ring_count, 1);
+
+  profile_ring *rings = atomic_load_explicit(&state.rings, memory_order_relaxed);
+  do {
+    ring->next = rings;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &state.rings, &rings, ring, memory_order_release, memory_order_relaxed));
+  return ring;
+}
+
+// Counters count the thread that opens them, so this runs on the ring's
+// thread.
+static void profile_ring_open_counters(profile_ring *ring) {
+  if (!platform_perf_counters_open(&ring->counters)) {
+    return;
+  }
+  u64 size = sizeof(*ring->event_counters) * PROFILE_RING_CAPACITY;
+  ring->event_counters = platform_allocate(size, false);
+  if (!ring->event_counters) {
+    platform_perf_counters_close(&ring->counters);
+    return;
+  }
+  platform_zero_memory(ring->event_counters, size);
+}
+
+static profile_ring *profile_thread_ring() {
+  if (!thread_ring) {
+    thread_ring = profile_ring_create();
+    if (thread_ring && state.hardware_counters) {
+      profile_ring_open_counters(thread_ring);
+    }
+  }
+  return thread_ring;
+}
+
+static void profile_read_counters(const profile_ring *ring,
+                                  u64 out_values[PROFILE_COUNTER_COUNT]) {
+  if (ring && ring->event_counters) {
+    platform_perf_counters_read(&ring->counters, out_values);
+  }
+}
+
+/**
+ * @param start_counters The ring's counters at start_ns, read again now to
+ * record their difference. Ignored if the ring does not count.
+ */
+static void profile_record(profile_ring *ring, const char *name, u64 start_ns,
+                           u64 end_ns, u32 depth, const u64 *start_counters) {
+  u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  profile_event *event = &ring->events[head & PROFILE_RING_MASK];
+  event->name = name;
+  event->start_ns = start_ns;
+  event->end_ns = end_ns;
+  event->depth = depth;
+  event->type = PROFILE_EVENT_ZONE;
+  if (ring->event_counters && start_counters) {
+    u64 *counters = ring->event_counters[head & PROFILE_RING_MASK];
+    platform_perf_counters_read(&ring->counters, counters);
+    for (u32 i = 0; i < PROFILE_COUNTER_COUNT; ++i) {
+      counters[i] -= start_counters[i];
+    }
+  }
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Runs in a signal handler on the ring's thread.
+static void profile_sample_record(void *context, const u64 *frames,
+                                  u32 depth) {
+  profile_ring *ring = context;
+  u64 head = atomic_load_explicit(&ring->sample_head, memory_order_relaxed);
+  profile_sample *sample = &ring->samples[head & PROFILE_SAMPLE_MASK];
+  sample->depth = depth;
+  for (u32 i = 0; i < depth; ++i) {
+    sample->frames[i] = frames[i];
+  }
+  atomic_store_explicit(&ring->sample_head, head + 1, memory_order_release);
+}
+
+// Arms or disarms the calling thread's sample timer after sampling started
+// or stopped. Restarting sampling drops the samples taken before.
+static void profile_ring_follow_sampling(profile_ring *ring, u32 generation) {
+  ring->sample_generation = generation;
+  platform_sample_timer_disarm(&ring->sample_timer);
+  if (!atomic_load_explicit(&state.sampling, memory_order_relaxed)) {
+    return;
+  }
+
+  if (!ring->samples) {
+    ring->samples = platform_allocate(
+        sizeof(profile_sample) * PROFILE_SAMPLE_CAPACITY, false);
+    if (!ring->samples) {
+      return;
+    }
+  }
+  atomic_store_explicit(&ring->sample_head, 0, memory_order_relaxed);
+  platform_sample_timer_arm(
+      atomic_load_explicit(&state.sample_frequency, memory_order_relaxed),
+      ring, &ring->sample_timer);
+}
+
+bool profiler_initialize(profiler_config config) {
+  state.hardware_counters = config.hardware_counters;
+  state.samples_path =
+      config.samples_path ? config.samples_path : PROFILE_SAMPLES_PATH;
+  atomic_store_explicit(&state.sample_frequency,
+                        config.sample_frequency
+                            ? config.sample_frequency
+                            : PROFILE_DEFAULT_SAMPLE_FREQUENCY,
+                        memory_order_relaxed);
+  state.sampling_supported = platform_sampler_initialize(profile_sample_record);
+  atomic_store_explicit(&state.running, true, memory_order_release);
+  profiler_set_thread_name("main");
+  if (config.hardware_counters) {
+    profile_ring *ring = thread_ring;
+    if (ring && ring->event_counters) {
+      kinfo("Profiling with %u hardware counters",
+            __builtin_popcount(ring->counters.available));
+    } else {
+      kwarn("Hardware counters are not available, profiling time only");
+    }
+  }
+  if (config.sample_frequency) {
+    profiler_sampling_start(config.sample_frequency);
+  }
+  profile_read_counters(thread_ring, state.frame_start_counters);
+  state.frame_start_ns = profile_now_ns();
+  return true;
+}
+
+void profiler_shutdown() {
+  atomic_store_explicit(&state.running, false, memory_order_release);
+
+  atomic_store_explicit(&state.sampling, false, memory_order_relaxed);
+
+  // Zones closed from here on are dropped, so the rings are no longer used.
+  profile_ring *rings = atomic_exchange(&state.rings, nullptr);
+  for (profile_ring *ring = rings; ring; ring = ring->next) {
+    platform_sample_timer_disarm(&ring->sample_timer);
+  }
+  if (state.sampling_supported) {
+    platform_sampler_shutdown();
+    state.sampling_supported = false;
+  }
+
+  profile_ring *ring = rings;
+  while (ring) {
+    profile_ring *next = ring->next;
+    if (ring->event_counters) {
+      platform_perf_counters_close(&ring->counters);
+      platform_free(ring->event_counters, false);
+    }
+    if (ring->samples) {
+      platform_free(ring->samples, false);
+    }
+    platform_free(ring, false);
+    ring = next;
+  }
+  thread_ring = nullptr;
+}
+
+profile_zone profile_zone_begin(const char *name) {
+  profile_zone zone = {.name = name};
+  if (atomic_load_explicit(&state.running, memory_order_relaxed)) {
+    profile_ring *ring = profile_thread_ring();
+    if (ring) {
+      u32 generation = atomic_load_explicit(&state.sample_generation,
+                                            memory_order_acquire);
+      if (generation != ring->sample_generation) {
+        profile_ring_follow_sampling(ring, generation);
+      }
+      zone.depth = ring->depth++;
+      profile_read_counters(ring, zone.counters);
+    }
+  }
+  zone.start_ns = profile_now_ns();
+  return zone;
+}
+
+void profile_zone_end(profile_zone *zone) {
+  u64 end_ns = profile_now_ns();
+  profile_ring *ring = thread_ring;
+  if (!ring || !atomic_load_explicit(&state.running, memory_order_relaxed)) {
+    return;
+  }
+
+  ring->depth = zone->depth;
+  profile_record(ring, zone->name, zone->start_ns, end_ns, zone->depth,
+                 zone->counters);
+}
+
+void profiler_set_thread_name(const char *name) {
+  profile_ring *ring = profile_thread_ring();
+  if (ring) {
+    ring->thread_name = name;
+  }
+}
+
+bool profiler_read_counters(u64 out_values[PROFILE_COUNTER_COUNT]) {
+  platform_zero_memory(out_values, sizeof(u64) * PROFILE_COUNTER_COUNT);
+  profile_ring *ring = thread_ring;
+  if (!ring || !ring->event_counters) {
+    return false;
+  }
+  platform_perf_counters_read(&ring->counters, out_values);
+  return true;
+}
+
+profile_track *profiler_track_create(const char *name) {
+  profile_ring *ring = profile_ring_create();
+  if (ring) {
+    ring->thread_name = name;
+  }
+  return ring;
+}
+
+void profiler_track_record(profile_track *track, const char *name,
+                           u64 start_ns, u64 end_ns, u32 depth) {
+  if (track && atomic_load_explicit(&state.running, memory_order_relaxed)) {
+    profile_record(track, name, start_ns, end_ns, depth, nullptr);
+  }
+}
+
+void profiler_plot(const char *name, u64 value) {
+  if (!atomic_load_explicit(&state.running, memory_order_relaxed)) {
+    return;
+  }
+  profile_ring *ring = profile_thread_ring();
+  if (!ring) {
+    return;
+  }
+  u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  profile_event *event = &ring->events[head & PROFILE_RING_MASK];
+  event->name = name;
+  event->start_ns = profile_now_ns();
+  event->value = value;
+  event->depth = 0;
+  event->type = PROFILE_EVENT_PLOT;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * @param counters What the counters counted during the event, or nullptr.
+ */
+static void profile_frame_add(profile_frame *frame, const profile_event *event,
+                              const u64 *counters) {
+  u64 duration = event->end_ns - event->start_ns;
+  profile_zone_stats *zone = nullptr;
+  for (u32 i = 0; i < frame->zone_count; ++i) {
+    if (frame->zones[i].name == event->name) {
+      zone = &frame->zones[i];
+      break;
+    }
+  }
+
+  if (zone) {
+    zone->total_ns += duration;
+    zone->calls++;
+    if (duration > zone->max_ns) {
+      zone->max_ns = duration;
+    }
+    if (event->depth < zone->depth) {
+      zone->depth = event->depth;
+    }
+  } else if (frame->zone_count < PROFILE_MAX_FRAME_ZONES) {
+    zone = &frame->zones[frame->zone_count++];
+    *zone = (profile_zone_stats){
+        .name = event->name,
+        .total_ns = duration,
+        .max_ns = duration,
+        .calls = 1,
+        .depth = event->depth,
+    };
+  } else {
+    return;
+  }
+
+  if (counters) {
+    for (u32 i = 0; i < PROFILE_COUNTER_COUNT; ++i) {
+      zone->counters[i] += counters[i];
+    }
+  }
+}
+
+void profiler_frame_end() {
+  u64 now = profile_now_ns();
+  profile_ring *ring = profile_thread_ring();
+  if (!ring) {
+    return;
+  }
+
+  profile_frame *frame = &state.last_frame;
+  frame->frame_index++;
+  frame->start_ns = state.frame_start_ns;
+  frame->duration_ns = now - state.frame_start_ns;
+  frame->zone_count = 0;
+
+  u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  u64 tail = ring->frame_tail;
+  if (head - tail > PROFILE_RING_CAPACITY) {
+    tail = head - PROFILE_RING_CAPACITY;
+  }
+  for (; tail != head; ++tail) {
+    u64 index = tail & PROFILE_RING_MASK;
+    if (ring->events[index].type != PROFILE_EVENT_ZONE) {
+      continue;
+    }
+    profile_frame_add(frame, &ring->events[index],
+                      ring->event_counters ? ring->event_counters[index]
+                                           : nullptr);
+  }
+
+  profile_record(ring, "frame", state.frame_start_ns, now, 0,
+                 state.frame_start_counters);
+  if (ring->event_counters) {
+    platform_copy_memory(frame->counters,
+                         ring->event_counters[head & PROFILE_RING_MASK],
+                         sizeof(frame->counters));
+  }
+  ring->frame_tail = head + 1;
+
+  if (state.sampling_supported && platform_sampler_toggle_requested()) {
+    if (profiler_sampling_active()) {
+      profiler_sampling_stop();
+      profiler_export_folded_stacks(state.samples_path);
+    } else {
+      profiler_sampling_start(atomic_load_explicit(&state.sample_frequency,
+                                                   memory_order_relaxed));
+    }
+  }
+
+  profile_read_counters(ring, state.frame_start_counters);
+  state.frame_start_ns = now;
+}
+
+const profile_frame *profiler_last_frame() { return &state.last_frame; }
+
+// Publishes a change of sampling state, and follows it on the calling
+// thread right away.
+static void profile_sampling_changed() {
+  u32 generation = atomic_fetch_add_explicit(&state.sample_generation, 1,
+                                             memory_order_release) +
+                   1;
+  profile_ring *ring = profile_thread_ring();
+  if (ring) {
+    profile_ring_follow_sampling(ring, generation);
+  }
+}
+
+bool profiler_sampling_start(u32 frequency_hz) {
+  if (!state.sampling_supported) {
+    kwarn("Sampling is not supported on this platform");
+    return false;
+  }
+  if (frequency_hz == 0) {
+    frequency_hz = PROFILE_DEFAULT_SAMPLE_FREQUENCY;
+  }
+  atomic_store_explicit(&state.sample_frequency, frequency_hz,
+                        memory_order_relaxed);
+  atomic_store_explicit(&state.sampling, true, memory_order_relaxed);
+  profile_sampling_changed();
+  kinfo("Sampling call stacks %u times per second of CPU time", frequency_hz);
+  return true;
+}
+
+void profiler_sampling_stop() {
+  if (!atomic_exchange_explicit(&state.sampling, false,
+                                memory_order_relaxed)) {
+    return;
+  }
+  profile_sampling_changed();
+  kinfo("Sampling stopped");
+}
+
+bool profiler_sampling_active() {
+  return atomic_load_explicit(&state.sampling, memory_order_relaxed);
+}
+
+static void profile_write_string(FILE *file, const char *string) {
+  fputc('"', file);
+  for (const char *c = string; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', file);
+    }
+    fputc(*c, file);
+  }
+  fputc('"', file);
+}
+
+// Writes the counted events as a trace event's arguments.
+static void profile_write_counters(FILE *file, u32 available,
+                                   const u64 *counters) {
+  fputs(",\"args\":{", file);
+  bool first = true;
+  for (u32 i = 0; i < PROFILE_COUNTER_COUNT; ++i) {
+    if (available & (1U << i)) {
+      fprintf(file, "%s\"%s\":%llu", first ? "" : ",",
+              profile_counter_names[i], counters[i]);
+      first = false;
+    }
+  }
+  fputc('}', file);
+}
+
+/**
+ * A copy of a sample taken out of its ring for exporting, which sorts
+ * identical stacks next to each other.
+ */
+typedef struct profile_stack {
+  u32 thread_index;
+  u32 depth;
+  const char *thread_name;
+  u64 frames[PLATFORM_SAMPLE_MAX_DEPTH];
+} profile_stack;
+
+static i32 profile_stack_compare(const void *a, const void *b) {
+  const profile_stack *left = a;
+  const profile_stack *right = b;
+  if (left->thread_index != right->thread_index) {
+    return left->thread_index < right->thread_index ? -1 : 1;
+  }
+  if (left->depth != right->depth) {
+    return left->depth < right->depth ? -1 : 1;
+  }
+  return memcmp(left->frames, right->frames, sizeof(u64) * left->depth);
+}
+
+// A stack as a line of folded text, and how many samples had it.
+typedef struct profile_folded {
+  char *text;
+  u64 count;
+} profile_folded;
+
+static i32 profile_folded_compare(const void *a, const void *b) {
+  return strcmp(((const profile_folded *)a)->text,
+                ((const profile_folded *)b)->text);
+}
+
+/**
+ * Appends a frame to a folded stack, in which `;` separates frames and a
+ * space precedes the count. Truncates stacks longer than
+ * PROFILE_FOLDED_LINE_SIZE.
+ * @returns The new length of `line`.
+ */
+static u64 profile_append_frame(char *line, u64 length, const char *name) {
+  if (length > 0 && length < PROFILE_FOLDED_LINE_SIZE - 1) {
+    line[length++] = ';';
+  }
+  for (const char *c = name; *c && length < PROFILE_FOLDED_LINE_SIZE - 1;
+       ++c) {
+    line[length++] = *c == ';' || *c == ' ' ? '_' : *c;
+  }
+  line[length] = '\0';
+  return length;
+}
+
+// Symbolizes a stack into a folded line, rooted at its thread's name.
+static u64 profile_fold_stack(const profile_stack *stack, char *line) {
+  char name[PROFILE_SYMBOL_SIZE];
+  if (stack->thread_name) {
+    snprintf(name, sizeof(name), "%s", stack->thread_name);
+  } else {
+    snprintf(name, sizeof(name), "thread_%u", stack->thread_index);
+  }
+  u64 length = profile_append_frame(line, 0, name);
+
+  for (u32 frame = stack->depth; frame-- > 0;) {
+    // Return addresses point past their call, which may be the start of the
+    // next function.
+    u64 address = frame == 0 ? stack->frames[0] : stack->frames[frame] - 1;
+    if (!platform_symbolize(address, name, sizeof(name))) {
+      snprintf(name, sizeof(name), "0x%llx", address);
+    }
+    length = profile_append_frame(line, length, name);
+  }
+  return length;
+}
+
+bool profiler_export_folded_stacks(const char *path) {
+  u64 capacity = 0;
+  profile_ring *rings = atomic_load_explicit(&state.rings, memory_order_acquire);
+  for (profile_ring *ring = rings; ring; ring = ring->next) {
+    if (ring->samples) {
+      u64 head = atomic_load_explicit(&ring->sample_head, memory_order_acquire);
+      capacity += head < PROFILE_SAMPLE_CAPACITY ? head : PROFILE_SAMPLE_CAPACITY;
+    }
+  }
+  if (capacity == 0) {
+    kwarn("No samples to export to `%s`", path);
+    return false;
+  }
+
+  profile_stack *stacks =
+      platform_allocate(sizeof(profile_stack) * capacity, false);
+  profile_folded *folded =
+      platform_allocate(sizeof(profile_folded) * capacity, false);
+  char *line = platform_allocate(PROFILE_FOLDED_LINE_SIZE, false);
+  if (!stacks || !folded || !line) {
+    kerror("Could not allocate %llu samples to export", capacity);
+    platform_free(stacks, false);
+    platform_free(folded, false);
+    platform_free(line, false);
+    return false;
+  }
+
+  u64 count = 0;
+  for (profile_ring *ring = rings; ring; ring = ring->next) {
+    if (!ring->samples) {
+      continue;
+    }
+    u64 head = atomic_load_explicit(&ring->sample_head, memory_order_acquire);
+    u64 tail =
+        head > PROFILE_SAMPLE_CAPACITY ? head - PROFILE_SAMPLE_CAPACITY : 0;
+    for (; tail != head && count < capacity; ++tail) {
+      const profile_sample *sample = &ring->samples[tail & PROFILE_SAMPLE_MASK];
+      profile_stack *stack = &stacks[count];
+      stack->thread_index = ring->thread_index;
+      stack->thread_name = ring->thread_name;
+      stack->depth = sample->depth < PLATFORM_SAMPLE_MAX_DEPTH
+                         ? sample->depth
+                         : PLATFORM_SAMPLE_MAX_DEPTH;
+      platform_copy_memory(stack->frames, sample->frames,
+                           sizeof(u64) * stack->depth);
+      // A thread still being sampled may have come around to the sample
+      // while it was copied.
+      atomic_thread_fence(memory_order_acquire);
+      if (atomic_load_explicit(&ring->sample_head, memory_order_relaxed) -
+              tail <
+          PROFILE_SAMPLE_CAPACITY) {
+        count++;
+      }
+    }
+  }
+
+  // Identical stacks are symbolized once. Different addresses within the
+  // same functions still fold into the same line, so lines are merged too.
+  qsort(stacks, count, sizeof(profile_stack), profile_stack_compare);
+  u64 folded_count = 0;
+  for (u64 i = 0; i < count;) {
+    u64 next = i + 1;
+    while (next < count &&
+           profile_stack_compare(&stacks[i], &stacks[next]) == 0) {
+      next++;
+    }
+    u64 length = profile_fold_stack(&stacks[i], line);
+    char *text = platform_allocate(length + 1, false);
+    platform_copy_memory(text, line, length + 1);
+    folded[folded_count++] = (profile_folded){.text = text, .count = next - i};
+    i = next;
+  }
+  qsort(folded, folded_count, sizeof(profile_folded), profile_folded_compare);
+
+  FILE *file = fopen(path, "w");
+  if (file) {
+    setvbuf(file, nullptr, _IOFBF, PROFILE_FILE_BUFFER_SIZE);
+  } else {
+    kerror("Could not open `%s` to export the samples", path);
+  }
+
+  u64 distinct = 0;
+  for (u64 i = 0; i < folded_count;) {
+    u64 samples = 0;
+    u64 next = i;
+    while (next < folded_count &&
+           strcmp(folded[i].text, folded[next].text) == 0) {
+      samples += folded[next].count;
+      next++;
+    }
+    if (file) {
+      fprintf(file, "%s %llu\n", folded[i].text, samples);
+    }
+    distinct++;
+    i = next;
+  }
+
+  for (u64 i = 0; i < folded_count; ++i) {
+    platform_free(folded[i].text, false);
+  }
+  platform_free(line, false);
+  platform_free(folded, false);
+  platform_free(stacks, false);
+  if (!file) {
+    return false;
+  }
+
+  bool result = !ferror(file);
+  fclose(file);
+  if (result) {
+    kinfo("Exported %llu samples of %llu distinct stacks to `%s`", count,
+          distinct, path);
+  } else {
+    kerror("Failed to write the samples to `%s`", path);
+  }
+  return result;
+}
+
+bool profiler_export_chrome_trace(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    kerror("Could not open `%s` to export the profile", path);
+    return false;
+  }
+  setvbuf(file, nullptr, _IOFBF, PROFILE_FILE_BUFFER_SIZE);
+
+  u64 event_count = 0;
+  bool first = true;
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+  profile_ring *rings = atomic_load_explicit(&state.rings, memory_order_acquire);
+  for (profile_ring *ring = rings; ring; ring = ring->next) {
+    if (ring->thread_name) {
+      fprintf(file,
+              "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,"
+              "\"args\":{\"name\":",
+              first ? "" : ",\n", ring->thread_index);
+      profile_write_string(file, ring->thread_name);
+      fputs("}}", file);
+      first = false;
+    }
+
+    u64 head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    u64 tail = head > PROFILE_RING_CAPACITY ? head - PROFILE_RING_CAPACITY : 0;
+    for (; tail != head; ++tail) {
+      const profile_event *event = &ring->events[tail & PROFILE_RING_MASK];
+      if (event->type == PROFILE_EVENT_PLOT) {
+        // Counter events, which are plotted per process and name.
+        fprintf(file, "%s{\"ph\":\"C\",\"pid\":1,\"name\":",
+                first ? "" : ",\n");
+        profile_write_string(file, event->name);
+        fprintf(file, ",\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+                event->start_ns / 1000.0, event->value);
+        first = false;
+        event_count++;
+        continue;
+      }
+      // Complete events, in microseconds.
+      fprintf(file, "%s{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"name\":",
+              first ? "" : ",\n", ring->thread_index);
+      profile_write_string(file, event->name);
+      fprintf(file, ",\"ts\":%.3f,\"dur\":%.3f", event->start_ns / 1000.0,
+              (event->end_ns - event->start_ns) / 1000.0);
+      if (ring->event_counters) {
+        profile_write_counters(file, ring->counters.available,
+                               ring->event_counters[tail & PROFILE_RING_MASK]);
+      }
+      fputc('}', file);
+      first = false;
+      event_count++;
+    }
+  }
+  fputs("\n]}\n", file);
+
+  bool result = !ferror(file);
+  fclose(file);
+  if (result) {
+    kinfo("Exported %llu profile zones to `%s`", event_count, path);
+  } else {
+    kerror("Failed to write the profile to `%s`", path);
+  }
+  return result;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#define KLOG_CATEGORY LOG_CATEGORY_MEMORY
+
+#include "memory/linear_allocator.h"
+
+#include "core/kmemory.h"
+#include "core/logger.h"
+
+void linear_allocator_create(u64 total_size, void *memory,
+                             linear_allocator *out_allocator) {
+  out_allocator->total_size = total_size;
+  atomic_init(&out_allocator->allocated, 0);
+  out_allocator->owns_memory = memory == nullptr;
+  if (memory) {
+    out_allocator->memory = memory;
+  } else {
+    out_allocator->memory =
+        kallocate(total_size, MEMORY_TAG_LINEAR_ALLOCATOR);
+  }
+}
+
+void linear_allocator_destroy(linear_allocator *allocator) {
+  if (allocator->owns_memory && allocator->memory) {
+    kfree(allocator->memory);
+  }
+  allocator->memory = nullptr;
+  allocator->total_size = 0;
+  allocator->owns_memory = false;
+  atomic_store_explicit(&allocator->allocated, 0, memory_order_relaxed);
+}
+
+void *linear_allocator_allocate(linear_allocator *allocator, u64 size) {
+  if (!allocator->memory || size == 0) {
+    return nullptr;
+  }
+
+  u64 aligned_size = (size + LINEAR_ALLOCATOR_ALIGNMENT - 1) &
+                     ~(u64)(LINEAR_ALLOCATOR_ALIGNMENT - 1);
+  u64 offset = atomic_fetch_add_explicit(&allocator->allocated, aligned_size,
+                                         memory_order_relaxed);
+  if (offset + aligned_size > allocator->total_size) {
+    // Leave the counter past the end; every later request fails too until
+    // the next free_all.
+    kerror("linear_allocator_allocate - tried to allocate %lluB, only %lluB "
+           "remaining",
+           size,
+           offset < allocator->total_size ? allocator->total_size - offset
+                                          : 0ULL);
+    return nullptr;
+  }
+
+  return (u8 *)allocator->memory + offset;
+}
+
+void linear_allocator_free_all(linear_allocator *allocator) {
+  atomic_store_explicit(&allocator->allocated, 0, memory_order_relaxed);
+}
@@ -1,17 +1,47 @@
+#define KLOG_CATEGORY LOG_CATEGORY_PLATFORM
+
 #include <dlfcn.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #include <time.h>
+#include <unistd.h>
 #include <vulkan/vulkan.h>
 
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
 #include "containers/darray.h"
+#include "core/event.h"
 #include "core/input.h"
 #include "core/logger.h"
+#include "core/profiler.h"
 #include "platform/platform.h"
 
 const f64 nano = 0.000000001;
 const u32 kilo = 1000;
 
+// How long the TSC is measured against clock_gettime to find its rate.
+#define TSC_CALIBRATION_NS 10000000ULL
+#define TSC_SAMPLE_ATTEMPTS 16
+// Fixed-point fraction bits of the TSC tick to nanosecond factor.
+#define TSC_SHIFT 32
+
+// How long the input thread blocks on the display connection before it
+// checks whether it should stop.
+#define INPUT_THREAD_WAIT_MS 50
+
 #if defined(KBUILD_X11)
 #include "platform/platform_linux_x11.h"
 #include <vulkan/vulkan_xcb.h>
@@ -31,10 +61,18 @@ typedef struct platform_state {
 #endif
   void (*platform_shutdown)();
   bool (*platform_pump_messages)();
+  bool (*platform_wait_messages)(i32 timeout_ms);
   bool (*platform_get_surface)(VkInstance instance,
                                VkAllocationCallbacks *allocator,
                                VkSurfaceKHR *surface);
   const char *vulkan_surface_extension_name;
+
+  // Dedicated input thread, see platform_config::input_thread. While it runs
+  // it owns the backend's message handling.
+  pthread_t input_thread;
+  bool input_threaded;
+  atomic_bool input_thread_running;
+  atomic_bool quit_requested;
 } platform_state;
 
 static platform_state *state_ptr;
@@ -43,6 +81,7 @@ static platform_state *state_ptr;
 static bool wl_startup(platform_config config) {
   if (wl_platform_startup(&state_ptr->wl, config)) {
     state_ptr->platform_pump_messages = wl_platform_pump_messages;
+    state_ptr->platform_wait_messages = wl_platform_wait_messages;
     state_ptr->platform_shutdown = wl_platform_shutdown;
     state_ptr->platform_get_surface = wl_platform_create_vulkan_surface;
     state_ptr->vulkan_surface_extension_name =
@@ -57,6 +96,7 @@ static bool wl_startup(platform_config config) {
 static bool x11_startup(platform_config config) {
   if (x11_platform_startup(&state_ptr->x11, config)) {
     state_ptr->platform_pump_messages = x11_platform_pump_messages;
+    state_ptr->platform_wait_messages = x11_platform_wait_messages;
     state_ptr->platform_shutdown = x11_platform_shutdown;
     state_ptr->platform_get_surface = x11_platform_create_vulkan_surface;
     state_ptr->vulkan_surface_extension_name =
@@ -67,14 +107,145 @@ static bool x11_startup(platform_config config) {
 }
 #endif
 
-bool platform_startup(void **plat_state, platform_config config) {
-  *plat_state = platform_allocate(sizeof(platform_state), false);
-  platform_zero_memory(*plat_state, sizeof(platform_state));
-  state_ptr = *plat_state;
-  if (!state_ptr) {
+/**
+ * Converts TSC readings to nanoseconds on the CLOCK_MONOTONIC timeline:
+ * base_ns + ((tsc - base_tsc) * tsc_mult >> TSC_SHIFT). Set up on first use,
+ * since time is read before platform_startup and in headless runs.
+ */
+typedef struct linux_timer {
+  bool use_tsc;
+  u64 base_tsc;
+  u64 base_ns;
+  u64 tsc_mult;
+} linux_timer;
+
+static linux_timer timer;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+
+static u64 monotonic_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (u64)now.tv_sec * 1000000000ULL + (u64)now.tv_nsec;
+}
+
+#if defined(__x86_64__)
+/**
+ * The TSC is only used when the CPU says it ticks at a constant rate in every
+ * power state, and the kernel, which checks that it is synchronized across
+ * CPUs, uses it as its own clocksource. KTIMER=clock_gettime opts out.
+ */
+static bool tsc_usable() {
+  const char *choice = getenv("KTIMER");
+  if (choice && strcmp(choice, "clock_gettime") == 0) {
+    return false;
+  }
+
+  u32 eax;
+  u32 ebx;
+  u32 ecx;
+  u32 edx;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1U << 8))) {
+    return false;
+  }
+
+  FILE *file = fopen(
+      "/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+  if (!file) {
+    return false;
+  }
+  char clocksource[32] = {};
+  bool read = fgets(clocksource, sizeof(clocksource), file) != nullptr;
+  fclose(file);
+  return read && strncmp(clocksource, "tsc", 3) == 0;
+}
+
+// A TSC reading paired with the clock_gettime reading taken between two
+// halves of it. The pair with the shortest gap is kept, as a preempted one
+// would skew the calibration.
+static u64 tsc_sample(u64 *out_ns) {
+  u64 best_gap = UINT64_MAX;
+  u64 best_tsc = 0;
+  for (u32 i = 0; i < TSC_SAMPLE_ATTEMPTS; ++i) {
+    u64 before = __rdtsc();
+    u64 ns = monotonic_ns();
+    u64 after = __rdtsc();
+    if (after - before < best_gap) {
+      best_gap = after - before;
+      best_tsc = before + (after - before) / 2;
+      *out_ns = ns;
+    }
+  }
+  return best_tsc;
+}
+
+static void timer_initialize() {
+  if (!tsc_usable()) {
+    return;
+  }
+
+  u64 start_ns;
+  u64 start_tsc = tsc_sample(&start_ns);
+  struct timespec wait = {.tv_nsec = TSC_CALIBRATION_NS};
+  nanosleep(&wait, nullptr);
+  u64 end_ns;
+  u64 end_tsc = tsc_sample(&end_ns);
+  if (end_tsc <= start_tsc) {
+    return;
+  }
+
+  timer.tsc_mult = (u64)((((unsigned __int128)(end_ns - start_ns))
+                          << TSC_SHIFT) /
+                         (end_tsc - start_tsc));
+  timer.base_tsc = end_tsc;
+  timer.base_ns = end_ns;
+  timer.use_tsc = true;
+}
+#else
+static void timer_initialize() {}
+#endif
+
+static void *input_thread_main(void *arg) {
+  (void)arg;
+  while (atomic_load_explicit(&state_ptr->input_thread_running,
+                              memory_order_acquire)) {
+    if (!state_ptr->platform_wait_messages(INPUT_THREAD_WAIT_MS)) {
+      atomic_store_explicit(&state_ptr->quit_requested, true,
+                            memory_order_release);
+      break;
+    }
+  }
+  return nullptr;
+}
+
+static bool input_thread_start() {
+  // Handing input over must be set up before the thread can produce any.
+  input_set_threaded(true);
+  state_ptr->input_threaded = true;
+  atomic_store(&state_ptr->input_thread_running, true);
+  if (pthread_create(&state_ptr->input_thread, nullptr, input_thread_main,
+                     nullptr) != 0) {
+    kerror("Failed to create the input thread, handling input on the main "
+           "thread");
+    atomic_store(&state_ptr->input_thread_running, false);
+    state_ptr->input_threaded = false;
+    input_set_threaded(false);
     return false;
   }
+  kinfo("Input thread started");
+  return true;
+}
+
+static void input_thread_stop() {
+  if (!state_ptr->input_threaded) {
+    return;
+  }
+  atomic_store(&state_ptr->input_thread_running, false);
+  pthread_join(state_ptr->input_thread, nullptr);
+  state_ptr->input_threaded = false;
+  input_set_threaded(false);
+}
 
+static bool platform_backend_startup(platform_config config) {
 #if defined(KBUILD_WAYLAND) && defined(KBUILD_X11)
   char *backend_choice = getenv("KBACKEND");
   if (backend_choice != NULL) {
@@ -116,12 +287,55 @@ bool platform_startup(void **plat_state, platform_config config) {
   return false;
 }
 
+bool platform_startup(void **plat_state, platform_config config) {
+  *plat_state = platform_allocate(sizeof(platform_state), false);
+  platform_zero_memory(*plat_state, sizeof(platform_state));
+  state_ptr = *plat_state;
+  if (!state_ptr) {
+    return false;
+  }
+
+  if (!platform_backend_startup(config)) {
+    return false;
+  }
+
+  pthread_once(&timer_once, timer_initialize);
+  kdebug("Timing with %s", timer.use_tsc ? "the TSC" : "clock_gettime");
+
+  if (config.input_thread) {
+    input_thread_start();
+  }
+  return true;
+}
+
 bool platform_pump_messages(void) {
+  KPROFILE_FUNCTION();
+  if (state_ptr->input_threaded) {
+    return !atomic_load_explicit(&state_ptr->quit_requested,
+                                 memory_order_acquire);
+  }
   return state_ptr->platform_pump_messages();
 }
 
+void platform_linux_fire_event(u16 code, event_context context) {
+  if (state_ptr->input_threaded) {
+    if (!event_post(code, nullptr, context)) {
+      kwarn("Event queue full, dropped platform event %hu", code);
+    }
+    return;
+  }
+  event_fire(code, nullptr, context);
+}
+
+void platform_input_thread_stop(void) {
+  if (state_ptr) {
+    input_thread_stop();
+  }
+}
+
 void platform_shutdown(void) {
   if (state_ptr) {
+    input_thread_stop();
     state_ptr->platform_shutdown();
     free(state_ptr);
     state_ptr = nullptr;
@@ -149,10 +363,20 @@ void *platform_set_memory(void *dest, i32 value, u64 size) {
   return memset(dest, value, size);
 }
 
+u64 platform_get_absolute_time_ns(void) {
+  pthread_once(&timer_once, timer_initialize);
+#if defined(__x86_64__)
+  if (timer.use_tsc) {
+    u64 ticks = __rdtsc() - timer.base_tsc;
+    return timer.base_ns +
+           (u64)(((unsigned __int128)ticks * timer.tsc_mult) >> TSC_SHIFT);
+  }
+#endif
+  return monotonic_ns();
+}
+
 f64 platform_get_absolute_time(void) {
-  struct timespec now;
-  clock_gettime(CLOCK_MONOTONIC, &now);
-  return (f64)now.tv_sec + ((f64)now.tv_nsec * nano);
+  return (f64)platform_get_absolute_time_ns() * nano;
 }
 
 void platform_sleep(u32 ms) {
@@ -162,6 +386,208 @@ void platform_sleep(u32 ms) {
   nanosleep(&ts, nullptr);
 }
 
+void platform_sleep_ns(u64 ns) {
+  struct timespec remaining = {.tv_sec = (time_t)(ns / 1000000000ULL),
+                               .tv_nsec = (long)(ns % 1000000000ULL)};
+  while (clock_nanosleep(CLOCK_MONOTONIC, 0, &remaining, &remaining) == EINTR) {
+  }
+}
+
+typedef struct linux_thread {
+  pthread_t handle;
+  platform_thread_entry entry;
+  void *params;
+} linux_thread;
+
+static void *linux_thread_main(void *arg) {
+  linux_thread *thread = arg;
+  thread->entry(thread->params);
+  return nullptr;
+}
+
+bool platform_thread_create(platform_thread_entry entry, void *params,
+                            platform_thread *out_thread) {
+  linux_thread *thread = malloc(sizeof(linux_thread));
+  thread->entry = entry;
+  thread->params = params;
+  if (pthread_create(&thread->handle, nullptr, linux_thread_main, thread) !=
+      0) {
+    free(thread);
+    out_thread->internal_data = nullptr;
+    return false;
+  }
+  out_thread->internal_data = thread;
+  return true;
+}
+
+void platform_thread_join(platform_thread *thread) {
+  linux_thread *internal = thread->internal_data;
+  if (!internal) {
+    return;
+  }
+  pthread_join(internal->handle, nullptr);
+  free(internal);
+  thread->internal_data = nullptr;
+}
+
+u32 platform_get_processor_count() {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (u32)count : 1;
+}
+
+u32 platform_get_physical_core_count() {
+  // A core is counted through the first of its hardware threads. The
+  // topology of offline processors is not listed.
+  long configured = sysconf(_SC_NPROCESSORS_CONF);
+  u32 count = 0;
+  for (long cpu = 0; cpu < configured; ++cpu) {
+    char path[96];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%ld/topology/thread_siblings_list",
+             cpu);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+      continue;
+    }
+    long first_sibling;
+    if (fscanf(file, "%ld", &first_sibling) == 1 && first_sibling == cpu) {
+      count++;
+    }
+    fclose(file);
+  }
+  return count > 0 ? count : platform_get_processor_count();
+}
+
+void platform_thread_yield() { sched_yield(); }
+
+bool platform_futex_wait(katomic u32 *address, u32 expected, u32 timeout_ms) {
+  struct timespec timeout = {.tv_sec = timeout_ms / 1000,
+                             .tv_nsec = (long)(timeout_ms % 1000) * 1000000};
+  // Private futexes skip the lookup for addresses shared between processes.
+  long result = syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected,
+                        timeout_ms == PLATFORM_WAIT_INFINITE ? nullptr
+                                                             : &timeout,
+                        nullptr, 0);
+  return result == 0 || errno != ETIMEDOUT;
+}
+
+void platform_futex_wake(katomic u32 *address, u32 count) {
+  syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE,
+          count > INT32_MAX ? INT32_MAX : (i32)count, nullptr, nullptr, 0);
+}
+
+// The perf events behind each profile_counter.
+static const struct perf_counter_event {
+  u32 type;
+  u64 config;
+} perf_counter_events[PROFILE_COUNTER_COUNT] = {
+    [PROFILE_COUNTER_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [PROFILE_COUNTER_INSTRUCTIONS] = {PERF_TYPE_HARDWARE,
+                                      PERF_COUNT_HW_INSTRUCTIONS},
+    [PROFILE_COUNTER_L1D_MISSES] = {PERF_TYPE_HW_CACHE,
+                                    PERF_COUNT_HW_CACHE_L1D |
+                                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    [PROFILE_COUNTER_LLC_MISSES] = {PERF_TYPE_HARDWARE,
+                                    PERF_COUNT_HW_CACHE_MISSES},
+    [PROFILE_COUNTER_BRANCH_MISSES] = {PERF_TYPE_HARDWARE,
+                                       PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+/**
+ * The counters are opened as one perf event group, so that they are
+ * scheduled onto the PMU together and a single read returns all of them.
+ */
+typedef struct linux_perf_counters {
+  i32 group_fd;
+  i32 fds[PROFILE_COUNTER_COUNT];
+  // Position of each counter's value in a group read, -1 if not counted.
+  i32 slots[PROFILE_COUNTER_COUNT];
+} linux_perf_counters;
+
+bool platform_perf_counters_open(platform_perf_counters *out_counters) {
+  *out_counters = (platform_perf_counters){};
+  linux_perf_counters *internal = malloc(sizeof(linux_perf_counters));
+  internal->group_fd = -1;
+  i32 slot_count = 0;
+
+  for (u32 i = 0; i < PROFILE_COUNTER_COUNT; ++i) {
+    internal->fds[i] = -1;
+    internal->slots[i] = -1;
+    // The group starts disabled, and the other counters follow its leader.
+    struct perf_event_attr attr = {
+        .type = perf_counter_events[i].type,
+        .size = sizeof(attr),
+        .config = perf_counter_events[i].config,
+        .read_format = PERF_FORMAT_GROUP,
+        .disabled = internal->group_fd < 0,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+    };
+    // This thread, on any CPU.
+    i32 fd = (i32)syscall(SYS_perf_event_open, &attr, 0, -1,
+                          internal->group_fd, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EACCES || errno == EPERM || errno == ENOSYS) {
+        kwarn_limited(1,
+                      "Hardware counters are not accessible: %s. See "
+                      "/proc/sys/kernel/perf_event_paranoid",
+                      strerror(errno));
+        break;
+      }
+      // Not provided by this CPU or hypervisor, the others may be.
+      continue;
+    }
+    if (internal->group_fd < 0) {
+      internal->group_fd = fd;
+    }
+    internal->fds[i] = fd;
+    internal->slots[i] = slot_count++;
+    out_counters->available |= 1U << i;
+  }
+
+  out_counters->internal_data = internal;
+  if (internal->group_fd < 0 ||
+      ioctl(internal->group_fd, PERF_EVENT_IOC_ENABLE,
+            PERF_IOC_FLAG_GROUP) != 0) {
+    platform_perf_counters_close(out_counters);
+    return false;
+  }
+  return true;
+}
+
+void platform_perf_counters_read(const platform_perf_counters *counters,
+                                 u64 out_values[PROFILE_COUNTER_COUNT]) {
+  linux_perf_counters *internal = counters->internal_data;
+  // The number of values, then the values in the order they were opened.
+  u64 group[1 + PROFILE_COUNTER_COUNT];
+  if (!internal || read(internal->group_fd, group, sizeof(group)) <= 0) {
+    platform_zero_memory(out_values, sizeof(u64) * PROFILE_COUNTER_COUNT);
+    return;
+  }
+
+  for (u32 i = 0; i < PROFILE_COUNTER_COUNT; ++i) {
+    i32 slot = internal->slots[i];
+    out_values[i] = slot >= 0 && (u64)slot < group[0] ? group[1 + slot] : 0;
+  }
+}
+
+void platform_perf_counters_close(platform_perf_counters *counters) {
+  linux_perf_counters *internal = counters->internal_data;
+  if (!internal) {
+    return;
+  }
+  // Followers first, the group goes with its leader.
+  for (i32 i = PROFILE_COUNTER_COUNT - 1; i >= 0; --i) {
+    if (internal->fds[i] >= 0) {
+      close(internal->fds[i]);
+    }
+  }
+  free(internal);
+  counters->internal_data = nullptr;
+  counters->available = 0;
+}
+
 void platform_get_required_extension_names(const char ***names) {
   darray_push(names, state_ptr->vulkan_surface_extension_name);
 }
@@ -417,7 +843,7 @@ keys translate_keycode(u32 xkb_keycode) {
   case XKB_KEY_bracketright:
     return KKEY_RBRACKET;
   default:
-    kwarn("Warning, key %lu not a valid key", xkb_keycode);
+    kwarn_limited(5, "Warning, key %lu not a valid key", xkb_keycode);
     return 0;
   }
 }
@@ -0,0 +1,179 @@
+#define KLOG_CATEGORY LOG_CATEGORY_PLATFORM
+
+#include "core/logger.h"
+#include "platform/platform.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Default MXCSR and x87 control word: all exceptions masked, round to
+// nearest, and for x87 extended precision.
+#define LINUX_FIBER_MXCSR 0x1F80
+#define LINUX_FIBER_FPU_CONTROL 0x037F
+
+typedef struct linux_fiber {
+  // Where the fiber's registers are saved while it is switched away.
+  void *stack_pointer;
+  // The mapping of its stack and guard page, nullptr for a thread's fiber.
+  u8 *mapping;
+  u64 mapping_size;
+  // The stack itself, above the guard page.
+  u64 stack_low;
+  platform_fiber_entry entry;
+  void *params;
+} linux_fiber;
+
+// The fiber the thread runs, set before switching to it. Initial-exec, so
+// that the sampler's signal handler reads it without allocating. Between
+// being set and the switch, the frames walked are bounded by the wrong
+// stack, which only ends the walk early: both stacks are mapped.
+static kthread_local linux_fiber *running_fiber
+    __attribute__((tls_model("initial-exec")));
+
+/**
+ * Pushes the registers the System V ABI has callees preserve, with the SSE
+ * and x87 control words, saves the stack pointer to `*from_stack_pointer`,
+ * and pops the same from `to_stack_pointer`. The return address on the new
+ * stack is where that context switched away, or linux_fiber_start.
+ */
+void linux_fiber_switch(void **from_stack_pointer, void *to_stack_pointer);
+
+// Where new fibers begin, with their linux_fiber in r12.
+void linux_fiber_start();
+
+__asm__(".text\n"
+        ".globl linux_fiber_switch\n"
+        ".hidden linux_fiber_switch\n"
+        ".type linux_fiber_switch, @function\n"
+        "linux_fiber_switch:\n"
+        "  pushq %rbp\n"
+        "  pushq %rbx\n"
+        "  pushq %r12\n"
+        "  pushq %r13\n"
+        "  pushq %r14\n"
+        "  pushq %r15\n"
+        "  subq $8, %rsp\n"
+        "  stmxcsr (%rsp)\n"
+        "  fnstcw 4(%rsp)\n"
+        "  movq %rsp, (%rdi)\n"
+        "  movq %rsi, %rsp\n"
+        "  ldmxcsr (%rsp)\n"
+        "  fldcw 4(%rsp)\n"
+        "  addq $8, %rsp\n"
+        "  popq %r15\n"
+        "  popq %r14\n"
+        "  popq %r13\n"
+        "  popq %r12\n"
+        "  popq %rbx\n"
+        "  popq %rbp\n"
+        "  ret\n"
+        ".size linux_fiber_switch, .-linux_fiber_switch\n"
+        "\n"
+        ".globl linux_fiber_start\n"
+        ".hidden linux_fiber_start\n"
+        ".type linux_fiber_start, @function\n"
+        "linux_fiber_start:\n"
+        "  .cfi_startproc\n"
+        // Ends stack walks, by unwinders and frame pointers alike, here.
+        "  .cfi_undefined rip\n"
+        "  xorl %ebp, %ebp\n"
+        "  movq %r12, %rdi\n"
+        "  call linux_fiber_main\n"
+        "  ud2\n"
+        "  .cfi_endproc\n"
+        ".size linux_fiber_start, .-linux_fiber_start\n");
+
+// Called by linux_fiber_start, with the stack aligned for a call.
+void linux_fiber_main(linux_fiber *fiber) {
+  fiber->entry(fiber->params);
+  kfatal("A fiber returned from its entry function");
+  abort();
+}
+
+bool platform_fiber_create(u64 stack_size, platform_fiber_entry entry,
+                           void *params, platform_fiber *out_fiber) {
+  out_fiber->internal_data = nullptr;
+  u64 page_size = (u64)sysconf(_SC_PAGESIZE);
+  stack_size = (stack_size + page_size - 1) / page_size * page_size;
+  u64 mapping_size = stack_size + page_size;
+  // Pages are only backed once touched, so unused stack costs nothing.
+  u8 *mapping = mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+  if (mapping == MAP_FAILED) {
+    kerror("Could not map a fiber stack: %s", strerror(errno));
+    return false;
+  }
+  // Stacks grow down, into the guard page.
+  if (mprotect(mapping, page_size, PROT_NONE) != 0) {
+    kwarn("Could not protect a fiber stack's guard page: %s",
+          strerror(errno));
+  }
+
+  linux_fiber *fiber = malloc(sizeof(linux_fiber));
+  *fiber = (linux_fiber){
+      .mapping = mapping,
+      .mapping_size = mapping_size,
+      .stack_low = (u64)mapping + page_size,
+      .entry = entry,
+      .params = params,
+  };
+
+  // What linux_fiber_switch pops, from the top of the stack down: the
+  // return address into linux_fiber_start, rbp, rbx, r12 to r15 and the
+  // control words. linux_fiber_start is entered with the stack 16-byte
+  // aligned, as it is before a call.
+  u64 *top = (u64 *)(mapping + mapping_size);
+  u64 *frame = top - 8;
+  frame[7] = (u64)linux_fiber_start;
+  frame[6] = 0;
+  frame[5] = 0;
+  frame[4] = (u64)fiber;
+  frame[3] = 0;
+  frame[2] = 0;
+  frame[1] = 0;
+  frame[0] = LINUX_FIBER_MXCSR | ((u64)LINUX_FIBER_FPU_CONTROL << 32);
+  fiber->stack_pointer = frame;
+
+  out_fiber->internal_data = fiber;
+  return true;
+}
+
+bool platform_fiber_from_thread(platform_fiber *out_fiber) {
+  // The thread's context is saved by its first switch away.
+  linux_fiber *fiber = malloc(sizeof(linux_fiber));
+  *fiber = (linux_fiber){};
+  out_fiber->internal_data = fiber;
+  return true;
+}
+
+void platform_fiber_destroy(platform_fiber *fiber) {
+  linux_fiber *internal = fiber->internal_data;
+  if (!internal) {
+    return;
+  }
+  if (internal->mapping) {
+    munmap(internal->mapping, internal->mapping_size);
+  }
+  free(internal);
+  fiber->internal_data = nullptr;
+}
+
+void platform_fiber_switch(platform_fiber *from, platform_fiber *to) {
+  linux_fiber *from_fiber = from->internal_data;
+  linux_fiber *to_fiber = to->internal_data;
+  // Whoever switches back to `from` sets it again, maybe on another thread.
+  running_fiber = to_fiber;
+  linux_fiber_switch(&from_fiber->stack_pointer, to_fiber->stack_pointer);
+}
+
+void platform_linux_fiber_stack(u64 *low, u64 *high) {
+  const linux_fiber *fiber = running_fiber;
+  // A thread's own fiber runs on the thread's stack.
+  if (fiber && fiber->mapping) {
+    *low = fiber->stack_low;
+    *high = (u64)fiber->mapping + fiber->mapping_size;
+  }
+}
@@ -0,0 +1,396 @@
+#define KLOG_CATEGORY LOG_CATEGORY_PLATFORM
+// dladdr, gettid, pthread_getattr_np and the ucontext register names.
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "containers/darray.h"
+#include "core/logger.h"
+#include "platform/platform.h"
+
+#if !defined(sigev_notify_thread_id)
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/**
+ * A thread's sample timer. Pending signals may still point at one after it
+ * is disarmed, so they are retired rather than freed until shutdown.
+ */
+typedef struct linux_sample_timer {
+  timer_t timer;
+  void *_Atomic context;
+  // The sampled thread's stack, which frame pointers must stay within.
+  u64 stack_low;
+  u64 stack_high;
+  struct linux_sample_timer *next_retired;
+} linux_sample_timer;
+
+typedef struct linux_symbol {
+  u64 address;
+  u64 size;
+  // Offset of its name in the module's `names`.
+  u32 name;
+} linux_symbol;
+
+/**
+ * The function symbols of a loaded executable or shared library, read from
+ * its file the first time an address in it is symbolized.
+ */
+typedef struct linux_module {
+  u64 base;
+  // Whether symbol addresses are relative to `base`, as in shared libraries
+  // and position independent executables.
+  bool relative;
+  char *path;
+  // Sorted by address.
+  linux_symbol *symbols;
+  u64 symbol_count;
+  char *names;
+} linux_module;
+
+typedef struct linux_sampler_state {
+  platform_sample_handler handler;
+  atomic_bool toggle_requested;
+  pthread_mutex_t lock;
+  linux_sample_timer *retired;
+  // darray
+  linux_module *modules;
+} linux_sampler_state;
+
+static linux_sampler_state sampler = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+// Walks the frame pointer chain of the interrupted code. Anything outside
+// the stack it runs on, the thread's or a fiber's, or not moving up it ends
+// the walk, since code built without frame pointers leaves other values in
+// rbp. A function interrupted before it set up its frame, or a leaf built
+// without one, is seen as called straight from its caller's caller.
+static void linux_sample_signal(i32 signal, siginfo_t *info, void *ucontext) {
+  (void)signal;
+  linux_sample_timer *timer = info->si_value.sival_ptr;
+  if (info->si_code != SI_TIMER || !timer) {
+    return;
+  }
+  void *context = atomic_load_explicit(&timer->context, memory_order_acquire);
+  if (!context) {
+    return;
+  }
+
+  i32 saved_errno = errno;
+  const mcontext_t *registers = &((const ucontext_t *)ucontext)->uc_mcontext;
+  u64 frames[PLATFORM_SAMPLE_MAX_DEPTH];
+  u32 depth = 0;
+  frames[depth++] = (u64)registers->gregs[REG_RIP];
+  u64 frame_pointer = (u64)registers->gregs[REG_RBP];
+  u64 stack_low = timer->stack_low;
+  u64 stack_high = timer->stack_high;
+  platform_linux_fiber_stack(&stack_low, &stack_high);
+  while (depth < PLATFORM_SAMPLE_MAX_DEPTH &&
+         frame_pointer >= stack_low &&
+         frame_pointer + 2 * sizeof(u64) <= stack_high &&
+         (frame_pointer & (sizeof(u64) - 1)) == 0) {
+    const u64 *frame = (const u64 *)frame_pointer;
+    if (frame[1] == 0) {
+      break;
+    }
+    frames[depth++] = frame[1];
+    if (frame[0] <= frame_pointer) {
+      break;
+    }
+    frame_pointer = frame[0];
+  }
+
+  sampler.handler(context, frames, depth);
+  errno = saved_errno;
+}
+
+static void linux_sampler_toggle_signal(i32 signal) {
+  (void)signal;
+  atomic_store_explicit(&sampler.toggle_requested, true,
+                        memory_order_relaxed);
+}
+
+bool platform_sampler_initialize(platform_sample_handler handler) {
+  sampler.handler = handler;
+  sampler.modules = darray_create(linux_module);
+
+  struct sigaction action = {
+      .sa_sigaction = linux_sample_signal,
+      .sa_flags = SA_SIGINFO | SA_RESTART,
+  };
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, nullptr) != 0) {
+    kerror("Could not handle SIGPROF: %s", strerror(errno));
+    return false;
+  }
+
+  struct sigaction toggle = {
+      .sa_handler = linux_sampler_toggle_signal,
+      .sa_flags = SA_RESTART,
+  };
+  sigemptyset(&toggle.sa_mask);
+  if (sigaction(SIGUSR2, &toggle, nullptr) != 0) {
+    kwarn("Could not handle SIGUSR2, sampling can only be switched in code");
+  }
+  return true;
+}
+
+void platform_sampler_shutdown() {
+  // A sample may still be pending; it must not end the process.
+  signal(SIGPROF, SIG_IGN);
+  signal(SIGUSR2, SIG_DFL);
+
+  pthread_mutex_lock(&sampler.lock);
+  linux_sample_timer *timer = sampler.retired;
+  while (timer) {
+    linux_sample_timer *next = timer->next_retired;
+    free(timer);
+    timer = next;
+  }
+  sampler.retired = nullptr;
+
+  if (sampler.modules) {
+    linux_module *module;
+    darray_for_each(sampler.modules, module) {
+      free(module->path);
+      free(module->symbols);
+      free(module->names);
+    }
+    darray_destroy(sampler.modules);
+    sampler.modules = nullptr;
+  }
+  pthread_mutex_unlock(&sampler.lock);
+}
+
+bool platform_sample_timer_arm(u32 frequency_hz, void *context,
+                               platform_sample_timer *out_timer) {
+  out_timer->internal_data = nullptr;
+  if (!sampler.handler || frequency_hz == 0) {
+    return false;
+  }
+
+  linux_sample_timer *timer = malloc(sizeof(linux_sample_timer));
+  *timer = (linux_sample_timer){};
+  atomic_init(&timer->context, context);
+
+  pthread_attr_t attributes;
+  if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+    void *stack;
+    size_t stack_size;
+    if (pthread_attr_getstack(&attributes, &stack, &stack_size) == 0) {
+      timer->stack_low = (u64)stack;
+      timer->stack_high = (u64)stack + stack_size;
+    }
+    pthread_attr_destroy(&attributes);
+  }
+
+  // Counts the CPU time of this thread only, and signals this thread only.
+  struct sigevent event = {
+      .sigev_notify = SIGEV_THREAD_ID,
+      .sigev_signo = SIGPROF,
+      .sigev_value.sival_ptr = timer,
+  };
+  event.sigev_notify_thread_id = gettid();
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer->timer) != 0) {
+    kwarn("Could not create a sample timer: %s", strerror(errno));
+    free(timer);
+    return false;
+  }
+
+  u64 interval_ns = 1000000000ULL / frequency_hz;
+  struct itimerspec interval = {
+      .it_interval = {.tv_sec = interval_ns / 1000000000ULL,
+                      .tv_nsec = interval_ns % 1000000000ULL},
+  };
+  interval.it_value = interval.it_interval;
+  if (timer_settime(timer->timer, 0, &interval, nullptr) != 0) {
+    kwarn("Could not start a sample timer: %s", strerror(errno));
+    timer_delete(timer->timer);
+    free(timer);
+    return false;
+  }
+
+  out_timer->internal_data = timer;
+  return true;
+}
+
+void platform_sample_timer_disarm(platform_sample_timer *timer) {
+  linux_sample_timer *internal = timer->internal_data;
+  if (!internal) {
+    return;
+  }
+  timer_delete(internal->timer);
+  atomic_store_explicit(&internal->context, nullptr, memory_order_release);
+
+  pthread_mutex_lock(&sampler.lock);
+  internal->next_retired = sampler.retired;
+  sampler.retired = internal;
+  pthread_mutex_unlock(&sampler.lock);
+  timer->internal_data = nullptr;
+}
+
+bool platform_sampler_toggle_requested() {
+  return atomic_exchange_explicit(&sampler.toggle_requested, false,
+                                  memory_order_relaxed);
+}
+
+static i32 linux_symbol_compare(const void *a, const void *b) {
+  u64 left = ((const linux_symbol *)a)->address;
+  u64 right = ((const linux_symbol *)b)->address;
+  return (left > right) - (left < right);
+}
+
+static u8 *linux_read_file(const char *path, u64 *out_size) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return nullptr;
+  }
+  u8 *data = nullptr;
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long size = ftell(file);
+    if (size > 0 && fseek(file, 0, SEEK_SET) == 0) {
+      data = malloc((u64)size);
+      if (fread(data, 1, (u64)size, file) == (u64)size) {
+        *out_size = (u64)size;
+      } else {
+        free(data);
+        data = nullptr;
+      }
+    }
+  }
+  fclose(file);
+  return data;
+}
+
+// Reads the function symbols of an ELF file, from its full symbol table if
+// it was not stripped, or else from the dynamic one.
+static void linux_module_load_symbols(linux_module *module, const char *path) {
+  u64 size = 0;
+  u8 *data = linux_read_file(path, &size);
+  if (!data) {
+    return;
+  }
+
+  const Elf64_Ehdr *header = (const Elf64_Ehdr *)data;
+  if (size < sizeof(Elf64_Ehdr) || memcmp(header->e_ident, ELFMAG, SELFMAG) ||
+      header->e_ident[EI_CLASS] != ELFCLASS64 ||
+      header->e_shoff + (u64)header->e_shnum * sizeof(Elf64_Shdr) > size) {
+    free(data);
+    return;
+  }
+  module->relative = header->e_type == ET_DYN;
+
+  const Elf64_Shdr *sections = (const Elf64_Shdr *)(data + header->e_shoff);
+  const Elf64_Shdr *table = nullptr;
+  for (u32 i = 0; i < header->e_shnum; ++i) {
+    if (sections[i].sh_type == SHT_SYMTAB ||
+        (sections[i].sh_type == SHT_DYNSYM && !table)) {
+      table = &sections[i];
+    }
+  }
+  if (!table || table->sh_link >= header->e_shnum ||
+      table->sh_offset + table->sh_size > size) {
+    free(data);
+    return;
+  }
+  const Elf64_Shdr *strings = &sections[table->sh_link];
+  if (strings->sh_offset + strings->sh_size > size || strings->sh_size == 0) {
+    free(data);
+    return;
+  }
+
+  const Elf64_Sym *symbols = (const Elf64_Sym *)(data + table->sh_offset);
+  u64 count = table->sh_size / sizeof(Elf64_Sym);
+  module->symbols = malloc(sizeof(linux_symbol) * (count ? count : 1));
+  for (u64 i = 0; i < count; ++i) {
+    const Elf64_Sym *symbol = &symbols[i];
+    if (ELF64_ST_TYPE(symbol->st_info) != STT_FUNC ||
+        symbol->st_shndx == SHN_UNDEF || symbol->st_value == 0 ||
+        symbol->st_name >= strings->sh_size) {
+      continue;
+    }
+    module->symbols[module->symbol_count++] = (linux_symbol){
+        .address = symbol->st_value,
+        .size = symbol->st_size,
+        .name = symbol->st_name,
+    };
+  }
+  qsort(module->symbols, module->symbol_count, sizeof(linux_symbol),
+        linux_symbol_compare);
+
+  module->names = malloc(strings->sh_size);
+  memcpy(module->names, data + strings->sh_offset, strings->sh_size);
+  module->names[strings->sh_size - 1] = '\0';
+  free(data);
+}
+
+static linux_module *linux_module_get(const Dl_info *info) {
+  linux_module *module;
+  darray_for_each(sampler.modules, module) {
+    if (module->base == (u64)info->dli_fbase) {
+      return module;
+    }
+  }
+
+  linux_module loaded = {
+      .base = (u64)info->dli_fbase,
+      .path = strdup(info->dli_fname && info->dli_fname[0] ? info->dli_fname
+                                                           : "[unknown]"),
+  };
+  linux_module_load_symbols(&loaded, loaded.path);
+  if (!loaded.symbols && loaded.path[0] != '/') {
+    // dladdr names the main executable by argv[0], which may be relative to
+    // a directory the process has since left, or searched for in PATH.
+    linux_module_load_symbols(&loaded, "/proc/self/exe");
+  }
+  darray_push(&sampler.modules, loaded);
+  return &sampler.modules[darray_length(sampler.modules) - 1];
+}
+
+bool platform_symbolize(u64 address, char *out_name, u64 size) {
+  Dl_info info;
+  if (!dladdr((void *)address, &info) || !info.dli_fbase) {
+    return false;
+  }
+
+  pthread_mutex_lock(&sampler.lock);
+  if (!sampler.modules) {
+    sampler.modules = darray_create(linux_module);
+  }
+  const linux_module *module = linux_module_get(&info);
+  u64 key = module->relative ? address - module->base : address;
+
+  // The last symbol starting at or before the address.
+  const linux_symbol *found = nullptr;
+  u64 low = 0;
+  u64 high = module->symbol_count;
+  while (low < high) {
+    u64 middle = low + (high - low) / 2;
+    if (module->symbols[middle].address <= key) {
+      found = &module->symbols[middle];
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  if (found && key - found->address < (found->size ? found->size : 1)) {
+    snprintf(out_name, size, "%s", module->names + found->name);
+  } else {
+    const char *file = strrchr(module->path, '/');
+    snprintf(out_name, size, "%s+0x%llx", file ? file + 1 : module->path,
+             address - module->base);
+  }
+  pthread_mutex_unlock(&sampler.lock);
+  return true;
+}
@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_PLATFORM
+
 #include "platform/platform_linux_wayland.h"
 #include "core/event.h"
 #include "core/logger.h"
@@ -110,10 +112,10 @@ static void handle_toplevel_configure(void *data,
     state->height = height;
   }
   if (width > 0 && height > 0) {
-    event_context context;
+    event_context context = {};
     context.data.u16[0] = (u16)width;
     context.data.u16[1] = (u16)height;
-    event_fire(EVENT_CODE_RESIZED, nullptr, context);
+    platform_linux_fire_event(EVENT_CODE_RESIZED, context);
   }
 }
 
@@ -136,10 +138,10 @@ static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface,
 
   if (state->xdg_surface_configured) {
     if (state->width > 0 && state->height > 0) {
-      event_context context;
+      event_context context = {};
       context.data.u16[0] = (u16)state->width;
       context.data.u16[1] = (u16)state->height;
-      event_fire(EVENT_CODE_RESIZED, nullptr, context);
+      platform_linux_fire_event(EVENT_CODE_RESIZED, context);
     }
   }
   wl_surface_commit(state->wl_surface);
@@ -538,13 +540,15 @@ void wl_platform_shutdown(void) {
   state_ptr->xkb_context = nullptr;
 }
 
-bool wl_platform_pump_messages(void) {
+bool wl_platform_pump_messages(void) { return wl_platform_wait_messages(0); }
+
+bool wl_platform_wait_messages(i32 timeout_ms) {
   while (state_ptr->fns.wl_display_prepare_read(state_ptr->display) != 0) {
     state_ptr->fns.wl_display_dispatch_pending(state_ptr->display);
   }
   state_ptr->fns.wl_display_flush(state_ptr->display);
 
-  i32 ret = poll(&state_ptr->wl_pollfd, 1, 0);
+  i32 ret = poll(&state_ptr->wl_pollfd, 1, timeout_ms);
   if (ret <= 0) {
     state_ptr->fns.wl_display_cancel_read(state_ptr->display);
   } else {
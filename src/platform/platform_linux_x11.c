@@ -1,4 +1,7 @@
+#define KLOG_CATEGORY LOG_CATEGORY_PLATFORM
+
 #include <dlfcn.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -78,6 +81,8 @@ bool init_xpfns(void) {
                                                           "xcb_destroy_window");
   fns->xcb_poll_for_event = (PFN_xcb_poll_for_event)dlsym(state_ptr->xcb_handle,
                                                           "xcb_poll_for_event");
+  fns->xcb_get_file_descriptor = (PFN_xcb_get_file_descriptor)dlsym(
+      state_ptr->xcb_handle, "xcb_get_file_descriptor");
 
   fns->xkb_x11_get_core_keyboard_device_id =
       (PFN_xkb_x11_get_core_keyboard_device_id)dlsym(
@@ -95,7 +100,8 @@ bool init_xpfns(void) {
       !fns->xcb_create_window || !fns->xcb_change_property ||
       !fns->xcb_intern_atom || !fns->xcb_intern_atom_reply ||
       !fns->xcb_map_window || !fns->xcb_flush || !fns->xcb_destroy_window ||
-      !fns->xcb_poll_for_event || !fns->xkb_keycode_to_keysym ||
+      !fns->xcb_poll_for_event || !fns->xcb_get_file_descriptor ||
+      !fns->xkb_keycode_to_keysym ||
       !fns->xkb_x11_get_core_keyboard_device_id ||
       !fns->xkb_x11_keymap_new_from_device ||
       !fns->xkb_x11_state_new_from_device) {
@@ -241,11 +247,14 @@ void x11_platform_shutdown(void) {
   state_ptr->xcb_handle = nullptr;
 }
 
-bool x11_platform_pump_messages(void) {
+/**
+ * Handles every event already received from the X server.
+ * @returns The number of events handled.
+ */
+static u32 x11_handle_messages(bool *quit_flagged) {
   xcb_generic_event_t *event;
   xcb_client_message_event_t *cm;
-
-  bool quit_flagged = false;
+  u32 count = 0;
 
   do {
     event = state_ptr->fns.xcb_poll_for_event(state_ptr->connection);
@@ -297,17 +306,17 @@ bool x11_platform_pump_messages(void) {
           (xcb_configure_notify_event_t *)event;
 
       (void)configure_event;
-      event_context context;
+      event_context context = {};
       context.data.u16[0] = configure_event->width;
       context.data.u16[1] = configure_event->height;
-      event_fire(EVENT_CODE_RESIZED, nullptr, context);
+      platform_linux_fire_event(EVENT_CODE_RESIZED, context);
     } break;
 
     case XCB_CLIENT_MESSAGE: {
       cm = (xcb_client_message_event_t *)event;
 
       if (cm->data.data32[0] == state_ptr->wm_delete_win) {
-        quit_flagged = true;
+        *quit_flagged = true;
       }
     } break;
     default:
@@ -315,8 +324,30 @@ bool x11_platform_pump_messages(void) {
     }
 
     free(event);
+    count++;
   } while (event != nullptr);
 
+  return count;
+}
+
+bool x11_platform_pump_messages(void) {
+  bool quit_flagged = false;
+  x11_handle_messages(&quit_flagged);
+  return (bool)!quit_flagged;
+}
+
+bool x11_platform_wait_messages(i32 timeout_ms) {
+  bool quit_flagged = false;
+  if (x11_handle_messages(&quit_flagged) == 0 && !quit_flagged) {
+    // Nothing was queued yet; sleep on the connection until the server
+    // sends something, then handle whatever arrived.
+    struct pollfd pfd = {
+        state_ptr->fns.xcb_get_file_descriptor(state_ptr->connection), POLLIN,
+        0};
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+      x11_handle_messages(&quit_flagged);
+    }
+  }
   return (bool)!quit_flagged;
 }
 
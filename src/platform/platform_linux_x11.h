@@ -41,6 +41,7 @@ typedef i32 (*PFN_xcb_flush)(xcb_connection_t *c);
 typedef xcb_void_cookie_t (*PFN_xcb_destroy_window)(xcb_connection_t *c,
                                                     xcb_window_t window);
 typedef xcb_generic_event_t *(*PFN_xcb_poll_for_event)(xcb_connection_t *c);
+typedef i32 (*PFN_xcb_get_file_descriptor)(xcb_connection_t *c);
 typedef KeySym (*PFN_xkb_keycode_to_keysym)(Display *display, KeyCode keycode,
                                             u32 group, u32 level);
 typedef i32 (*PFN_xkb_x11_get_core_keyboard_device_id)(xcb_connection_t *c);
@@ -75,6 +76,7 @@ typedef struct xpfns {
   PFN_xcb_flush xcb_flush;
   PFN_xcb_destroy_window xcb_destroy_window;
   PFN_xcb_poll_for_event xcb_poll_for_event;
+  PFN_xcb_get_file_descriptor xcb_get_file_descriptor;
 
   // xkb_x11 functions
   PFN_xkb_x11_get_core_keyboard_device_id xkb_x11_get_core_keyboard_device_id;
@@ -0,0 +1,148 @@
+#include "platform/platform.h"
+
+/**
+ * Synchronization built on platform_futex_wait and platform_futex_wake, so
+ * Linux and Windows share one implementation and only block in the kernel
+ * when a thread actually has to wait.
+ */
+
+// How many times a contended lock is retried before the thread sleeps. A lock
+// held for a few hundred cycles is cheaper to spin on than to sleep on.
+#define PLATFORM_MUTEX_SPIN_COUNT 100
+
+// Mutex states, after Drepper's "Futexes Are Tricky".
+enum {
+  MUTEX_UNLOCKED = 0,
+  MUTEX_LOCKED = 1,
+  // Locked, and a thread may be asleep waiting for it.
+  MUTEX_CONTENDED = 2,
+};
+
+// Takes the mutex marking it contended, so its unlock wakes another waiter.
+static void mutex_lock_contended(platform_mutex *mutex) {
+  while (katomic_exchange(&mutex->state, MUTEX_CONTENDED, acquire) !=
+         MUTEX_UNLOCKED) {
+    platform_futex_wait(&mutex->state, MUTEX_CONTENDED,
+                        PLATFORM_WAIT_INFINITE);
+  }
+}
+
+void platform_mutex_lock(platform_mutex *mutex) {
+  if (platform_mutex_try_lock(mutex)) {
+    return;
+  }
+  for (u32 i = 0; i < PLATFORM_MUTEX_SPIN_COUNT; ++i) {
+    kcpu_relax();
+    u32 state = katomic_load(&mutex->state, relaxed);
+    if (state == MUTEX_CONTENDED) {
+      // Others are already asleep, queue up behind them.
+      break;
+    }
+    if (state == MUTEX_UNLOCKED && platform_mutex_try_lock(mutex)) {
+      return;
+    }
+  }
+  mutex_lock_contended(mutex);
+}
+
+bool platform_mutex_try_lock(platform_mutex *mutex) {
+  u32 expected = MUTEX_UNLOCKED;
+  return katomic_compare_exchange(&mutex->state, &expected, MUTEX_LOCKED,
+                                  acquire, relaxed);
+}
+
+void platform_mutex_unlock(platform_mutex *mutex) {
+  if (katomic_fetch_sub(&mutex->state, 1, release) != MUTEX_LOCKED) {
+    katomic_store(&mutex->state, MUTEX_UNLOCKED, release);
+    platform_futex_wake(&mutex->state, 1);
+  }
+}
+
+void platform_semaphore_create(u32 initial_count,
+                               platform_semaphore *out_semaphore) {
+  katomic_init(&out_semaphore->count, initial_count);
+  katomic_init(&out_semaphore->waiters, 0);
+}
+
+void platform_semaphore_post(platform_semaphore *semaphore, u32 count) {
+  // Sequentially consistent, paired with the waiter's registration: either
+  // it sees the new count or this sees it waiting.
+  katomic_fetch_add(&semaphore->count, count, seq_cst);
+  if (katomic_load(&semaphore->waiters, seq_cst) > 0) {
+    platform_futex_wake(&semaphore->count, count);
+  }
+}
+
+static bool semaphore_try_take(platform_semaphore *semaphore) {
+  u32 count = katomic_load(&semaphore->count, relaxed);
+  while (count > 0) {
+    if (katomic_compare_exchange_weak(&semaphore->count, &count, count - 1,
+                                      acquire, relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void platform_semaphore_wait(platform_semaphore *semaphore) {
+  platform_semaphore_timed_wait(semaphore, PLATFORM_WAIT_INFINITE);
+}
+
+bool platform_semaphore_timed_wait(platform_semaphore *semaphore,
+                                   u32 timeout_ms) {
+  if (semaphore_try_take(semaphore)) {
+    return true;
+  }
+  if (timeout_ms == 0) {
+    return false;
+  }
+
+  u64 deadline = platform_get_absolute_time_ns() + timeout_ms * 1000000ULL;
+  u32 remaining_ms = timeout_ms;
+  katomic_fetch_add(&semaphore->waiters, 1, seq_cst);
+  bool taken;
+  while (!(taken = semaphore_try_take(semaphore))) {
+    if (katomic_load(&semaphore->count, seq_cst) == 0 &&
+        !platform_futex_wait(&semaphore->count, 0, remaining_ms)) {
+      taken = semaphore_try_take(semaphore);
+      break;
+    }
+    if (timeout_ms != PLATFORM_WAIT_INFINITE) {
+      u64 now = platform_get_absolute_time_ns();
+      if (now >= deadline) {
+        taken = semaphore_try_take(semaphore);
+        break;
+      }
+      // Rounded up so a sub-millisecond remainder still waits.
+      remaining_ms = (u32)((deadline - now + 999999) / 1000000);
+    }
+  }
+  katomic_fetch_sub(&semaphore->waiters, 1, relaxed);
+  return taken;
+}
+
+void platform_condvar_wait(platform_condvar *condvar, platform_mutex *mutex) {
+  platform_condvar_timed_wait(condvar, mutex, PLATFORM_WAIT_INFINITE);
+}
+
+bool platform_condvar_timed_wait(platform_condvar *condvar,
+                                 platform_mutex *mutex, u32 timeout_ms) {
+  // Read under the mutex, so a signal sent after the caller checked its
+  // condition changes the sequence and the futex does not sleep through it.
+  u32 sequence = katomic_load(&condvar->sequence, relaxed);
+  platform_mutex_unlock(mutex);
+  bool woken = platform_futex_wait(&condvar->sequence, sequence, timeout_ms);
+  // Other threads may have been woken with this one and sleep on the mutex.
+  mutex_lock_contended(mutex);
+  return woken;
+}
+
+void platform_condvar_signal(platform_condvar *condvar) {
+  katomic_fetch_add(&condvar->sequence, 1, release);
+  platform_futex_wake(&condvar->sequence, 1);
+}
+
+void platform_condvar_broadcast(platform_condvar *condvar) {
+  katomic_fetch_add(&condvar->sequence, 1, release);
+  platform_futex_wake(&condvar->sequence, PLATFORM_WAKE_ALL);
+}
@@ -1,9 +1,12 @@
+#define KLOG_CATEGORY LOG_CATEGORY_PLATFORM
+
 #if defined(KBUILD_WINDOWS)
 #include "platform/platform.h"
 
 #include "containers/darray.h"
 #include "core/event.h"
 #include "core/input.h"
+#include "core/profiler.h"
 #include <stdlib.h>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_win32.h>
@@ -16,7 +19,6 @@ typedef struct platform_state {
   HWND hwnd;
   VkSurfaceKHR vk_surface;
 
-  f64 clock_frequency;
   LARGE_INTEGER start_time;
 } platform_state;
 
@@ -87,9 +89,6 @@ bool platform_startup(void **plat_state, platform_config config) {
   i32 show_window_command_flags = should_activate ? SW_SHOW : SW_SHOWNOACTIVATE;
   ShowWindow(state_ptr->hwnd, show_window_command_flags);
 
-  LARGE_INTEGER frequency;
-  QueryPerformanceFrequency(&frequency);
-  state_ptr->clock_frequency = 1 / (f64)frequency.QuadPart;
   QueryPerformanceCounter(&state_ptr->start_time);
 
   return true;
@@ -106,7 +105,11 @@ void platform_shutdown() {
   }
 }
 
+// Input is always read on the main thread here.
+void platform_input_thread_stop() {}
+
 bool platform_pump_messages() {
+  KPROFILE_FUNCTION();
   MSG message;
   while (PeekMessageA(&message, nullptr, 0, 0, PM_REMOVE)) {
     TranslateMessage(&message);
@@ -133,17 +136,242 @@ void *platform_set_memory(void *dest, i32 value, u64 size) {
   return memset(dest, value, size);
 }
 
-f64 platform_get_absolute_time() {
-  if (state_ptr) {
-    LARGE_INTEGER now_time;
-    QueryPerformanceCounter(&now_time);
-    return (f64)now_time.QuadPart * state_ptr->clock_frequency;
+u64 platform_get_absolute_time_ns() {
+  // Fixed at boot, so racing first calls store the same value.
+  static LARGE_INTEGER frequency;
+  if (frequency.QuadPart == 0) {
+    QueryPerformanceFrequency(&frequency);
   }
-  return 0.0;
+  LARGE_INTEGER now_time;
+  QueryPerformanceCounter(&now_time);
+  u64 ticks = (u64)now_time.QuadPart;
+  u64 rate = (u64)frequency.QuadPart;
+  return (ticks / rate) * 1000000000ULL +
+         (ticks % rate) * 1000000000ULL / rate;
+}
+
+f64 platform_get_absolute_time() {
+  return (f64)platform_get_absolute_time_ns() * 0.000000001;
 }
 
 void platform_sleep(u32 ms) { Sleep(ms); }
 
+void platform_sleep_ns(u64 ns) {
+  // Sleep only has the granularity of the system timer, 15.6 ms by default.
+  static HANDLE timer;
+  if (!timer) {
+    timer = CreateWaitableTimerExW(nullptr, nullptr,
+                                   CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                   TIMER_ALL_ACCESS);
+  }
+  if (!timer) {
+    Sleep((DWORD)(ns / 1000000));
+    return;
+  }
+  // Relative due times are negative, in 100 ns units.
+  LARGE_INTEGER due = {.QuadPart = -(LONGLONG)(ns / 100)};
+  if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+    WaitForSingleObject(timer, INFINITE);
+  }
+}
+
+typedef struct win32_thread {
+  HANDLE handle;
+  platform_thread_entry entry;
+  void *params;
+} win32_thread;
+
+static DWORD WINAPI win32_thread_main(LPVOID arg) {
+  win32_thread *thread = arg;
+  thread->entry(thread->params);
+  return 0;
+}
+
+bool platform_thread_create(platform_thread_entry entry, void *params,
+                            platform_thread *out_thread) {
+  win32_thread *thread = malloc(sizeof(win32_thread));
+  thread->entry = entry;
+  thread->params = params;
+  thread->handle =
+      CreateThread(nullptr, 0, win32_thread_main, thread, 0, nullptr);
+  if (!thread->handle) {
+    free(thread);
+    out_thread->internal_data = nullptr;
+    return false;
+  }
+  out_thread->internal_data = thread;
+  return true;
+}
+
+void platform_thread_join(platform_thread *thread) {
+  win32_thread *internal = thread->internal_data;
+  if (!internal) {
+    return;
+  }
+  WaitForSingleObject(internal->handle, INFINITE);
+  CloseHandle(internal->handle);
+  free(internal);
+  thread->internal_data = nullptr;
+}
+
+u32 platform_get_processor_count() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+}
+
+u32 platform_get_physical_core_count() {
+  DWORD length = 0;
+  GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+  u8 *buffer = malloc(length);
+  u32 count = 0;
+  if (buffer && GetLogicalProcessorInformationEx(
+                    RelationProcessorCore,
+                    (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)buffer,
+                    &length)) {
+    // One variable-size entry per core.
+    for (DWORD offset = 0; offset < length;) {
+      const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *info =
+          (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(buffer + offset);
+      count++;
+      offset += info->Size;
+    }
+  }
+  free(buffer);
+  return count > 0 ? count : platform_get_processor_count();
+}
+
+void platform_thread_yield() { SwitchToThread(); }
+
+bool platform_futex_wait(katomic u32 *address, u32 expected, u32 timeout_ms) {
+  // INFINITE and PLATFORM_WAIT_INFINITE are both 0xFFFFFFFF.
+  if (WaitOnAddress((volatile void *)address, &expected, sizeof(expected),
+                    timeout_ms)) {
+    return true;
+  }
+  return GetLastError() != ERROR_TIMEOUT;
+}
+
+void platform_futex_wake(katomic u32 *address, u32 count) {
+  if (count == 1) {
+    WakeByAddressSingle((void *)address);
+  } else {
+    WakeByAddressAll((void *)address);
+  }
+}
+
+typedef struct win32_fiber {
+  void *handle;
+  // Whether `handle` is a thread's, which stays the thread's own.
+  bool thread;
+  platform_fiber_entry entry;
+  void *params;
+} win32_fiber;
+
+static void WINAPI win32_fiber_main(void *arg) {
+  win32_fiber *fiber = arg;
+  fiber->entry(fiber->params);
+  kfatal("A fiber returned from its entry function");
+  abort();
+}
+
+bool platform_fiber_create(u64 stack_size, platform_fiber_entry entry,
+                           void *params, platform_fiber *out_fiber) {
+  win32_fiber *fiber = malloc(sizeof(win32_fiber));
+  *fiber = (win32_fiber){.entry = entry, .params = params};
+  // Reserves the stack with a guard page, committing pages as it grows.
+  fiber->handle = CreateFiberEx(0, stack_size, FIBER_FLAG_FLOAT_SWITCH,
+                                win32_fiber_main, fiber);
+  if (!fiber->handle) {
+    free(fiber);
+    out_fiber->internal_data = nullptr;
+    return false;
+  }
+  out_fiber->internal_data = fiber;
+  return true;
+}
+
+bool platform_fiber_from_thread(platform_fiber *out_fiber) {
+  win32_fiber *fiber = malloc(sizeof(win32_fiber));
+  *fiber = (win32_fiber){.thread = true};
+  fiber->handle = ConvertThreadToFiberEx(nullptr, FIBER_FLAG_FLOAT_SWITCH);
+  if (!fiber->handle && GetLastError() == ERROR_ALREADY_FIBER) {
+    fiber->handle = GetCurrentFiber();
+  }
+  if (!fiber->handle) {
+    free(fiber);
+    out_fiber->internal_data = nullptr;
+    return false;
+  }
+  out_fiber->internal_data = fiber;
+  return true;
+}
+
+void platform_fiber_destroy(platform_fiber *fiber) {
+  win32_fiber *internal = fiber->internal_data;
+  if (!internal) {
+    return;
+  }
+  if (!internal->thread) {
+    DeleteFiber(internal->handle);
+  }
+  free(internal);
+  fiber->internal_data = nullptr;
+}
+
+void platform_fiber_switch(platform_fiber *from, platform_fiber *to) {
+  // Windows keeps track of the running fiber itself.
+  (void)from;
+  win32_fiber *to_fiber = to->internal_data;
+  SwitchToFiber(to_fiber->handle);
+}
+
+bool platform_perf_counters_open(platform_perf_counters *out_counters) {
+  // Windows only exposes PMU counters to kernel drivers and ETW sessions.
+  *out_counters = (platform_perf_counters){};
+  return false;
+}
+
+void platform_perf_counters_read(const platform_perf_counters *counters,
+                                 u64 out_values[PROFILE_COUNTER_COUNT]) {
+  (void)counters;
+  platform_zero_memory(out_values, sizeof(u64) * PROFILE_COUNTER_COUNT);
+}
+
+void platform_perf_counters_close(platform_perf_counters *counters) {
+  counters->internal_data = nullptr;
+  counters->available = 0;
+}
+
+bool platform_sampler_initialize(platform_sample_handler handler) {
+  // Would need a thread that suspends the others to read their context.
+  (void)handler;
+  return false;
+}
+
+void platform_sampler_shutdown() {}
+
+bool platform_sample_timer_arm(u32 frequency_hz, void *context,
+                               platform_sample_timer *out_timer) {
+  (void)frequency_hz;
+  (void)context;
+  out_timer->internal_data = nullptr;
+  return false;
+}
+
+void platform_sample_timer_disarm(platform_sample_timer *timer) {
+  timer->internal_data = nullptr;
+}
+
+bool platform_sampler_toggle_requested() { return false; }
+
+bool platform_symbolize(u64 address, char *out_name, u64 size) {
+  (void)address;
+  (void)out_name;
+  (void)size;
+  return false;
+}
+
 void platform_get_required_extension_names(const char ***names) {
   darray_push(names, VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 }
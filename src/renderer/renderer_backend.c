@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_RENDERER
+
 #include "renderer_backend.h"
 #include "core/asserts.h"
 #include "core/logger.h"
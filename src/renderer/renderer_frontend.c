@@ -1,18 +1,31 @@
+#define KLOG_CATEGORY LOG_CATEGORY_RENDERER
+
 #include "renderer_frontend.h"
 
 #include "renderer/renderer_types.h"
 #include "renderer_backend.h"
 
+#include "core/application.h"
 #include "core/kmemory.h"
 #include "core/logger.h"
+#include "core/profiler.h"
 
 static renderer_backend *backend = nullptr;
+// The size the backend was last told about.
+static u16 framebuffer_width = 0;
+static u16 framebuffer_height = 0;
 
 bool renderer_initialize(const char *application_name,
                          struct platform_state *plat_state) {
   backend = kallocate(sizeof(renderer_backend), MEMORY_TAG_RENDERER);
   backend->frame_number = 0;
 
+  u32 width;
+  u32 height;
+  application_get_framebuffer_size(&width, &height);
+  framebuffer_width = (u16)width;
+  framebuffer_height = (u16)height;
+
   if (!renderer_backend_create(RENDERER_BACKEND_TYPE_VULKAN, plat_state,
                                backend)) {
     kfatal("Failed to create renderer backend!");
@@ -28,10 +41,12 @@ bool renderer_initialize(const char *application_name,
 }
 
 bool renderer_begin_frame(f32 delta_time) {
+  KPROFILE_FUNCTION();
   return backend->begin_frame(backend, delta_time);
 }
 
 bool renderer_end_frame(f32 delta_time) {
+  KPROFILE_FUNCTION();
   bool result = backend->end_frame(backend, delta_time);
   backend->frame_number++;
   return result;
@@ -43,7 +58,23 @@ void renderer_shutdown() {
   backend = nullptr;
 }
 
+void renderer_on_resized(u16 width, u16 height) {
+  framebuffer_width = width;
+  framebuffer_height = height;
+  if (backend) {
+    backend->resized(backend, width, height);
+  } else {
+    kwarn("renderer backend does not exist to accept resize: %hu %hu", width,
+          height);
+  }
+}
+
 bool renderer_draw_frame(render_packet *packet) {
+  KPROFILE_FUNCTION();
+  if (packet->width != framebuffer_width ||
+      packet->height != framebuffer_height) {
+    renderer_on_resized(packet->width, packet->height);
+  }
   if (renderer_begin_frame(packet->delta_time)) {
     bool result = renderer_end_frame(packet->delta_time);
 
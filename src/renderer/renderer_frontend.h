@@ -9,6 +9,11 @@ bool renderer_initialize(const char *application_name,
                          struct platform_state *plat_state);
 void renderer_shutdown();
 
+/**
+ * Has the backend draw at a new framebuffer size. Called by
+ * `renderer_draw_frame` when a packet's size differs, so only from the thread
+ * that draws.
+ */
 void renderer_on_resized(u16 width, u16 height);
 
 bool renderer_draw_frame(render_packet *packet);
@@ -0,0 +1,99 @@
+#define KLOG_CATEGORY LOG_CATEGORY_RENDERER
+
+#include "renderer_thread.h"
+
+#include "renderer_frontend.h"
+
+#include "core/logger.h"
+#include "core/profiler.h"
+#include "platform/platform.h"
+
+typedef struct render_slot {
+  render_packet packet;
+  // Set in the slot after the last packet, which stops the thread.
+  bool stop;
+} render_slot;
+
+typedef struct renderer_thread_state {
+  render_slot slots[RENDER_QUEUE_DEPTH];
+  // Counts the slots the main thread can fill, and the ones it has filled.
+  platform_semaphore free_slots;
+  platform_semaphore filled_slots;
+  // Only the main thread moves `head`, only the render thread `tail`.
+  u32 head;
+  u32 tail;
+  // Set by the render thread once a frame failed to draw.
+  katomic bool failed;
+  bool running;
+  platform_thread thread;
+} renderer_thread_state;
+
+static renderer_thread_state state;
+
+static void renderer_thread_main(void *params) {
+  (void)params;
+  KPROFILE_THREAD_NAME("render");
+
+  for (;;) {
+    platform_semaphore_wait(&state.filled_slots);
+    render_slot *slot = &state.slots[state.tail];
+    state.tail = (state.tail + 1) % RENDER_QUEUE_DEPTH;
+    if (slot->stop) {
+      break;
+    }
+
+    // Later frames are still taken, so the main thread never waits on them.
+    if (!katomic_load(&state.failed, relaxed) &&
+        !renderer_draw_frame(&slot->packet)) {
+      katomic_store(&state.failed, true, relaxed);
+    }
+    platform_semaphore_post(&state.free_slots, 1);
+  }
+}
+
+// Waits for a free slot and returns it, to be published with
+// `renderer_thread_publish`.
+static render_slot *renderer_thread_reserve() {
+  KPROFILE_SCOPE("render_queue_wait");
+  platform_semaphore_wait(&state.free_slots);
+  return &state.slots[state.head];
+}
+
+static void renderer_thread_publish() {
+  state.head = (state.head + 1) % RENDER_QUEUE_DEPTH;
+  platform_semaphore_post(&state.filled_slots, 1);
+}
+
+bool renderer_thread_start() {
+  state = (renderer_thread_state){};
+  platform_semaphore_create(RENDER_QUEUE_DEPTH, &state.free_slots);
+  platform_semaphore_create(0, &state.filled_slots);
+  if (!platform_thread_create(renderer_thread_main, nullptr, &state.thread)) {
+    kwarn("Failed to start the render thread, drawing on the main thread");
+    return false;
+  }
+  state.running = true;
+  kinfo("Render thread started, %u frame(s) of pipelining",
+        RENDER_QUEUE_DEPTH);
+  return true;
+}
+
+void renderer_thread_stop() {
+  if (!state.running) {
+    return;
+  }
+  render_slot *slot = renderer_thread_reserve();
+  slot->stop = true;
+  renderer_thread_publish();
+  platform_thread_join(&state.thread);
+  state.running = false;
+}
+
+bool renderer_thread_submit(const render_packet *packet) {
+  KPROFILE_FUNCTION();
+  render_slot *slot = renderer_thread_reserve();
+  *slot = (render_slot){.packet = *packet};
+  renderer_thread_publish();
+  // A failure is seen by the submission after the failed frame.
+  return !katomic_load(&state.failed, relaxed);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "renderer_types.h"
+
+/**
+ * Draws frames on a dedicated thread, so that recording and submitting the
+ * commands of frame N overlaps the update of frame N+1 on the main thread.
+ *
+ * Packets are handed over through a queue of RENDER_QUEUE_DEPTH slots. The
+ * main thread fills a free slot in `renderer_thread_submit`, after which the
+ * render thread owns it: it draws straight from the slot and only frees it
+ * once the frame has been submitted, so the packet never changes while it is
+ * drawn. A full queue blocks the main thread, which therefore never gets
+ * more than RENDER_QUEUE_DEPTH frames ahead of the renderer.
+ *
+ * While the thread runs, only it calls into the renderer.
+ */
+
+// Frames the main thread can hand over before waiting for the renderer. 1 is
+// one frame of latency; more smooths out uneven frames at the cost of more.
+#define RENDER_QUEUE_DEPTH 1
+
+/**
+ * Starts the render thread, for a renderer that is already initialized.
+ * @returns `false` if the thread could not be started, in which case frames
+ * are to be drawn on the main thread.
+ */
+bool renderer_thread_start();
+
+/**
+ * Draws the frames still queued and stops the render thread, after which the
+ * renderer can be shut down.
+ */
+void renderer_thread_stop();
+
+/**
+ * Queues a copy of `packet` to be drawn, waiting for a free slot first.
+ * @returns `false` once a frame failed to draw, after which the packets
+ * queued are dropped.
+ */
+bool renderer_thread_submit(const render_packet *packet);
@@ -25,6 +25,16 @@ typedef struct renderer_backend {
   bool (*end_frame)(struct renderer_backend *backend, f32 delta_time);
 } renderer_backend;
 
+/**
+ * What the renderer needs to draw a frame, captured by the main thread once
+ * the frame's update is done. With a render thread it is drawn while the
+ * main thread already updates the next frame, so it must hold copies of the
+ * data it refers to rather than pointers into state the update changes.
+ */
 typedef struct render_packet {
   f32 delta_time;
+  // Size of the framebuffer to draw at. The renderer is resized when it
+  // changes.
+  u16 width;
+  u16 height;
 } render_packet;
@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_VULKAN
+
 #include "vulkan_backend.h"
 
 #include "containers/darray.h"
@@ -11,12 +13,16 @@
 #include "vulkan_device.h"
 #include "vulkan_fence.h"
 #include "vulkan_framebuffer.h"
+#include "vulkan_gpu_profiler.h"
 #include "vulkan_platform.h"
 #include "vulkan_render_pass.h"
 #include "vulkan_swapchain.h"
 #include "vulkan_types.h"
 
 static vulkan_context context;
+// The last size the window reported, pending while the framebuffer size
+// generation is ahead of the swapchain's. Either dimension may be 0 while
+// the window is minimized.
 static u32 cached_framebuffer_width = 0;
 static u32 cached_framebuffer_height = 0;
 
@@ -35,6 +41,7 @@ void regenerate_framebuffers(vulkan_swapchain *swapchain,
                              vulkan_render_pass *render_pass);
 void initialize_sync_objects();
 void destroy_sync_objects();
+bool recreate_swapchain();
 
 bool vulkan_renderer_backend_initialize(struct renderer_backend *backend,
                                         const char *application_name,
@@ -195,6 +202,10 @@ bool vulkan_renderer_backend_initialize(struct renderer_backend *backend,
 
   initialize_sync_objects();
 
+#if defined(KPROFILE_ENABLED)
+  vulkan_gpu_profiler_create(&context);
+#endif
+
   kinfo("Vulkan renderer initialized :)");
   return true;
 }
@@ -203,6 +214,9 @@ void vulkan_renderer_backend_shutdown(struct renderer_backend *backend) {
   (void)backend;
   vkDeviceWaitIdle(context.device.logical_device);
 
+#if defined(KPROFILE_ENABLED)
+  vulkan_gpu_profiler_destroy(&context);
+#endif
   destroy_sync_objects();
   free_command_buffers();
 
@@ -248,14 +262,62 @@ void vulkan_renderer_backend_shutdown(struct renderer_backend *backend) {
 void vulkan_renderer_backend_resized(struct renderer_backend *backend,
                                      u16 width, u16 height) {
   (void)backend;
-  (void)width;
-  (void)height;
+  // Applied when the swapchain is recreated, at the start of a frame.
+  cached_framebuffer_width = width;
+  cached_framebuffer_height = height;
+  context.framebuffer_size_generation++;
+  kinfo("Vulkan renderer backend resized: %hu x %hu (generation %llu)", width,
+        height, context.framebuffer_size_generation);
 }
 
 bool vulkan_renderer_backend_begin_frame(struct renderer_backend *backend,
                                          f32 delta_time) {
   (void)backend;
   (void)delta_time;
+
+  if (context.framebuffer_size_generation !=
+      context.framebuffer_size_last_generation) {
+    // Drawn at the new size from the next frame on.
+    recreate_swapchain();
+    return false;
+  }
+
+  if (!vulkan_fence_wait(&context,
+                         &context.in_flight_fences[context.current_frame],
+                         UINT64_MAX)) {
+    kwarn("In-flight fence wait failure!");
+    return false;
+  }
+
+  if (!vulkan_swapchain_acquire_next_image_index(
+          &context, &context.swapchain, UINT64_MAX,
+          context.image_available_semaphores[context.current_frame],
+          VK_NULL_HANDLE, &context.image_index)) {
+    recreate_swapchain();
+    return false;
+  }
+
+  vulkan_command_buffer *command_buffer =
+      &context.graphics_command_buffers[context.image_index];
+  vulkan_command_buffer_reset(command_buffer);
+  vulkan_command_buffer_begin(command_buffer, false, false, false);
+
+#if defined(KPROFILE_ENABLED)
+  vulkan_gpu_profiler_begin_frame(&context, command_buffer);
+  context.gpu_frame_zone =
+      vulkan_gpu_zone_begin(&context, command_buffer, "gpu_frame");
+#endif
+
+  context.main_render_pass.w = context.framebuffer_width;
+  context.main_render_pass.h = context.framebuffer_height;
+  vulkan_render_pass_begin(
+      command_buffer, &context.main_render_pass,
+      context.swapchain.framebuffers[context.image_index].handle);
+#if defined(KPROFILE_ENABLED)
+  context.gpu_render_pass_zone =
+      vulkan_gpu_zone_begin(&context, command_buffer, "main_render_pass");
+#endif
+
   return true;
 }
 
@@ -263,10 +325,65 @@ bool vulkan_renderer_backend_end_frame(struct renderer_backend *backend,
                                        f32 delta_time) {
   (void)backend;
   (void)delta_time;
+
+  vulkan_command_buffer *command_buffer =
+      &context.graphics_command_buffers[context.image_index];
+
+#if defined(KPROFILE_ENABLED)
+  vulkan_gpu_zone_end(&context, command_buffer, context.gpu_render_pass_zone);
+#endif
+  vulkan_render_pass_end(command_buffer, &context.main_render_pass);
+#if defined(KPROFILE_ENABLED)
+  vulkan_gpu_zone_end(&context, command_buffer, context.gpu_frame_zone);
+#endif
+  vulkan_command_buffer_end(command_buffer);
+
+  // The image may still be in use by an earlier frame in flight.
+  if (context.images_in_flight[context.image_index]) {
+    vulkan_fence_wait(&context, context.images_in_flight[context.image_index],
+                      UINT64_MAX);
+  }
+  context.images_in_flight[context.image_index] =
+      &context.in_flight_fences[context.current_frame];
+  vulkan_fence_reset(&context, &context.in_flight_fences[context.current_frame]);
+
+  VkPipelineStageFlags wait_stage =
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &command_buffer->handle,
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores =
+          &context.image_available_semaphores[context.current_frame],
+      .pWaitDstStageMask = &wait_stage,
+      .signalSemaphoreCount = 1,
+      .pSignalSemaphores =
+          &context.queue_complete_semaphores[context.current_frame],
+  };
+  VkResult result =
+      vkQueueSubmit(context.device.graphics_queue, 1, &submit_info,
+                    context.in_flight_fences[context.current_frame].handle);
+  if (result != VK_SUCCESS) {
+    kerror("vkQueueSubmit failed with result %d", result);
+    return false;
+  }
+  vulkan_command_buffer_update_submitted(command_buffer);
+
+  if (!vulkan_swapchain_present(
+          &context, &context.swapchain, context.device.graphics_queue,
+          context.device.present_queue,
+          context.queue_complete_semaphores[context.current_frame],
+          context.image_index)) {
+    recreate_swapchain();
+  }
+
   return true;
 }
 
 #if defined(_DEBUG)
+#define VK_DEBUG_MESSAGES_PER_SECOND 20
+
 VKAPI_ATTR VkBool32 VKAPI_CALL
 vk_debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
                   VkDebugUtilsMessageTypeFlagsEXT message_types,
@@ -306,19 +423,24 @@ vk_debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT message_severity,
     message = " %s";
   }
 
+  // Layers can report the same problem every frame.
   switch (message_severity) {
   default:
   case VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT:
-    kerror(message, callback_data->pMessage);
+    kerror_limited(VK_DEBUG_MESSAGES_PER_SECOND, message,
+                   callback_data->pMessage);
     break;
   case VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT:
-    kwarn(message, callback_data->pMessage);
+    kwarn_limited(VK_DEBUG_MESSAGES_PER_SECOND, message,
+                  callback_data->pMessage);
     break;
   case VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT:
-    kinfo(message, callback_data->pMessage);
+    kinfo_limited(VK_DEBUG_MESSAGES_PER_SECOND, message,
+                  callback_data->pMessage);
     break;
   case VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT:
-    ktrace(message, callback_data->pMessage);
+    ktrace_limited(VK_DEBUG_MESSAGES_PER_SECOND, message,
+                   callback_data->pMessage);
     break;
   }
 
@@ -442,3 +564,53 @@ void destroy_sync_objects() {
   darray_destroy(context.queue_complete_semaphores);
   darray_destroy(context.in_flight_fences);
 }
+
+/**
+ * Recreates the swapchain at the latest framebuffer size, with the depth
+ * attachment and framebuffers that refer to its images. Waits for the device
+ * to go idle first, since frames in flight still use them.
+ * @returns `false` if it was skipped, such as while the window is minimized.
+ */
+bool recreate_swapchain() {
+  if (context.recreating_swapchain) {
+    kdebug("recreate_swapchain called when already recreating");
+    return false;
+  }
+
+  if (context.framebuffer_size_generation !=
+      context.framebuffer_size_last_generation) {
+    context.framebuffer_width = cached_framebuffer_width;
+    context.framebuffer_height = cached_framebuffer_height;
+  }
+  if (context.framebuffer_width == 0 || context.framebuffer_height == 0) {
+    // The resize stays pending, so frames are skipped until the window is
+    // restored and reports a usable size.
+    kdebug("recreate_swapchain skipped, a dimension is 0");
+    return false;
+  }
+
+  context.recreating_swapchain = true;
+  vkDeviceWaitIdle(context.device.logical_device);
+
+  for (u32 i = 0; i < context.swapchain.image_count; ++i) {
+    context.images_in_flight[i] = nullptr;
+  }
+
+  vulkan_swapchain_recreate(&context, context.framebuffer_width,
+                            context.framebuffer_height, &context.swapchain);
+  context.framebuffer_width = context.swapchain.extent.width;
+  context.framebuffer_height = context.swapchain.extent.height;
+  context.framebuffer_size_last_generation =
+      context.framebuffer_size_generation;
+
+  for (u32 i = 0; i < context.swapchain.image_count; ++i) {
+    vulkan_framebuffer_destroy(&context, &context.swapchain.framebuffers[i]);
+  }
+  regenerate_framebuffers(&context.swapchain, &context.main_render_pass);
+
+  // Recorded against the old framebuffers.
+  create_command_buffers();
+
+  context.recreating_swapchain = false;
+  return true;
+}
@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_VULKAN
+
 #include "vulkan_command_buffer.h"
 
 void vulkan_command_buffer_allocate(vulkan_context *context, VkCommandPool pool,
@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_VULKAN
+
 #include "vulkan_device.h"
 #include "containers/darray.h"
 #include "core/kmemory.h"
@@ -33,6 +35,31 @@ bool physical_device_meets_requirements(
     vulkan_physical_device_queue_family_info *out_queue_family_info,
     vulkan_swapchain_support_info *out_swapchain_support);
 
+#if defined(KPROFILE_ENABLED)
+static bool device_supports_extension(VkPhysicalDevice device,
+                                      const char *name) {
+  u32 extension_count = 0;
+  VK_CHECK(vkEnumerateDeviceExtensionProperties(device, nullptr,
+                                                &extension_count, nullptr));
+  VkExtensionProperties *extensions =
+      darray_with_capacity(VkExtensionProperties, extension_count);
+  VK_CHECK(vkEnumerateDeviceExtensionProperties(device, nullptr,
+                                                &extension_count, extensions));
+  darray_length_set(extensions, extension_count);
+
+  bool found = false;
+  VkExtensionProperties *extension;
+  darray_for_each(extensions, extension) {
+    if (strings_equal(name, extension->extensionName)) {
+      found = true;
+      break;
+    }
+  }
+  darray_destroy(extensions);
+  return found;
+}
+#endif
+
 bool vulkan_device_create(vulkan_context *context) {
   if (!select_physical_device(context)) {
     return false;
@@ -85,15 +112,26 @@ bool vulkan_device_create(vulkan_context *context) {
       .samplerAnisotropy = VK_TRUE,
   };
 
-  const char *extension_names = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+  const char *extension_names[2] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  u32 extension_count = 1;
+#if defined(KPROFILE_ENABLED)
+  // Lets the GPU profiler pair GPU and CPU clocks without stalling.
+  context->device.calibrated_timestamps =
+      device_supports_extension(context->device.physical_device,
+                                VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+  if (context->device.calibrated_timestamps) {
+    extension_names[extension_count++] =
+        VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+  }
+#endif
 
   VkDeviceCreateInfo device_create_info = {
       .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
       .queueCreateInfoCount = index_count,
       .pQueueCreateInfos = queue_create_infos,
       .pEnabledFeatures = &device_features,
-      .enabledExtensionCount = 1,
-      .ppEnabledExtensionNames = &extension_names,
+      .enabledExtensionCount = extension_count,
+      .ppEnabledExtensionNames = extension_names,
       .enabledLayerCount = 0,
       .ppEnabledLayerNames = nullptr,
   };
@@ -247,73 +285,81 @@ bool select_physical_device(vulkan_context *context) {
               &VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
   VkPhysicalDevice *current_device;
-  kinfo("Checking requiremnets");
-  darray_for_each(physical_devices, current_device) {
-    VkPhysicalDeviceProperties properties;
-    vkGetPhysicalDeviceProperties(*current_device, &properties);
-
-    VkPhysicalDeviceFeatures features;
-    vkGetPhysicalDeviceFeatures(*current_device, &features);
-
-    VkPhysicalDeviceMemoryProperties memory;
-    vkGetPhysicalDeviceMemoryProperties(*current_device, &memory);
-
-    vulkan_physical_device_queue_family_info queue_info = {};
-    bool result = physical_device_meets_requirements(
-        *current_device, context->surface, &properties, &features,
-        &requirements, &queue_info, &context->device.swapchain_support);
-
-    if (result) {
-      kinfo("Selected device: '%s'.", properties.deviceName);
-      switch (properties.deviceType) {
-      default:
-      case VK_PHYSICAL_DEVICE_TYPE_OTHER:
-        kinfo("GPU type is Unknown.");
-        break;
-      case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
-        kinfo("GPU type is Integrated.");
-        break;
-      case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
-        kinfo("GPU type is Discrete.");
-        break;
-      case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
-        kinfo("GPU type is Virtual.");
-        break;
-      case VK_PHYSICAL_DEVICE_TYPE_CPU:
-        kinfo("GPU type is CPU.");
-        break;
-      }
-
-      kinfo("GPU Driver version: %d.%d.%d",
-            VK_VERSION_MAJOR(properties.driverVersion),
-            VK_VERSION_MINOR(properties.driverVersion),
-            VK_VERSION_PATCH(properties.driverVersion));
-      kinfo("Vulkan API version: %d.%d.%d",
-            VK_VERSION_MAJOR(properties.apiVersion),
-            VK_VERSION_MINOR(properties.apiVersion),
-            VK_VERSION_PATCH(properties.apiVersion));
-
-      for (u32 j = 0; j < memory.memoryHeapCount; ++j) {
-        f32 memory_size_gib =
-            (((f32)memory.memoryHeaps[j].size) / 1024.0F / 1024.0F / 1024.0F);
-        if (memory.memoryHeaps[j].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
-          kinfo("Local GPU memory: %.2f GiB", memory_size_gib);
-        } else {
-          kinfo("Shared system memory: %.2f GiB", memory_size_gib);
+  // A CPU implementation such as lavapipe is only picked when there is no
+  // discrete GPU, e.g. for testing.
+  for (u32 attempt = 0; attempt < 2; ++attempt) {
+    requirements.discrete_gpu = attempt == 0;
+    if (!requirements.discrete_gpu) {
+      kinfo("No discrete GPU meets the requirements, trying other devices");
+    }
+    kinfo("Checking requiremnets");
+    darray_for_each(physical_devices, current_device) {
+      VkPhysicalDeviceProperties properties;
+      vkGetPhysicalDeviceProperties(*current_device, &properties);
+
+      VkPhysicalDeviceFeatures features;
+      vkGetPhysicalDeviceFeatures(*current_device, &features);
+
+      VkPhysicalDeviceMemoryProperties memory;
+      vkGetPhysicalDeviceMemoryProperties(*current_device, &memory);
+
+      vulkan_physical_device_queue_family_info queue_info = {};
+      bool result = physical_device_meets_requirements(
+          *current_device, context->surface, &properties, &features,
+          &requirements, &queue_info, &context->device.swapchain_support);
+
+      if (result) {
+        kinfo("Selected device: '%s'.", properties.deviceName);
+        switch (properties.deviceType) {
+        default:
+        case VK_PHYSICAL_DEVICE_TYPE_OTHER:
+          kinfo("GPU type is Unknown.");
+          break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+          kinfo("GPU type is Integrated.");
+          break;
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+          kinfo("GPU type is Discrete.");
+          break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+          kinfo("GPU type is Virtual.");
+          break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:
+          kinfo("GPU type is CPU.");
+          break;
         }
-      }
 
-      context->device.physical_device = *current_device;
-      context->device.graphics_queue_index = queue_info.graphics_family_index;
-      context->device.present_queue_index = queue_info.present_family_index;
-      context->device.transfer_queue_index = queue_info.transfer_family_index;
+        kinfo("GPU Driver version: %d.%d.%d",
+              VK_VERSION_MAJOR(properties.driverVersion),
+              VK_VERSION_MINOR(properties.driverVersion),
+              VK_VERSION_PATCH(properties.driverVersion));
+        kinfo("Vulkan API version: %d.%d.%d",
+              VK_VERSION_MAJOR(properties.apiVersion),
+              VK_VERSION_MINOR(properties.apiVersion),
+              VK_VERSION_PATCH(properties.apiVersion));
+
+        for (u32 j = 0; j < memory.memoryHeapCount; ++j) {
+          f32 memory_size_gib =
+              (((f32)memory.memoryHeaps[j].size) / 1024.0F / 1024.0F / 1024.0F);
+          if (memory.memoryHeaps[j].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            kinfo("Local GPU memory: %.2f GiB", memory_size_gib);
+          } else {
+            kinfo("Shared system memory: %.2f GiB", memory_size_gib);
+          }
+        }
 
-      context->device.properties = properties;
-      context->device.features = features;
-      context->device.memory = memory;
-      darray_destroy(physical_devices);
-      darray_destroy(requirements.device_extension_names);
-      return true;
+        context->device.physical_device = *current_device;
+        context->device.graphics_queue_index = queue_info.graphics_family_index;
+        context->device.present_queue_index = queue_info.present_family_index;
+        context->device.transfer_queue_index = queue_info.transfer_family_index;
+
+        context->device.properties = properties;
+        context->device.features = features;
+        context->device.memory = memory;
+        darray_destroy(physical_devices);
+        darray_destroy(requirements.device_extension_names);
+        return true;
+      }
     }
   }
   kerror("No physical devices found which meet the requirements");
@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_VULKAN
+
 #include "vulkan_fence.h"
 #include "core/logger.h"
 
@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_VULKAN
+
 #include "vulkan_framebuffer.h"
 #include "core/kmemory.h"
 
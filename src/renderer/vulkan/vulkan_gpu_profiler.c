@@ -0,0 +1,255 @@
+#define KLOG_CATEGORY LOG_CATEGORY_VULKAN
+
+#include "vulkan_gpu_profiler.h"
+
+#if defined(KPROFILE_ENABLED)
+
+#include "core/logger.h"
+#include "platform/platform.h"
+#include "vulkan_command_buffer.h"
+
+#include <stdint.h>
+
+#define VULKAN_GPU_QUERY_COUNT (VULKAN_GPU_ZONES_PER_FRAME * 2)
+
+// How often the clocks are paired again, to follow drift between them.
+#define VULKAN_GPU_CALIBRATION_INTERVAL_NS 1000000000ULL
+
+/**
+ * Pairs a GPU timestamp with the CPU time it was taken at. With
+ * VK_EXT_calibrated_timestamps, the device clock is read directly between
+ * two CPU readings. Otherwise a timestamp is written by an otherwise empty
+ * submission that is waited on, which stalls and is off by up to the
+ * submission's latency, so it is only done once.
+ */
+static bool vulkan_gpu_profiler_calibrate(vulkan_context *context) {
+  vulkan_gpu_profiler *profiler = &context->gpu_profiler;
+  VkDevice device = context->device.logical_device;
+
+  if (profiler->get_calibrated_timestamps) {
+    VkCalibratedTimestampInfoEXT info = {
+        .sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT,
+        .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT,
+    };
+    // Vulkan's uint64_t is not u64's unsigned long long on LP64.
+    uint64_t ticks;
+    uint64_t max_deviation;
+    u64 before = platform_get_absolute_time_ns();
+    VkResult result = profiler->get_calibrated_timestamps(
+        device, 1, &info, &ticks, &max_deviation);
+    u64 after = platform_get_absolute_time_ns();
+    if (result == VK_SUCCESS) {
+      profiler->calibration_ticks = ticks & profiler->timestamp_mask;
+      profiler->calibration_ns = before + (after - before) / 2;
+      profiler->next_calibration_ns =
+          after + VULKAN_GPU_CALIBRATION_INTERVAL_NS;
+      return true;
+    }
+    kwarn("vkGetCalibratedTimestampsEXT failed, calibrating GPU timestamps "
+          "once by submission");
+    profiler->get_calibrated_timestamps = nullptr;
+  }
+
+  VkQueryPool query_pool = profiler->frames[0].query_pool;
+  vulkan_command_buffer command_buffer;
+  vulkan_command_buffer_allocate_and_begin_single_use(
+      context, context->device.graphics_command_pool, &command_buffer);
+  vkCmdResetQueryPool(command_buffer.handle, query_pool, 0, 1);
+  vkCmdWriteTimestamp(command_buffer.handle, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      query_pool, 0);
+  u64 before = platform_get_absolute_time_ns();
+  vulkan_command_buffer_end_single_use(context,
+                                       context->device.graphics_command_pool,
+                                       &command_buffer,
+                                       context->device.graphics_queue);
+  u64 after = platform_get_absolute_time_ns();
+
+  u64 ticks;
+  VkResult result = vkGetQueryPoolResults(
+      device, query_pool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+  if (result != VK_SUCCESS) {
+    return false;
+  }
+  profiler->calibration_ticks = ticks & profiler->timestamp_mask;
+  profiler->calibration_ns = before + (after - before) / 2;
+  profiler->next_calibration_ns = UINT64_MAX;
+  return true;
+}
+
+void vulkan_gpu_profiler_create(vulkan_context *context) {
+  vulkan_gpu_profiler *profiler = &context->gpu_profiler;
+  *profiler = (vulkan_gpu_profiler){};
+
+  u32 family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(context->device.physical_device,
+                                           &family_count, nullptr);
+  VkQueueFamilyProperties families[family_count];
+  vkGetPhysicalDeviceQueueFamilyProperties(context->device.physical_device,
+                                           &family_count, families);
+  u32 valid_bits =
+      families[context->device.graphics_queue_index].timestampValidBits;
+  if (valid_bits == 0) {
+    kinfo("The graphics queue has no timestamps, GPU zones are not timed");
+    return;
+  }
+  kassert(context->swapchain.max_frames_in_flight <=
+          VULKAN_GPU_PROFILER_MAX_FRAMES);
+
+  profiler->timestamp_period =
+      context->device.properties.limits.timestampPeriod;
+  profiler->timestamp_mask =
+      valid_bits >= 64 ? UINT64_MAX : (1ULL << valid_bits) - 1;
+
+  VkQueryPoolCreateInfo query_pool_create_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = VULKAN_GPU_QUERY_COUNT,
+  };
+  for (u8 i = 0; i < context->swapchain.max_frames_in_flight; ++i) {
+    VK_CHECK(vkCreateQueryPool(context->device.logical_device,
+                               &query_pool_create_info, context->allocator,
+                               &profiler->frames[i].query_pool));
+  }
+
+  if (context->device.calibrated_timestamps) {
+    profiler->get_calibrated_timestamps =
+        (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(
+            context->device.logical_device, "vkGetCalibratedTimestampsEXT");
+  }
+  if (!vulkan_gpu_profiler_calibrate(context)) {
+    kwarn("Could not calibrate GPU timestamps, GPU zones are not timed");
+    vulkan_gpu_profiler_destroy(context);
+    return;
+  }
+
+  profiler->track = profiler_track_create("GPU");
+  profiler->supported = true;
+  kdebug("GPU zones timed at %.3f ns per tick, calibrated %s",
+         profiler->timestamp_period,
+         profiler->get_calibrated_timestamps ? "with VK_EXT_calibrated_timestamps"
+                                             : "by submission");
+}
+
+void vulkan_gpu_profiler_destroy(vulkan_context *context) {
+  vulkan_gpu_profiler *profiler = &context->gpu_profiler;
+  for (u32 i = 0; i < VULKAN_GPU_PROFILER_MAX_FRAMES; ++i) {
+    if (profiler->frames[i].query_pool) {
+      vkDestroyQueryPool(context->device.logical_device,
+                         profiler->frames[i].query_pool, context->allocator);
+      profiler->frames[i].query_pool = VK_NULL_HANDLE;
+    }
+  }
+  profiler->supported = false;
+}
+
+// Maps a GPU timestamp onto the platform_get_absolute_time_ns timeline.
+static u64 vulkan_gpu_ticks_to_ns(const vulkan_gpu_profiler *profiler,
+                                  u64 ticks) {
+  u64 mask = profiler->timestamp_mask;
+  u64 delta = (ticks - profiler->calibration_ticks) & mask;
+  // Timestamps from before the calibration wrap around to the top half.
+  f64 signed_delta =
+      delta > (mask >> 1) ? -(f64)((mask - delta) + 1) : (f64)delta;
+  return profiler->calibration_ns +
+         (i64)(signed_delta * profiler->timestamp_period);
+}
+
+// Merges the zones of a frame whose fence has signaled into the profiler.
+static void vulkan_gpu_profiler_collect(vulkan_context *context,
+                                        vulkan_gpu_frame *frame) {
+  vulkan_gpu_profiler *profiler = &context->gpu_profiler;
+  // Each query's value followed by its availability.
+  u64 results[VULKAN_GPU_QUERY_COUNT][2];
+  u32 query_count = frame->zone_count * 2;
+  VkResult result = vkGetQueryPoolResults(
+      context->device.logical_device, frame->query_pool, 0, query_count,
+      sizeof(results), results, sizeof(results[0]),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  if (result != VK_SUCCESS && result != VK_NOT_READY) {
+    return;
+  }
+
+  for (u32 i = 0; i < frame->zone_count; ++i) {
+    const vulkan_gpu_zone *zone = &frame->zones[i];
+    const u64 *start = results[i * 2];
+    const u64 *end = results[i * 2 + 1];
+    if (!zone->ended || !start[1] || !end[1]) {
+      continue;
+    }
+    profiler_track_record(
+        profiler->track, zone->name,
+        vulkan_gpu_ticks_to_ns(profiler, start[0] & profiler->timestamp_mask),
+        vulkan_gpu_ticks_to_ns(profiler, end[0] & profiler->timestamp_mask),
+        zone->depth);
+  }
+}
+
+void vulkan_gpu_profiler_begin_frame(vulkan_context *context,
+                                     vulkan_command_buffer *command_buffer) {
+  vulkan_gpu_profiler *profiler = &context->gpu_profiler;
+  if (!profiler->supported) {
+    return;
+  }
+
+  vulkan_gpu_frame *frame = &profiler->frames[context->current_frame];
+  if (frame->zone_count > 0) {
+    vulkan_gpu_profiler_collect(context, frame);
+  }
+  if (platform_get_absolute_time_ns() >= profiler->next_calibration_ns) {
+    vulkan_gpu_profiler_calibrate(context);
+  }
+
+  vkCmdResetQueryPool(command_buffer->handle, frame->query_pool, 0,
+                      VULKAN_GPU_QUERY_COUNT);
+  frame->zone_count = 0;
+  frame->depth = 0;
+}
+
+u32 vulkan_gpu_zone_begin(vulkan_context *context,
+                          vulkan_command_buffer *command_buffer,
+                          const char *name) {
+  vulkan_gpu_profiler *profiler = &context->gpu_profiler;
+  if (!profiler->supported) {
+    return VULKAN_GPU_ZONE_NONE;
+  }
+
+  vulkan_gpu_frame *frame = &profiler->frames[context->current_frame];
+  if (frame->zone_count == VULKAN_GPU_ZONES_PER_FRAME) {
+    kwarn_limited(1, "More than %u GPU zones in a frame, `%s` is not timed",
+                  VULKAN_GPU_ZONES_PER_FRAME, name);
+    return VULKAN_GPU_ZONE_NONE;
+  }
+
+  u32 zone = frame->zone_count++;
+  frame->zones[zone] = (vulkan_gpu_zone){
+      .name = name,
+      .depth = frame->depth++,
+      .ended = false,
+  };
+  vkCmdWriteTimestamp(command_buffer->handle,
+                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame->query_pool,
+                      zone * 2);
+  return zone;
+}
+
+void vulkan_gpu_zone_end(vulkan_context *context,
+                         vulkan_command_buffer *command_buffer, u32 zone) {
+  if (zone == VULKAN_GPU_ZONE_NONE) {
+    return;
+  }
+
+  vulkan_gpu_frame *frame =
+      &context->gpu_profiler.frames[context->current_frame];
+  frame->depth--;
+  frame->zones[zone].ended = true;
+  vkCmdWriteTimestamp(command_buffer->handle,
+                      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame->query_pool,
+                      zone * 2 + 1);
+}
+
+void vulkan_gpu_scope_end(vulkan_gpu_scope *scope) {
+  vulkan_gpu_zone_end(scope->context, scope->command_buffer, scope->zone);
+}
+
+#endif
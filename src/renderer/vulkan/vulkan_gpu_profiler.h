@@ -0,0 +1,62 @@
+#pragma once
+
+#include "vulkan_types.h"
+
+#if defined(KPROFILE_ENABLED)
+
+// Returned for zones that are not timed, e.g. past VULKAN_GPU_ZONES_PER_FRAME.
+#define VULKAN_GPU_ZONE_NONE UINT32_MAX
+
+/**
+ * Creates a timestamp query pool per frame in flight and calibrates the GPU
+ * clock against the CPU's. Leaves GPU zones untimed if the graphics queue
+ * does not support timestamps.
+ */
+void vulkan_gpu_profiler_create(vulkan_context *context);
+
+void vulkan_gpu_profiler_destroy(vulkan_context *context);
+
+/**
+ * Starts the current frame's zones. Must be called once its in-flight fence
+ * has signaled, right after its command buffer began recording and outside a
+ * render pass. Merges the zones the frame recorded the last time around into
+ * the profiler, then resets its queries.
+ */
+void vulkan_gpu_profiler_begin_frame(vulkan_context *context,
+                                     vulkan_command_buffer *command_buffer);
+
+/**
+ * Opens a GPU zone in the current frame's command buffer.
+ * @param name Must live until the profile is exported.
+ * @returns The zone to pass to `vulkan_gpu_zone_end`.
+ */
+u32 vulkan_gpu_zone_begin(vulkan_context *context,
+                          vulkan_command_buffer *command_buffer,
+                          const char *name);
+
+void vulkan_gpu_zone_end(vulkan_context *context,
+                         vulkan_command_buffer *command_buffer, u32 zone);
+
+typedef struct vulkan_gpu_scope {
+  vulkan_context *context;
+  vulkan_command_buffer *command_buffer;
+  u32 zone;
+} vulkan_gpu_scope;
+
+void vulkan_gpu_scope_end(vulkan_gpu_scope *scope);
+
+/**
+ * Times the commands recorded in the rest of the enclosing block as a GPU
+ * zone called `name`.
+ */
+#define VULKAN_GPU_SCOPE(context, command_buffer, name)                        \
+  vulkan_gpu_scope KPROFILE_CONCAT(vulkan_gpu_scope_, __LINE__)                \
+      __attribute__((cleanup(vulkan_gpu_scope_end))) = {                       \
+          context, command_buffer,                                             \
+          vulkan_gpu_zone_begin(context, command_buffer, name)}
+
+#else
+
+#define VULKAN_GPU_SCOPE(context, command_buffer, name)
+
+#endif
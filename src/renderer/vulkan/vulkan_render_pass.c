@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_VULKAN
+
 #include "vulkan_render_pass.h"
 
 #define ATTACHMENT_COUNT 2
@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_VULKAN
+
 #include "vulkan_swapchain.h"
 
 #include "containers/darray.h"
@@ -37,8 +39,7 @@ bool vulkan_swapchain_acquire_next_image_index(
       image_available_semaphore, fence, out_image_index);
 
   if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-    vulkan_swapchain_recreate(context, context->framebuffer_width,
-                              context->framebuffer_height, swapchain);
+    // Recreated by the backend, along with what refers to its images.
     return false;
   } else if (!(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)) {
     kfatal("Failed to acquire swapchain image!");
@@ -48,7 +49,7 @@ bool vulkan_swapchain_acquire_next_image_index(
   return true;
 }
 
-void vulkan_swapchain_present(vulkan_context *context,
+bool vulkan_swapchain_present(vulkan_context *context,
                               vulkan_swapchain *swapchain,
                               VkQueue graphics_queue, VkQueue present_queue,
                               VkSemaphore render_complete_semaphore,
@@ -65,19 +66,24 @@ void vulkan_swapchain_present(vulkan_context *context,
   };
   (void)graphics_queue;
   VkResult result = vkQueuePresentKHR(present_queue, &present_info);
+  bool up_to_date = true;
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-    vulkan_swapchain_recreate(context, context->framebuffer_width,
-                              context->framebuffer_height, swapchain);
+    up_to_date = false;
   } else if (result != VK_SUCCESS) {
     kfatal("Failed to present swapchain image!");
   }
 
   context->current_frame =
       (context->current_frame + 1) % swapchain->max_frames_in_flight;
+  return up_to_date;
 }
 
 void create(vulkan_context *context, u32 width, u32 height,
             vulkan_swapchain *swapchain) {
+  // The surface's extent changes with the window.
+  vulkan_device_query_swapchain_support(context->device.physical_device,
+                                        context->surface,
+                                        &context->device.swapchain_support);
   VkSurfaceCapabilitiesKHR capabilities =
       context->device.swapchain_support.capabilities;
 
@@ -116,9 +122,6 @@ void create(vulkan_context *context, u32 width, u32 height,
     }
   }
 
-  vulkan_device_query_swapchain_support(context->device.physical_device,
-                                        context->surface,
-                                        &context->device.swapchain_support);
   VkExtent2D extent = {.width = width, .height = height};
   if (capabilities.currentExtent.width != UINT32_MAX) {
     extent = capabilities.currentExtent;
@@ -128,6 +131,7 @@ void create(vulkan_context *context, u32 width, u32 height,
                         capabilities.maxImageExtent.width);
   extent.height = KCLAMP(extent.height, capabilities.minImageExtent.height,
                          capabilities.maxImageExtent.height);
+  swapchain->extent = extent;
 
   bool present_shares_graphics = context->device.present_queue_index ==
                                  context->device.graphics_queue_index;
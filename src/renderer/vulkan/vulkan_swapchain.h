@@ -11,11 +11,19 @@ void vulkan_swapchain_recreate(vulkan_context *context, u32 width, u32 height,
 void vulkan_swapchain_destroy(vulkan_context *context,
                               vulkan_swapchain *swapchain);
 
+/**
+ * @returns `false` if no image was acquired, also when the swapchain is out
+ * of date and has to be recreated first.
+ */
 bool vulkan_swapchain_acquire_next_image_index(
     vulkan_context *context, vulkan_swapchain *swapchain, u64 timeout_ms,
     VkSemaphore image_available_semaphore, VkFence fence, u32 *out_image_index);
 
-void vulkan_swapchain_present(vulkan_context *context,
+/**
+ * @returns `false` if the swapchain is out of date or suboptimal and should
+ * be recreated.
+ */
+bool vulkan_swapchain_present(vulkan_context *context,
                               vulkan_swapchain *swapchain,
                               VkQueue graphics_queue, VkQueue present_queue,
                               VkSemaphore render_complete_semaphore,
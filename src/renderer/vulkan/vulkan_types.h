@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/asserts.h"
+#include "core/profiler.h"
 
 #include <vulkan/vulkan.h>
 
@@ -44,6 +45,9 @@ typedef struct vulkan_device {
   VkCommandPool graphics_command_pool;
 
   VkFormat depth_format;
+
+  // VK_EXT_calibrated_timestamps is enabled.
+  bool calibrated_timestamps;
 } vulkan_device;
 
 typedef enum vulkan_render_pass_state {
@@ -77,6 +81,8 @@ typedef struct vulkan_swapchain {
   VkSurfaceFormatKHR image_format;
   u8 max_frames_in_flight;
   VkSwapchainKHR handle;
+  // May differ from the size asked for, within the surface's limits.
+  VkExtent2D extent;
   u32 image_count;
   VkImage *images;
   VkImageView *views;
@@ -107,9 +113,54 @@ typedef struct vulkan_fence {
   bool is_signaled;
 } vulkan_fence;
 
+// Most frames in flight the GPU profiler keeps queries for.
+#define VULKAN_GPU_PROFILER_MAX_FRAMES 3
+
+// GPU zones per frame, each taking two timestamp queries.
+#define VULKAN_GPU_ZONES_PER_FRAME 32
+
+typedef struct vulkan_gpu_zone {
+  const char *name;
+  u32 depth;
+  bool ended;
+} vulkan_gpu_zone;
+
+// The timestamp queries of one frame in flight.
+typedef struct vulkan_gpu_frame {
+  VkQueryPool query_pool;
+  u32 zone_count;
+  // Nesting depth of the zones currently open.
+  u32 depth;
+  // Zone i owns queries 2i and 2i + 1.
+  vulkan_gpu_zone zones[VULKAN_GPU_ZONES_PER_FRAME];
+} vulkan_gpu_frame;
+
+/**
+ * Times GPU zones with timestamp queries and merges them into the CPU
+ * profiler's trace. GPU ticks are mapped onto the CPU timeline from paired
+ * readings of both clocks.
+ */
+typedef struct vulkan_gpu_profiler {
+  bool supported;
+  // Nanoseconds per timestamp tick.
+  f64 timestamp_period;
+  u64 timestamp_mask;
+  PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
+  // A GPU timestamp and the CPU time it was taken at.
+  u64 calibration_ticks;
+  u64 calibration_ns;
+  u64 next_calibration_ns;
+  vulkan_gpu_frame frames[VULKAN_GPU_PROFILER_MAX_FRAMES];
+  profile_track *track;
+} vulkan_gpu_profiler;
+
 typedef struct vulkan_context {
   u32 framebuffer_width;
   u32 framebuffer_height;
+  // Bumped on each resize. The swapchain is recreated when it is ahead of
+  // the generation it was last created for.
+  u64 framebuffer_size_generation;
+  u64 framebuffer_size_last_generation;
 
   VkInstance instance;
   VkAllocationCallbacks *allocator;
@@ -138,6 +189,13 @@ typedef struct vulkan_context {
 
   bool recreating_swapchain;
 
+#if defined(KPROFILE_ENABLED)
+  vulkan_gpu_profiler gpu_profiler;
+  // Zones open from begin_frame to end_frame.
+  u32 gpu_frame_zone;
+  u32 gpu_render_pass_zone;
+#endif
+
   i32 (*find_memory_index)(u32 type_filter,
                            VkMemoryPropertyFlags property_flags);
 
@@ -1,3 +1,5 @@
+#define KLOG_CATEGORY LOG_CATEGORY_VULKAN
+
 #include "vulkan_utils.h"
 
 const char *vulkan_result_string(VkResult result, bool get_extended) {
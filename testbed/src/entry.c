@@ -1,6 +1,7 @@
 #include "game.h"
 #include <core/kmemory.h>
 #include <entry.h>
+#include <stdlib.h>
 
 #define WIDTH 1280
 #define HEIGHT 720
@@ -14,6 +15,27 @@ bool create_game(game *out_game) {
   out_game->app_config.start_width = WIDTH;
   out_game->app_config.start_height = HEIGHT;
   out_game->app_config.name = NAME;
+  // Scripted performance runs: KINPUT_RECORD=<file> captures a session,
+  // KINPUT_PLAYBACK=<file> replays it, and KHEADLESS skips the window and
+  // renderer so it can run without a window system.
+  out_game->app_config.headless = getenv("KHEADLESS") != nullptr;
+  out_game->app_config.input_record_path = getenv("KINPUT_RECORD");
+  out_game->app_config.input_playback_path = getenv("KINPUT_PLAYBACK");
+  out_game->app_config.input_thread = getenv("KINPUT_THREAD") != nullptr;
+  // KTARGET_FPS=<n> paces frames to n per second, unlimited by default.
+  const char *target_fps = getenv("KTARGET_FPS");
+  out_game->app_config.target_fps =
+      target_fps ? (u32)strtoul(target_fps, nullptr, 10) : 0;
+  // KFRAME_STATS=<seconds> logs frame time statistics that often.
+  const char *frame_stats = getenv("KFRAME_STATS");
+  out_game->app_config.frame_stats_log_seconds =
+      frame_stats ? strtof(frame_stats, nullptr) : 0;
+  // KJOB_WORKERS=<n> starts n job workers instead of one per physical core.
+  const char *job_workers = getenv("KJOB_WORKERS");
+  out_game->app_config.job_worker_count =
+      job_workers ? (u32)strtoul(job_workers, nullptr, 10) : 0;
+  // KRENDER_THREAD draws frames on a thread of their own.
+  out_game->app_config.render_thread = getenv("KRENDER_THREAD") != nullptr;
   out_game->initialize = game_initialize;
   out_game->update = game_update;
   out_game->render = game_render;
@@ -0,0 +1,38 @@
+#include <core/log_binary.h>
+
+#include <stdio.h>
+
+// Turns a binary log written with the `binary_log` option back into text.
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: %s <console.klog> [output.log]\n", argv[0]);
+    return 2;
+  }
+
+  FILE *in = fopen(argv[1], "rb");
+  if (!in) {
+    fprintf(stderr, "Could not open `%s`\n", argv[1]);
+    return 1;
+  }
+
+  FILE *out = stdout;
+  if (argc == 3) {
+    out = fopen(argv[2], "w");
+    if (!out) {
+      fprintf(stderr, "Could not open `%s` for writing\n", argv[2]);
+      fclose(in);
+      return 1;
+    }
+  }
+
+  bool ok = log_binary_decode(in, out);
+  if (!ok) {
+    fprintf(stderr, "`%s` is not a complete binary log\n", argv[1]);
+  }
+
+  fclose(in);
+  if (out != stdout) {
+    fclose(out);
+  }
+  return ok ? 0 : 1;
+}
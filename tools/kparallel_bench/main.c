@@ -0,0 +1,201 @@
+#include <core/clock.h>
+#include <core/job_system.h>
+#include <core/kmemory.h>
+#include <core/kparallel.h>
+#include <core/logger.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRANSFORM_COUNT 1000000ULL
+#define DEFAULT_ITERATIONS 20
+#define DELTA_TIME (1.0F / 60.0F)
+#define BOUNDS 100.0F
+
+typedef struct transform {
+  f32 position[3];
+  f32 velocity[3];
+  // Rotation about the up axis, and its change per update, as unit complex
+  // numbers.
+  f32 rotation[2];
+  f32 spin[2];
+  f32 scale;
+  f32 model[16];
+} transform;
+
+typedef struct bounds {
+  f32 min[3];
+  f32 max[3];
+} bounds;
+
+// Moves, bounces and spins each transform, then rebuilds its model matrix.
+static void update_transforms(u64 start, u64 end, void *context) {
+  transform *transforms = context;
+  for (u64 i = start; i < end; ++i) {
+    transform *t = &transforms[i];
+    for (u32 axis = 0; axis < 3; ++axis) {
+      t->position[axis] += t->velocity[axis] * DELTA_TIME;
+      if (t->position[axis] > BOUNDS || t->position[axis] < -BOUNDS) {
+        t->velocity[axis] = -t->velocity[axis];
+      }
+    }
+
+    f32 c = t->rotation[0] * t->spin[0] - t->rotation[1] * t->spin[1];
+    f32 s = t->rotation[0] * t->spin[1] + t->rotation[1] * t->spin[0];
+    // One Newton step back to unit length, against rounding drift.
+    f32 renormalize = 1.5F - 0.5F * (c * c + s * s);
+    t->rotation[0] = c * renormalize;
+    t->rotation[1] = s * renormalize;
+
+    f32 *m = t->model;
+    m[0] = t->rotation[0] * t->scale;
+    m[1] = 0.0F;
+    m[2] = -t->rotation[1] * t->scale;
+    m[3] = 0.0F;
+    m[4] = 0.0F;
+    m[5] = t->scale;
+    m[6] = 0.0F;
+    m[7] = 0.0F;
+    m[8] = t->rotation[1] * t->scale;
+    m[9] = 0.0F;
+    m[10] = t->rotation[0] * t->scale;
+    m[11] = 0.0F;
+    m[12] = t->position[0];
+    m[13] = t->position[1];
+    m[14] = t->position[2];
+    m[15] = 1.0F;
+  }
+}
+
+static void reduce_bounds(u64 start, u64 end, void *context, void *partial) {
+  const transform *transforms = context;
+  bounds *b = partial;
+  for (u64 i = start; i < end; ++i) {
+    for (u32 axis = 0; axis < 3; ++axis) {
+      f32 p = transforms[i].position[axis];
+      b->min[axis] = p < b->min[axis] ? p : b->min[axis];
+      b->max[axis] = p > b->max[axis] ? p : b->max[axis];
+    }
+  }
+}
+
+static void combine_bounds(void *result, const void *partial, void *context) {
+  (void)context;
+  bounds *b = result;
+  const bounds *p = partial;
+  for (u32 axis = 0; axis < 3; ++axis) {
+    b->min[axis] = p->min[axis] < b->min[axis] ? p->min[axis] : b->min[axis];
+    b->max[axis] = p->max[axis] > b->max[axis] ? p->max[axis] : b->max[axis];
+  }
+}
+
+static void reset_transforms(transform *transforms) {
+  srand(1);
+  for (u64 i = 0; i < TRANSFORM_COUNT; ++i) {
+    transform *t = &transforms[i];
+    for (u32 axis = 0; axis < 3; ++axis) {
+      t->position[axis] = ((f32)rand() / RAND_MAX * 2.0F - 1.0F) * BOUNDS;
+      t->velocity[axis] = ((f32)rand() / RAND_MAX * 2.0F - 1.0F) * 10.0F;
+    }
+    t->rotation[0] = 1.0F;
+    t->rotation[1] = 0.0F;
+    // About 0.57 degrees per update.
+    t->spin[0] = 0.99995F;
+    t->spin[1] = 0.0099998F;
+    t->scale = 1.0F;
+  }
+}
+
+/**
+ * Runs the update and the reduction `iterations` times.
+ * @returns The average nanoseconds per iteration of each.
+ */
+static void run(transform *transforms, u32 iterations, f64 *out_for_ns,
+                f64 *out_reduce_ns, bounds *out_bounds) {
+  reset_transforms(transforms);
+  // Warms the caches and wakes the workers up.
+  kparallel_for(TRANSFORM_COUNT, 0, update_transforms, transforms);
+
+  u64 for_ns = 0;
+  u64 reduce_ns = 0;
+  for (u32 i = 0; i < iterations; ++i) {
+    clock timer = {};
+    clock_start(&timer);
+    kparallel_for(TRANSFORM_COUNT, 0, update_transforms, transforms);
+    clock_update(&timer);
+    for_ns += timer.elapsed_ns;
+
+    *out_bounds = (bounds){
+        .min = {BOUNDS * 2, BOUNDS * 2, BOUNDS * 2},
+        .max = {-BOUNDS * 2, -BOUNDS * 2, -BOUNDS * 2},
+    };
+    clock_start(&timer);
+    kparallel_reduce(TRANSFORM_COUNT, 0, reduce_bounds, combine_bounds,
+                     transforms, out_bounds, sizeof(bounds));
+    clock_update(&timer);
+    reduce_ns += timer.elapsed_ns;
+  }
+  *out_for_ns = (f64)for_ns / iterations;
+  *out_reduce_ns = (f64)reduce_ns / iterations;
+}
+
+// Measures how kparallel_for and kparallel_reduce scale over a transform
+// update of a million elements, from 1 thread to one per physical core.
+int main(int argc, char **argv) {
+  if (argc > 3) {
+    fprintf(stderr, "usage: %s [max_threads] [iterations]\n", argv[0]);
+    return 2;
+  }
+
+  initialize_memory();
+  initialize_logging();
+
+  u32 max_threads = argc > 1 ? (u32)strtoul(argv[1], nullptr, 10) : 0;
+  if (max_threads == 0) {
+    job_system_initialize(0);
+    max_threads = job_system_worker_count() + 1;
+    job_system_shutdown();
+  }
+  u32 iterations =
+      argc > 2 ? (u32)strtoul(argv[2], nullptr, 10) : DEFAULT_ITERATIONS;
+  if (iterations == 0) {
+    iterations = 1;
+  }
+
+  transform *transforms =
+      kallocate(sizeof(transform) * TRANSFORM_COUNT, MEMORY_TAG_APPLICATION);
+
+  printf("%llu transforms, %u iterations\n", TRANSFORM_COUNT, iterations);
+  printf("threads   for ms  speedup  efficiency   reduce ms  speedup\n");
+  f64 serial_for_ns = 0;
+  f64 serial_reduce_ns = 0;
+  for (u32 threads = 1; threads <= max_threads; ++threads) {
+    // With a single thread the job system stays stopped, and jobs run as
+    // they are submitted.
+    if (threads > 1 && !job_system_initialize(threads - 1)) {
+      break;
+    }
+
+    f64 for_ns;
+    f64 reduce_ns;
+    bounds b;
+    run(transforms, iterations, &for_ns, &reduce_ns, &b);
+    if (threads == 1) {
+      serial_for_ns = for_ns;
+      serial_reduce_ns = reduce_ns;
+    }
+    f64 speedup = serial_for_ns / for_ns;
+    printf("%7u %8.3f %8.2fx %10.0f%% %11.3f %7.2fx\n", threads,
+           for_ns / 1000000.0, speedup, speedup / threads * 100.0,
+           reduce_ns / 1000000.0, serial_reduce_ns / reduce_ns);
+
+    if (threads > 1) {
+      job_system_shutdown();
+    }
+  }
+
+  kfree(transforms);
+  shutdown_logging();
+  shutdown_memory();
+  return 0;
+}